@@ -23,103 +23,230 @@
  */
 
 #include "bus.h"
+#include "machine.h"
 
-uint8_t cpuRAM[2048];
-uint8_t* prgRAM = NULL;
-
-INES cartridge;
-char trace[150];
-char debugOverlayString[32];
-
-bool cpuPaused = false;
-bool audioEnabled = false;
-
-SyncMode syncMode = SYNC_REALTIME;
-
-int32_t cyclesUntilDelay = 0;
-int32_t cyclesUntilSample = 0;
-int32_t cyclesUntilSecond = 0;
-uint64_t frameIntervalCount = 0;
-uint32_t cpuTimeCount = 0;
-uint32_t ppuCycleDebt = 0;
-uint32_t cyclesPerSec = 0;
-uint32_t totalCPUCycles = 0;
-
-#if (PERFORMANCE_DEBUG)
-uint32_t framesElapsed = 0;
-uint32_t framesPerSec = 0;
-double usecsElapsed = 0;
-
-uint32_t freqHertz;
-uint32_t framerate;
-struct timeval t1, t2;
-struct timeval pt1, pt2;
-struct timeval pd1, pd2;
-#endif
-
-void bus_init(FileBinary* bin) {
-  debugOverlayString[0] = '\0';
-  #if (PERFORMANCE_DEBUG)
-  gettimeofday(&t1, NULL);
-  gettimeofday(&pd1, NULL);
-  #endif
+machine_local HotState hot;
+
+// cold: only touched when loading, saving or mapping the cartridge
+machine_local uint32_t prgRAMSize = 0;
+machine_local bool prgRAMMapped = false;
+machine_local bool cartAccurateTiming = false;
+machine_local uint32_t cartID = 0;
+
+// numbers the cartridges loaded by the process (on any thread), so one
+// loaded where another was freed isn't taken for it
+static uint32_t cartCount = 0;
+
+machine_local INES cartridge;
+machine_local char trace[150];
 
-  io_init(DISPLAY_SCALE);
+machine_local bool audioEnabled = false;
 
-  // panic if issues with rom
-  if (bin == NULL) {
-    io_panic("(I/O) 0x00 NO_ROM");
-    while (true) io_pollJoypad(&bus_handleInput);
+machine_local SyncMode syncMode = SYNC_REALTIME;
+
+machine_local uint64_t frameIntervalCount = 0;
+machine_local uint32_t cpuTimeCount = 0;
+
+// chosen for the whole process; each console resolves it on attach
+EngineConfig engineConfig = {
+  EMU_MODE,
+  HEADLESS ? PPURENDER_NONE : (PPU_IMMEDIATE_CATCHUP ? PPURENDER_SCANLINE : PPURENDER_FRAME),
+  CPU_TIMING,
+  LOGGING
+};
+machine_local CPURunLoop runLoop = NULL;
+machine_local void(*traceSink)(char*) = NULL;
+
+/**
+ * @brief Guess whether a game depends on exact CPU timing. Games which poll
+ *        for sprite zero hits to split the screen (BIT $2002 then BVC/BVS,
+ *        or LDA $2002 then AND #$40) time their writes against the PPU.
+ * 
+ * @param prg the PRG ROM
+ * @param size its size in bytes
+ * @return bool whether the game wants accurate timing
+ */
+static bool bus_wantsAccurateTiming(uint8_t* prg, uint32_t size) {
+  for (uint32_t i = 0; i + 4 < size; i++) {
+    if (prg[i + 1] != 0x02 || prg[i + 2] != 0x20) continue;
+    if (prg[i] == 0x2C && (prg[i + 3] == 0x50 || prg[i + 3] == 0x70)) return true;
+    if (prg[i] == 0xAD && prg[i + 3] == 0x29 && prg[i + 4] == 0x40) return true;
   }
+  return false;
+}
 
-  if (!bus_parseROM(bin)) {
-    io_panic("(I/O) 0x01 INVALID_ROM");
-    while (true) io_pollJoypad(&bus_handleInput);
+/**
+ * @brief Get the size of the cartridge's CHR ROM, or of its CHR RAM if it
+ *        has none
+ * 
+ * @return uint32_t the size in bytes
+ */
+static uint32_t bus_chrSize() {
+  return (cartridge.header.chrRomSize ? cartridge.header.chrRomSize : 1) * 8192;
+}
+
+/**
+ * @brief Point the CPU and PPU at the inserted cartridge and pick the run
+ *        loop, without resetting anything
+ * 
+ * @param prog the cartridge's decoded program
+ */
+static void bus_connect(BytecodeProgram* prog) {
+  // a 16 KB cartridge is mirrored at $C000
+  hot.prgBanks[0] = cartridge.prgRom;
+  hot.prgBanks[1] = cartridge.prgRom + ((cartridge.header.prgRomSize > 1) ? 16384 : 0);
+
+  ppu_insertCartridge(cartridge.chrRom, bus_chrSize(), cartID, cartridge.header.chrRomSize == 0, cartridge.header.mirroringType == MIRRORING_VERTICAL, &bus_readCPU, &bus_ppuReport, engineConfig.renderMode);
+  cpu6502_init(&bus_writeCPU, &bus_readCPU, engineConfig.cpuMode, prog);
+  cpu6502_setAccurateTiming(cartAccurateTiming);
+  runLoop = cpu6502_getRunLoop(engineConfig.cpuMode, cartAccurateTiming, engineConfig.tracing);
+  switch (engineConfig.renderMode) {
+    case PPURENDER_SCANLINE: hot.cpuReport = &bus_cpuReportScanline; break;
+    case PPURENDER_NONE: hot.cpuReport = &bus_cpuReportHeadless; break;
+    case PPURENDER_DOT: hot.cpuReport = &bus_cpuReportDot; break;
+    default: hot.cpuReport = &bus_cpuReportFrame; break;
   }
+  traceSink = engineConfig.tracing ? &bus_saveTrace : NULL;
+}
 
-  if (HEADLESS) {
-    // looks like somebody chopped off the PPU!
-    io_printString("DISPLAY OFF", 88, 64);
+/**
+ * @brief Power on the CPU and PPU with the selected engine
+ */
+static void bus_powerOn() {
+  uint32_t prgSize = (uint32_t)cartridge.header.prgRomSize * 16384;
+  cartAccurateTiming = engineConfig.timing == CPUTIMING_ACCURATE ||
+    (engineConfig.timing == CPUTIMING_AUTO && bus_wantsAccurateTiming(cartridge.prgRom, prgSize));
+
+  BytecodeProgram* prog = NULL;
+  if (engineConfig.cpuMode != CPUEMU_INTERPRET_DIRECT) {
+    prog = cpu6502_createBytecodeProgram();
+    bool cached = codecache_load(prog, cartridge.prgRom, prgSize, engineConfig.cpuMode);
+    hot.prgBytecode = prog;
+    if (!cached && engineConfig.cpuMode == CPUEMU_RECOMPILE_STATIC) {
+      cpu6502_loadBytecodeProgram(cartridge.prgRom, prgSize);
+      codecache_save(prog, cartridge.prgRom, prgSize, engineConfig.cpuMode);
+    }
   }
+  bus_connect(prog);
+  ppu_init();
+}
+
+void bus_selectEngine(EngineConfig config) {
+  engineConfig = config;
+}
 
-  if (LOGGING) {
-    logging_init();
+EngineConfig bus_getEngine() {
+  return engineConfig;
+}
+
+BusLoadResult bus_loadROM(FileBinary* bin) {
+  bus_unloadROM();
+  if (bin == NULL) return LOADROM_NO_ROM;
+  if (!bus_parseROM(bin)) {
+    bus_unloadROM();
+    return LOADROM_INVALID;
+  }
+  if (cartridge.header.mapperNumber != 0) {
+    bus_unloadROM();
+    return LOADROM_UNSUPPORTED_MAPPER;
   }
 
-  CPUEmulationMode mode = EMU_MODE; // perhaps this could be set dynamically?
+  cartID = __atomic_add_fetch(&cartCount, 1, __ATOMIC_RELAXED);
 
-  // initialize hardware
-  ppu_init(cartridge.chrRom, cartridge.header.mirroringType == MIRRORING_VERTICAL, &bus_readCPU, &bus_ppuReport);
-  cpu6502_init(&bus_writeCPU, &bus_readCPU, mode);
+  // power on with a clean machine
+  JoypadState joypad;
+  memset(&joypad, 0, sizeof(joypad));
+  joypad_loadState(&joypad);
+  memset(hot.cpuRAM, 0, sizeof(hot.cpuRAM));
+  hot.frameComplete = false;
+  hot.cyclesUntilDelay = 0;
+  hot.totalCPUCycles = 0;
+  hot.totalInstructions = 0;
 
-  #if (LIMIT_CLOCK_SPEED)
-  //bus_initClock();
-  #endif
+  bus_powerOn();
+  return LOADROM_OK;
+}
 
-  // determine if emulator should run in disassembly mode or not
-  if (mode == CPUEMU_INTERPRET_DIRECT || mode == CPUEMU_INTERPRET_CACHED) {
-    while (cpu6502_getClockMode() != CPUCLOCK_HALT) {
-      cpu6502_step(trace, &bus_cpuReport);
-    }
-  } else if (mode == CPUEMU_RECOMPILE_STATIC) {
-    cpu6502_loadBytecodeProgram(cartridge.prgRom, (uint32_t)cartridge.header.prgRomSize * 16384);
-    while (cpu6502_getClockMode() != CPUCLOCK_HALT) {
-      cpu6502_step(NULL, &bus_cpuReport);
-    }
-  } else if (mode == CPUEMU_DISASSEMBLE) {
-    //cpu6502_dasm(cartridge.prgRom, rom.header.prgRomSize * 16384, &nes_handleDisassemblyLine, DASM_MINIMAL);
-  }
+void bus_unloadROM() {
+  BusCartridge cart;
+  bus_detachCartridge(&cart);
+  bus_freeCartridge(&cart);
+}
+
+void bus_detachCartridge(BusCartridge* cart) {
+  cart->cartridge = cartridge;
+  cart->prgRAM = hot.prgRAM;
+  cart->prgRAMSize = prgRAMSize;
+  cart->prgRAMMapped = prgRAMMapped;
+  cart->bytecode = hot.prgBytecode;
+  cart->accurateTiming = cartAccurateTiming;
+  cart->id = cartID;
+  cartID = 0;
+  hot.prgBytecode = NULL;
+  cartridge.trainer = NULL;
+  cartridge.prgRom = NULL;
+  cartridge.chrRom = NULL;
+  hot.prgBanks[0] = NULL;
+  hot.prgBanks[1] = NULL;
+  hot.prgRAM = NULL;
+  prgRAMMapped = false;
+  hot.prgRAMDirty = false;
+}
+
+void bus_attachCartridge(BusCartridge* cart) {
+  cartridge = cart->cartridge;
+  hot.prgRAM = cart->prgRAM;
+  prgRAMSize = cart->prgRAMSize;
+  prgRAMMapped = cart->prgRAMMapped;
+  hot.prgRAMDirty = false;
+  cartAccurateTiming = cart->accurateTiming;
+  cartID = cart->id;
+
+  // the rest of the machine comes from bus_loadState
+  bus_connect(cart->bytecode);
+}
 
-  // CPU should never halt until shut off
-  switch (cpu6502_getErrno())
-  {
-    case 0: io_panic("(CPU) 0x00 UNEXPECTED_HALT"); break;
-    case 1: io_panic("(CPU) 0x01 ILLEGAL_INSTR"); break;
-    case 2: io_panic("(CPU) 0x02 ILLEGAL_BYTECODE"); break;
-    default: io_panic("(CPU) 0xFF UNKNOWN"); break;
+void bus_freeCartridge(BusCartridge* cart) {
+  if (cart->bytecode != NULL && cart->cartridge.prgRom != NULL) {
+    // keep whatever the interpreter decoded for the next run
+    codecache_save(cart->bytecode, cart->cartridge.prgRom, (uint32_t)cart->cartridge.header.prgRomSize * 16384, engineConfig.cpuMode);
+  }
+  cpu6502_freeBytecodeProgram(cart->bytecode);
+  cart->bytecode = NULL;
+  free(cart->cartridge.trainer);
+  free(cart->cartridge.prgRom);
+  free(cart->cartridge.chrRom);
+  if (cart->prgRAMMapped) {
+    msync(cart->prgRAM, cart->prgRAMSize, MS_SYNC);
+    munmap(cart->prgRAM, cart->prgRAMSize);
+  } else {
+    free(cart->prgRAM);
   }
-  cpu6502_setClockMode(CPUCLOCK_HALT);
-  while (true) io_pollJoypad(&bus_handleInput); // wait for user to exit, essentially
+  cart->cartridge.trainer = NULL;
+  cart->cartridge.prgRom = NULL;
+  cart->cartridge.chrRom = NULL;
+  cart->prgRAM = NULL;
+}
+
+void bus_setWriteHook(void(*hook)(uint16_t)) {
+  hot.writeHook = hook;
+}
+
+uint64_t bus_getCycleCount() {
+  return hot.totalCPUCycles;
+}
+
+uint64_t bus_getInstructionCount() {
+  return hot.totalInstructions;
+}
+
+uint8_t* bus_getCPURAM() {
+  return hot.cpuRAM;
+}
+
+uint8_t* bus_getPRGRAM(uint32_t* size) {
+  *size = (hot.prgRAM != NULL) ? prgRAMSize : 0;
+  return hot.prgRAM;
 }
 
 bool bus_parseROM(FileBinary* bin) {
@@ -146,7 +273,11 @@ bool bus_parseROM(FileBinary* bin) {
   pos = 16;
 
   // load trainer, if present
+  cartridge.trainer = NULL;
+  cartridge.prgRom = NULL;
+  cartridge.chrRom = NULL;
   if (header.containsTrainer) {
+    if ((pos + 512) > bin->bytes) return false;
     cartridge.trainer = malloc(sizeof(uint8_t) * 512);
     for (int i = 0; i < 512; i++) {
       cartridge.trainer[i] = bin->data[pos];
@@ -164,28 +295,134 @@ bool bus_parseROM(FileBinary* bin) {
 
   // load chr rom (or fail if size mismatch)
   if ((pos + (header.chrRomSize * 8192)) > bin->bytes) return false;
-  cartridge.chrRom = malloc(sizeof(uint8_t) * (header.chrRomSize * 8192));
-  for (int i = 0; i < (header.chrRomSize * 8192); i++) {
-    cartridge.chrRom[i] = bin->data[pos];
-    pos += 1;
+  if (header.chrRomSize == 0) {
+    // no chr rom means the cartridge has 8 KB of chr ram instead
+    cartridge.chrRom = calloc(8192, sizeof(uint8_t));
+  } else {
+    cartridge.chrRom = malloc(sizeof(uint8_t) * (header.chrRomSize * 8192));
+    for (int i = 0; i < (header.chrRomSize * 8192); i++) {
+      cartridge.chrRom[i] = bin->data[pos];
+      pos += 1;
+    }
   }
 
   if (header.containsPrgRam) {
-    prgRAM = malloc(sizeof(uint8_t) * (header.prgRamSize * 8192));
+    // a size of 0 infers 8 KB for compatibility
+    prgRAMSize = (header.prgRamSize ? header.prgRamSize : 1) * 8192;
+    hot.prgRAM = (bin->path != NULL) ? bus_mapBatteryRAM(bin->path, prgRAMSize) : NULL;
+    prgRAMMapped = (hot.prgRAM != NULL);
+
+    // fall back to volatile RAM if the save file isn't usable
+    if (!prgRAMMapped) hot.prgRAM = calloc(prgRAMSize, sizeof(uint8_t));
   }
 
   return true;
 }
 
+uint32_t bus_runFrame() {
+  hot.frameComplete = false;
+  uint32_t instructionCount = runLoop(&hot.frameComplete, hot.cpuReport, traceSink);
+  hot.totalInstructions += instructionCount;
+  return instructionCount;
+}
+
+bool bus_stepInstruction() {
+  hot.frameComplete = false;
+  cpu6502_step(engineConfig.tracing ? trace : NULL, hot.cpuReport);
+  if (engineConfig.tracing) bus_saveTrace(trace);
+  hot.totalInstructions += 1;
+  return hot.frameComplete;
+}
+
+void bus_setInputs(uint8_t* inputs) {
+  for (uint8_t port = 0; port < JOYPAD_PORT_COUNT; port++) {
+    joypad_setButtons(port, inputs[port]);
+  }
+}
+
+void bus_saveState(MachineState* state) {
+  cpu6502_saveState(&state->cpu);
+  ppu_saveState(&state->ppu);
+  joypad_saveState(&state->joypad);
+  memcpy(state->cpuRAM, hot.cpuRAM, sizeof(hot.cpuRAM));
+  if (hot.prgRAM != NULL) {
+    memcpy(state->prgRAM, hot.prgRAM, sizeof(state->prgRAM));
+  } else {
+    memset(state->prgRAM, 0, sizeof(state->prgRAM));
+  }
+  if (cartridge.chrRom != NULL && cartridge.header.chrRomSize == 0) {
+    memcpy(state->chrRAM, cartridge.chrRom, sizeof(state->chrRAM));
+  } else {
+    memset(state->chrRAM, 0, sizeof(state->chrRAM));
+  }
+  state->cyclesUntilDelay = hot.cyclesUntilDelay;
+  state->totalCPUCycles = hot.totalCPUCycles;
+}
+
+void bus_loadState(MachineState* state) {
+  cpu6502_loadState(&state->cpu);
+  ppu_loadState(&state->ppu);
+  joypad_loadState(&state->joypad);
+  memcpy(hot.cpuRAM, state->cpuRAM, sizeof(hot.cpuRAM));
+  if (hot.prgRAM != NULL) {
+    memcpy(hot.prgRAM, state->prgRAM, sizeof(state->prgRAM));
+    hot.prgRAMDirty = true;
+  }
+  if (cartridge.chrRom != NULL && cartridge.header.chrRomSize == 0) {
+    memcpy(cartridge.chrRom, state->chrRAM, sizeof(state->chrRAM));
+    ppu_invalidateChrCache();
+  }
+  hot.cyclesUntilDelay = state->cyclesUntilDelay;
+  hot.totalCPUCycles = state->totalCPUCycles;
+}
+
+uint8_t* bus_mapBatteryRAM(char* romPath, uint32_t size) {
+  if (romPath == NULL) return NULL;
+
+  // swap the ROM's extension for .sav
+  char path[strlen(romPath) + 5];
+  strcpy(path, romPath);
+  char* ext = strrchr(path, '.');
+  char* dir = strrchr(path, '/');
+  if (ext != NULL && (dir == NULL || ext > dir)) *ext = '\0';
+  strcat(path, ".sav");
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return NULL;
+
+  // new (or short) files are zero-filled up to the RAM size
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (st.st_size < size && ftruncate(fd, size) != 0)) {
+    close(fd);
+    return NULL;
+  }
+
+  uint8_t* ram = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd); // the mapping keeps the file alive
+  return (ram == MAP_FAILED) ? NULL : ram;
+}
+
+void bus_syncBatteryRAM(bool blocking) {
+  if (!prgRAMMapped) return;
+  if (blocking) {
+    msync(hot.prgRAM, prgRAMSize, MS_SYNC);
+  } else if (hot.prgRAMDirty) {
+    // just schedule writeback; the kernel flushes it in the background
+    msync(hot.prgRAM, prgRAMSize, MS_ASYNC);
+  }
+  hot.prgRAMDirty = false;
+}
+
 void bus_writeCPU(uint16_t addr, uint8_t data) {
-  if (addr <= 0x1FFF) {
-    cpuRAM[addr] = data;
+  if (hot.writeHook != NULL) hot.writeHook(addr);
+  if (addr <= 0x07FF) {
+    hot.cpuRAM[addr] = data;
   } else if (addr <= 0x0FFF) {
-    cpuRAM[addr - 0x0800] = data;
+    hot.cpuRAM[addr - 0x0800] = data;
   } else if (addr <= 0x17FF) {
-    cpuRAM[addr - 0x1000] = data;
+    hot.cpuRAM[addr - 0x1000] = data;
   } else if (addr <= 0x1FFF) {
-    cpuRAM[addr - 0x1800] = data;
+    hot.cpuRAM[addr - 0x1800] = data;
   } else if (addr <= 0x3FFF) {
     addr = (addr & 0x0007) | 0x2000;
     if (addr == 0x2000) { // ppu control
@@ -221,13 +458,13 @@ void bus_writeCPU(uint16_t addr, uint8_t data) {
 
 uint8_t bus_readCPU(uint16_t addr) {
   if (addr <= 0x07FF) {
-    return cpuRAM[addr];
+    return hot.cpuRAM[addr];
   } else if (addr <= 0x0FFF) {
-    return cpuRAM[addr - 0x0800];
+    return hot.cpuRAM[addr - 0x0800];
   } else if (addr <= 0x17FF) {
-    return cpuRAM[addr - 0x1000];
+    return hot.cpuRAM[addr - 0x1000];
   } else if (addr <= 0x1FFF) {
-    return cpuRAM[addr - 0x1800];
+    return hot.cpuRAM[addr - 0x1800];
   } else if (addr <= 0x3FFF) {
     addr = (addr & 0x0007) | 0x2000;
     if (addr == 0x2000) {
@@ -251,7 +488,9 @@ uint8_t bus_readCPU(uint16_t addr) {
     if (addr == 0x4014) {
       return ppu_readRegister(PPU_OAMDMA);
     } else if (addr == 0x4016) {
-      return joypad_read();
+      return joypad_read(0);
+    } else if (addr == 0x4017) {
+      return joypad_read(1);
     }
     return 0; // apu & i/o regs
   } else if (addr <= 0x401F) {
@@ -262,14 +501,20 @@ uint8_t bus_readCPU(uint16_t addr) {
   return 0;
 }
 
+bool bus_peekCPU(uint16_t addr, uint8_t* data) {
+  if (addr >= 0x2000 && addr <= 0x401F) return false;
+  *data = (addr <= 0x1FFF) ? hot.cpuRAM[addr & 0x07FF] : bus_cartridgeRead(addr);
+  return true;
+}
+
 uint16_t bus_readCPUAddr(uint16_t addr) {
   return ((uint16_t)bus_readCPU(addr + 1) << 8) | (uint16_t)bus_readCPU(addr);
 }
 
 void bus_writeCPUAddr(uint16_t address, uint16_t data) {
   if (address < 0x2000) { // cpu ram
-    cpuRAM[address] = (data << 8) >> 8;
-    cpuRAM[address + 1] = data >> 8;
+    hot.cpuRAM[address] = (data << 8) >> 8;
+    hot.cpuRAM[address + 1] = data >> 8;
   }
 }
 
@@ -280,7 +525,8 @@ void bus_cartridgeWrite(uint16_t addr, uint8_t data) {
       // invalid write
     } else if (addr <= 0x7FFF) {
       if (cartridge.header.containsPrgRam) {
-        prgRAM[addr - 0x6000] = data;
+        hot.prgRAM[addr - 0x6000] = data;
+        hot.prgRAMDirty = true;
       } else {
         // invalid write
       }
@@ -288,123 +534,75 @@ void bus_cartridgeWrite(uint16_t addr, uint8_t data) {
       // invalid write
     }
   } else {
-    io_panic("(I/O) 0x02 UNSUPPORTED_MAPPER");
-    while (true) io_pollJoypad(&bus_handleInput);
+    cpu6502_setClockMode(CPUCLOCK_HALT); // bus_loadROM rejects these
   }
 }
 
 uint8_t bus_cartridgeRead(uint16_t addr) {
+  if (addr >= 0x8000) {
+    // mapper 0 (bus_loadROM rejects the rest); see bus_powerOn
+    return hot.prgBanks[(addr >> 14) & 1][addr & 0x3FFF];
+  }
   if (cartridge.header.mapperNumber == 0) {
     // mapper 0
     if (addr < 0x6000) {
       //exceptions_invalidMemoryRead(addr);
     } else if (addr <= 0x7FFF) {
       if (cartridge.header.containsPrgRam) {
-        return prgRAM[addr - 0x6000];
-      } else {
-        //exceptions_invalidMemoryRead(addr);
-      }
-    } else if (addr <= 0xBFFF) {
-      return cartridge.prgRom[addr - 0x8000];
-    } else if (addr <= 0xFFFF) {
-      if (cartridge.header.prgRomSize == 1) {
-        return cartridge.prgRom[addr - 0xC000];
-      } else if (cartridge.header.prgRomSize == 2) {
-        return cartridge.prgRom[addr - 0x8000];
+        return hot.prgRAM[addr - 0x6000];
       } else {
         //exceptions_invalidMemoryRead(addr);
       }
     }
   } else {
-    io_panic("(I/O) 0x02 UNSUPPORTED_MAPPER");
-    while (true) io_pollJoypad(&bus_handleInput);
+    cpu6502_setClockMode(CPUCLOCK_HALT); // bus_loadROM rejects these
   }
   return 0;
 }
 
-void bus_setJoypad(JoypadButton button) {
-    joypad_setButton(button);
-}
-
-void bus_unsetJoypad(JoypadButton button) {
-    joypad_unsetButton(button);
-}
-
-void bus_initClock() {
-  struct timeval tv1, tv2;
-  gettimeofday(&tv1, NULL);
-  uint64_t elapsed;
-  
-  while (cpu6502_getClockMode() != CPUCLOCK_HALT)
-  {
-    gettimeofday(&tv2, NULL);
-    elapsed = ((tv2.tv_sec - tv1.tv_sec) * 1000000) + (tv2.tv_usec - tv1.tv_usec);
-
-    // suspend CPU until specified time has elapsed
-    if (elapsed >= DISPLAY_FRAME_USEC) {
-      bus_frameIntervalReport();
-      tv1 = tv2;
-      elapsed -= DISPLAY_FRAME_USEC;
-    }
-
-    if (LOGGING && !cpuPaused) {
-      cpu6502_step(trace, &bus_cpuReport);
-      logging_saveNESTrace(trace, totalCPUCycles); 
+static force_inline void bus_cpuReportAs(PPURenderMode renderMode, uint8_t cycleCount) {
+  hot.totalCPUCycles += cycleCount;
+  // update PPU
+  if (renderMode != PPURENDER_NONE) {
+    // let PPU catch up either immediately or once per frame
+    // run 3x the number of cycles on the PPU
+    if (renderMode == PPURENDER_SCANLINE) {
+      ppu_runScanlineCycles(cycleCount * 3);
+    } else if (renderMode == PPURENDER_DOT) {
+      ppu_runDotCycles(cycleCount * 3);
     } else {
-      if (!cpuPaused) cpu6502_step(NULL, &bus_cpuReport);
+      ppu_runFrameCycles(cycleCount * 3);
     }
-  }
-
-  io_panic("(CPU) 0x00 UNEXPECTED_HALT");
-  while (true) io_pollJoypad(&bus_handleInput);
-}
-
-void bus_initPPU() {
-    #if (!HEADLESS)
-    ppu_init(cartridge.chrRom, cartridge.header.mirroringType == MIRRORING_VERTICAL, &bus_readCPU, &bus_ppuReport);
-    #endif
-}
 
-void bus_cpuReport(uint8_t cycleCount) {
-  cyclesPerSec += cycleCount;
-  totalCPUCycles += cycleCount;
-  // update PPU
-  #if (!HEADLESS)
-  ppuCycleDebt += cycleCount;
-  // let PPU catch up either immediately or once per frame
-  // run 3x the number of cycles on the PPU
-  ppu_runCycles(cycleCount * 3);
-
-  // determine if necessary to generate NMI
-  if (ppu_getControlFlag(PPUCTRL_GENVBNMI)
-    && ppu_getStatusFlag(PPUSTAT_VBLKSTART)) {
-    bus_triggerNMI();
-    ppu_setStatusFlag(PPUSTAT_VBLKSTART, false);
+    // determine if necessary to generate NMI
+    if (ppu_getControlFlag(PPUCTRL_GENVBNMI)
+      && ppu_getStatusFlag(PPUSTAT_VBLKSTART)) {
+      bus_triggerNMI();
+      ppu_setStatusFlag(PPUSTAT_VBLKSTART, false);
+    }
   }
-  
-  #endif
 
   // update cycle counters
-  cyclesUntilDelay -= cycleCount;
-  cyclesUntilSample -= cycleCount;
-  cyclesUntilSecond -= cycleCount;
-
-  // pause CPU until next frame interval
-  if (cyclesUntilDelay <= 0) {
-      if (syncMode != SYNC_DISABLED) cpuPaused = true;
-      cyclesUntilDelay += CPU_FRAME_CYCLES;
+  hot.cyclesUntilDelay -= cycleCount;
+  hot.cyclesUntilSample -= cycleCount;
+  hot.cyclesUntilSecond -= cycleCount;
+
+  // frame interval (by CPU cycles)
+  if (hot.cyclesUntilDelay <= 0) {
+      hot.cyclesUntilDelay += CPU_FRAME_CYCLES;
+      if (renderMode == PPURENDER_NONE) hot.frameComplete = true; // no PPU to report frames
   }
 
   // CPU second has elapsed (CPU second = 1789773 clocks)
-  if (cyclesUntilSecond <= 0) {
+  if (hot.cyclesUntilSecond <= 0) {
       cpuTimeCount += 1;
-      cyclesUntilSecond = CPU_FREQUENCY;
+      hot.cyclesUntilSecond = CPU_FREQUENCY;
   }
 
   // fill audio buffer
-  if (audioEnabled && cyclesUntilSample <= 0) {
+  if (audioEnabled && hot.cyclesUntilSample <= 0) {
       // TODO: Queue audio sample
-      cyclesUntilSample = 40;
+      hot.cyclesUntilSample = 40;
   }
 
   #if (DEBUG_MODE)
@@ -412,61 +610,32 @@ void bus_cpuReport(uint8_t cycleCount) {
   #endif
 }
 
-void bus_frameIntervalReport() {
-    frameIntervalCount += 1;
-    if (syncMode == SYNC_REALTIME) cpuPaused = false;
+void bus_cpuReportFrame(uint8_t cycleCount) {
+  bus_cpuReportAs(PPURENDER_FRAME, cycleCount);
 }
 
-void bus_ppuReport() {
-  // If desired, alculate & display framerate and CPU frequency
-  #if (PERFORMANCE_DEBUG)
-  gettimeofday(&pd2, NULL); // poll delay
-  uint32_t delayCounter = (pd2.tv_sec - pd1.tv_sec);
-  framesElapsed += 1;
-  if (delayCounter >= 1) {
-    freqHertz = cyclesPerSec;
-    framerate = framesElapsed;
-    framesElapsed = 0;
-    cyclesPerSec = 0;
-    gettimeofday(&pd1, NULL);
-    uint32_t fq = freqHertz;
-    uint32_t fr = framerate;
-    // This is ugly, but it reduces dependency & overhead from sprintf
-    for (int i = 8; i >= 0; i--) {
-      if (i < 3) {
-        debugOverlayString[i] = '0' + (fq % 10);
-      } else if (i < 6) {
-        debugOverlayString[i + 1] = '0' + (fq % 10);
-        debugOverlayString[i] = '.';
-      }
-      fq /= 10;
-    }
-    debugOverlayString[7] = '\0';
-    strcat(debugOverlayString, " MHz (");
-    for (int i = 16; i >= 13; i--) {
-      debugOverlayString[i] = '0' + (fr % 10);
-      fr /= 10;
-    }
-    debugOverlayString[17] = '\0';
-    strcat(debugOverlayString, " FPS)");
-  }
-  #endif
+void bus_cpuReportScanline(uint8_t cycleCount) {
+  bus_cpuReportAs(PPURENDER_SCANLINE, cycleCount);
+}
 
-  #if (!HEADLESS)
-  io_update(debugOverlayString);
-  #endif
+void bus_cpuReportHeadless(uint8_t cycleCount) {
+  bus_cpuReportAs(PPURENDER_NONE, cycleCount);
+}
 
-  io_pollJoypad(&bus_handleInput);
+void bus_cpuReportDot(uint8_t cycleCount) {
+  bus_cpuReportAs(PPURENDER_DOT, cycleCount);
 }
 
-void bus_handleInput(NESInput input, bool enabled) {
-    if (input == INPUT_QUIT) exit(0);
-    JoypadButton jpMappings[9] = {JP_UP, JP_DOWN, JP_LEFT, JP_RIGHT, JP_BTN_A, JP_BTN_B, JP_SELECT, JP_START, JP_NULL};
-    if (enabled) {
-        joypad_setButton(jpMappings[input]);
-    } else {
-        joypad_unsetButton(jpMappings[input]);
-    }
+void bus_saveTrace(char* traceStr) {
+  logging_saveNESTrace(traceStr, (uint32_t)hot.totalCPUCycles);
+}
+
+void bus_frameIntervalReport() {
+    frameIntervalCount += 1;
+}
+
+void bus_ppuReport() {
+  hot.frameComplete = true;
 }
 
 void bus_triggerNMI() {
@@ -474,6 +643,5 @@ void bus_triggerNMI() {
 }
 
 void bus_triggerCPUPanic() {
-    io_panic("(SYS) 0x00 TRIGGER_PANIC");
-    while (true) io_pollJoypad(&bus_handleInput);
+    cpu6502_setClockMode(CPUCLOCK_HALT);
 }
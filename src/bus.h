@@ -30,13 +30,17 @@
 #define BUS_H
 
 #include <stdint.h>
+#include <string.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 
 #include "globalflags.h"
 #include "cpu6502.h"
+#include "codecache.h"
 #include "ppu.h"
-#include "io.h"
 #include "joypad.h"
 
 typedef enum {
@@ -45,6 +49,17 @@ typedef enum {
   SYNC_DISABLED
 } SyncMode;
 
+/**
+ * @brief Which specialized engine runs every console. Each combination
+ *        has its own loop, resolved when a cartridge is attached.
+ */
+typedef struct {
+  CPUEmulationMode cpuMode;
+  PPURenderMode renderMode;
+  CPUTiming timing;
+  bool tracing;
+} EngineConfig;
+
 typedef enum {
   MIRRORING_HORIZONTAL  = 0,
   MIRRORING_VERTICAL    = 1
@@ -78,22 +93,189 @@ typedef struct {
   uint8_t* pRom;
 } INES;
 
+typedef struct {
+  CPUState cpu;
+  PPUState ppu;
+  JoypadState joypad;
+  uint8_t cpuRAM[2048];
+  uint8_t prgRAM[0x2000];
+  uint8_t chrRAM[0x2000];
+  int32_t cyclesUntilDelay;
+  uint64_t totalCPUCycles;
+} MachineState;
+
+typedef struct {
+  INES cartridge;
+  uint8_t* prgRAM;
+  uint32_t prgRAMSize;
+  bool prgRAMMapped;
+
+  // worked out at power on, and kept with the cartridge so switching
+  // machines doesn't redo it
+  BytecodeProgram* bytecode;
+  bool accurateTiming;
+  uint32_t id;
+} BusCartridge;
+
+typedef enum {
+  LOADROM_OK,
+  LOADROM_NO_ROM,
+  LOADROM_INVALID,
+  LOADROM_UNSUPPORTED_MAPPER
+} BusLoadResult;
+
 /* INITIALIZATION METHODS */
 
-void bus_init(FileBinary* bin);
+/**
+ * @brief Insert a cartridge and power on the machine of the calling
+ *        thread, without any I/O. Frames are then run with bus_runFrame.
+ * 
+ * @param bin the ROM file (a NULL path skips the battery save file)
+ * @return BusLoadResult LOADROM_OK on success
+ */
+BusLoadResult bus_loadROM(FileBinary* bin);
+
+/**
+ * @brief Remove the cartridge and free its memory
+ */
+void bus_unloadROM();
+
+/**
+ * @brief Take the cartridge out of the machine without freeing it
+ *        (to switch this thread to another machine). Nothing is saved
+ *        or reset, so this is cheap.
+ * 
+ * @param cart the output cartridge
+ */
+void bus_detachCartridge(BusCartridge* cart);
+
+/**
+ * @brief Insert a detached cartridge into an empty machine, without
+ *        powering on. The machine must then be restored with
+ *        bus_loadState.
+ * 
+ * @param cart the cartridge
+ */
+void bus_attachCartridge(BusCartridge* cart);
+
+/**
+ * @brief Free a detached cartridge (flushing its battery save and adding
+ *        what it decoded to the code cache)
+ * 
+ * @param cart the cartridge
+ */
+void bus_freeCartridge(BusCartridge* cart);
+
+/**
+ * @brief Call a function for every CPU write (e.g. for the debugger)
+ * 
+ * @param hook the function, or NULL
+ */
+void bus_setWriteHook(void(*hook)(uint16_t));
+
+/**
+ * @brief Get the number of CPU cycles since power on
+ * 
+ * @return uint64_t the cycle count
+ */
+uint64_t bus_getCycleCount();
+
+/**
+ * @brief Get the number of instructions executed since power on
+ * 
+ * @return uint64_t the instruction count
+ */
+uint64_t bus_getInstructionCount();
+
+/**
+ * @brief Get the 2 KB of internal CPU RAM
+ * 
+ * @return uint8_t* the RAM
+ */
+uint8_t* bus_getCPURAM();
+
+/**
+ * @brief Get the cartridge PRG RAM
+ * 
+ * @param size the output size (0 if there is none)
+ * @return uint8_t* the RAM (or NULL if there is none)
+ */
+uint8_t* bus_getPRGRAM(uint32_t* size);
 
 bool bus_parseROM(FileBinary* bin);
 
 /**
- * @brief Initialize the PPU
+ * @brief Map battery-backed PRG RAM onto a save file beside the ROM
+ *        (e.g. game.sav for game.nes), creating it if necessary.
+ *        Writes to PRG RAM then land directly in the file's pages.
+ * 
+ * @param romPath the path of the loaded ROM
+ * @param size the size of PRG RAM (in bytes)
+ * @return uint8_t* the mapped PRG RAM, or NULL on failure
+ */
+uint8_t* bus_mapBatteryRAM(char* romPath, uint32_t size);
+
+/**
+ * @brief Flush battery-backed PRG RAM to its save file if it was written
+ * 
+ * @param blocking wait for the data to reach the disk (e.g. on exit)
  */
-void bus_initPPU();
+void bus_syncBatteryRAM(bool blocking);
+
+/* EXECUTION METHODS */
 
 /**
- * @brief Initialize the clock
+ * @brief Choose the engine for every console in the process. Consoles
+ *        switch when their cartridge is next attached, so this is meant
+ *        to be called once at startup, before any are created.
  * 
+ * @param config the engine
  */
-void bus_initClock();
+void bus_selectEngine(EngineConfig config);
+
+/**
+ * @brief Get the engine chosen for every console
+ * 
+ * @return EngineConfig the engine
+ */
+EngineConfig bus_getEngine();
+
+/**
+ * @brief Run the CPU until the PPU reports a completed frame
+ * 
+ * @return uint32_t the number of instructions executed
+ */
+uint32_t bus_runFrame();
+
+/**
+ * @brief Execute a single instruction
+ * 
+ * @return true if the instruction completed a frame
+ */
+bool bus_stepInstruction();
+
+/**
+ * @brief Set the buttons held on both controller ports
+ * 
+ * @param inputs the JoypadButton flags of each port
+ */
+void bus_setInputs(uint8_t* inputs);
+
+/* STATE METHODS */
+
+/**
+ * @brief Take a snapshot of the entire machine
+ * 
+ * @param state the pointer to the state object to fill
+ */
+void bus_saveState(MachineState* state);
+
+/**
+ * @brief Restore the entire machine from a snapshot
+ * 
+ * @param state the pointer to the state object to restore from
+ */
+void bus_loadState(MachineState* state);
 
 /* DATA METHODS */
 
@@ -136,6 +318,15 @@ void bus_cartridgeWrite(uint16_t addr, uint8_t data);
  */
 uint8_t bus_cartridgeRead(uint16_t addr);
 
+/**
+ * @brief Read CPU RAM, PRG RAM or PRG ROM without any side effects
+ * 
+ * @param address the address to read
+ * @param data the output data
+ * @return bool false for $2000-$401F, where reads have side effects
+ */
+bool bus_peekCPU(uint16_t address, uint8_t* data);
+
 /**
  * @brief Perform 16-bit read operation at mapped address
  * 
@@ -152,47 +343,57 @@ uint16_t bus_readCPUAddr(uint16_t address);
  */
 void bus_writeCPUAddr(uint16_t address, uint16_t data);
 
+/* MONITORS */
+
+void bus_frameIntervalReport();
+
+/* CALLBACKS */
+
 /**
- * @brief Set a button on the joypad
+ * @brief CPU has reported a successful execution of instruction, and the
+ *        PPU catches up once per frame (PPURENDER_FRAME)
  * 
- * @param button the button to set
+ * @param cycleCount the number of cycles elapsed
  */
-void bus_setJoypad(JoypadButton button);
+void bus_cpuReportFrame(uint8_t cycleCount);
 
 /**
- * @brief Unset a button on the joypad
+ * @brief CPU has reported a successful execution of instruction, and the
+ *        PPU catches up immediately (PPURENDER_SCANLINE)
  * 
- * @param button the button to unset
+ * @param cycleCount the number of cycles elapsed
  */
-void bus_unsetJoypad(JoypadButton button);
-
-/* MONITORS */
+void bus_cpuReportScanline(uint8_t cycleCount);
 
-void bus_frameIntervalReport();
-
-/* CALLBACKS */
+/**
+ * @brief CPU has reported a successful execution of instruction, and
+ *        there's no PPU (PPURENDER_NONE)
+ * 
+ * @param cycleCount the number of cycles elapsed
+ */
+void bus_cpuReportHeadless(uint8_t cycleCount);
 
 /**
- * @brief CPU has reported a successful execution of instruction
+ * @brief CPU has reported a successful execution of instruction, and the
+ *        PPU catches up immediately, dot by dot (PPURENDER_DOT)
  * 
  * @param cycleCount the number of cycles elapsed
  */
-void bus_cpuReport(uint8_t cycleCount);
+void bus_cpuReportDot(uint8_t cycleCount);
 
 /**
- * @brief PPU has reported a successful completion of a frame
+ * @brief CPU has traced an instruction
  * 
- * @param bitmap the display bitmap
+ * @param traceStr the trace
  */
-void bus_ppuReport();
+void bus_saveTrace(char* traceStr);
 
 /**
- * @brief Handle result of joypad input
+ * @brief PPU has reported a successful completion of a frame
  * 
- * @param input the joypad input
- * @param enabled the new state of the joypad input
+ * @param bitmap the display bitmap
  */
-void bus_handleInput(NESInput input, bool enabled);
+void bus_ppuReport();
 
 /* TRIGGERS */
 
@@ -202,7 +403,7 @@ void bus_handleInput(NESInput input, bool enabled);
 void bus_triggerNMI();
 
 /**
- * @brief Trigger a CPU Panic
+ * @brief Trigger a CPU Panic (halts the CPU)
  * 
  */
 void bus_triggerCPUPanic();
@@ -0,0 +1,160 @@
+/**
+ * @file codecache.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "codecache.h"
+#include "cpu6502.h"
+
+// chosen for the whole process, like the engine
+char* codecacheDir = NULL;
+
+/**
+ * @brief Hash PRG ROM (64-bit FNV-1a)
+ * 
+ * @param prg the PRG ROM
+ * @param prgSize its size in bytes
+ * @return uint64_t the hash
+ */
+static uint64_t codecache_hash(uint8_t* prg, uint32_t prgSize) {
+  uint64_t hash = 0xCBF29CE484222325;
+  for (uint32_t i = 0; i < prgSize; i++) {
+    hash ^= prg[i];
+    hash *= 0x100000001B3;
+  }
+  return hash;
+}
+
+/**
+ * @brief Get the file a program is kept in
+ * 
+ * @param path receives the path
+ * @param size the size of path
+ * @param prgHash the PRG ROM hash
+ * @param mode the CPU mode
+ * @return bool false if the cache is disabled or the path doesn't fit
+ */
+static bool codecache_path(char* path, size_t size, uint64_t prgHash, CPUEmulationMode mode) {
+  if (codecacheDir == NULL) return false;
+  int length = snprintf(path, size, "%s/%016llx-%d.code", codecacheDir, (unsigned long long)prgHash, (int)mode);
+  return length > 0 && (size_t)length < size;
+}
+
+void codecache_setDirectory(char* dir) {
+  codecacheDir = (dir != NULL && dir[0] != '\0') ? dir : NULL;
+}
+
+bool codecache_load(BytecodeProgram* prog, uint8_t* prg, uint32_t prgSize, CPUEmulationMode mode) {
+  uint64_t prgHash = codecache_hash(prg, prgSize);
+  char path[4096];
+  if (!codecache_path(path, sizeof(path), prgHash, mode)) return false;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)(sizeof(CodeCacheHeader) + sizeof(prog->addrMap))) {
+    close(fd);
+    return false;
+  }
+  uint32_t mappingSize = (uint32_t)st.st_size;
+  uint8_t* mapping = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) return false;
+
+  // anything stale or foreign is ignored, and replaced on the next save
+  CodeCacheHeader* header = (CodeCacheHeader*)mapping;
+  uint16_t* addrMap = (uint16_t*)(mapping + sizeof(CodeCacheHeader));
+  Bytecode* bytecodes = (Bytecode*)(mapping + sizeof(CodeCacheHeader) + sizeof(prog->addrMap));
+  bool valid = header->magic == CODECACHE_MAGIC
+    && header->mode == (uint32_t)mode
+    && header->decoderID == cpu6502_getDecoderID()
+    && header->prgHash == prgHash
+    && header->prgSize == prgSize
+    && header->bytecodeSize == sizeof(Bytecode)
+    && header->bytecodeCount <= 0xFFFF
+    && mappingSize == sizeof(CodeCacheHeader) + sizeof(prog->addrMap) + header->bytecodeCount * sizeof(Bytecode);
+  for (uint32_t i = 0; valid && i < 65536; i++) {
+    if (addrMap[i] != 0 && addrMap[i] >= header->bytecodeCount) valid = false;
+  }
+  if (!valid) {
+    munmap(mapping, mappingSize);
+    return false;
+  }
+
+  memcpy(prog->addrMap, addrMap, sizeof(prog->addrMap));
+  free(prog->bytecodes);
+  prog->bytecodes = bytecodes;
+  prog->bytecodeCount = header->bytecodeCount;
+  prog->cachedCount = header->bytecodeCount;
+  prog->mapping = mapping;
+  prog->mappingSize = mappingSize;
+  return true;
+}
+
+void codecache_save(BytecodeProgram* prog, uint8_t* prg, uint32_t prgSize, CPUEmulationMode mode) {
+  if (codecacheDir == NULL || prog->bytecodeCount <= prog->cachedCount) return;
+  uint64_t prgHash = codecache_hash(prg, prgSize);
+  char path[4096];
+  char tempPath[4096 + 8];
+  if (!codecache_path(path, sizeof(path), prgHash, mode)) return;
+  snprintf(tempPath, sizeof(tempPath), "%s.XXXXXX", path);
+
+  CodeCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = CODECACHE_MAGIC;
+  header.mode = (uint32_t)mode;
+  header.decoderID = cpu6502_getDecoderID();
+  header.prgHash = prgHash;
+  header.prgSize = prgSize;
+  header.bytecodeCount = prog->bytecodeCount;
+  header.bytecodeSize = sizeof(Bytecode);
+
+  // RAM holds different code from run to run
+  uint16_t* addrMap = malloc(sizeof(prog->addrMap));
+  if (addrMap == NULL) return;
+  memcpy(addrMap, prog->addrMap, sizeof(prog->addrMap));
+  if (mode == CPUEMU_INTERPRET_CACHED) {
+    memset(addrMap, 0, 0x8000 * sizeof(uint16_t));
+  }
+
+  int fd = mkstemp(tempPath);
+  if (fd < 0) {
+    free(addrMap);
+    return;
+  }
+  FILE* fp = fdopen(fd, "wb");
+  bool written = fp != NULL
+    && fwrite(&header, sizeof(header), 1, fp) == 1
+    && fwrite(addrMap, sizeof(prog->addrMap), 1, fp) == 1
+    && fwrite(prog->bytecodes, sizeof(Bytecode), prog->bytecodeCount, fp) == prog->bytecodeCount;
+  free(addrMap);
+  if (fp != NULL) {
+    written = (fclose(fp) == 0) && written;
+  } else {
+    close(fd);
+  }
+  if (!written || chmod(tempPath, 0644) != 0 || rename(tempPath, path) != 0) {
+    unlink(tempPath);
+    return;
+  }
+  prog->cachedCount = prog->bytecodeCount;
+}
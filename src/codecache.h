@@ -0,0 +1,99 @@
+/**
+ * @file codecache.h
+ * @author Noah Sadir (development.noahsadir@gmail.com)
+ * @brief Decoded program cache kept on disk
+ * @version 1.0
+ * @date 2026-10-19
+ * 
+ * @copyright Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef CODECACHE_H
+#define CODECACHE_H
+
+/*
+ * Keeps bytecode programs on disk between runs, so short jobs don't spend
+ * their time decoding the same ROM again. Each file is named by a hash of
+ * the PRG ROM and the CPU mode, and it's only used by the exact build of
+ * the emulator that wrote it. Files are mapped straight into memory; the
+ * CPU copies them out if it ever needs to decode more.
+ *
+ * Only ROM addresses ($8000 and up) are kept for the cached interpreter,
+ * since anything it decoded from RAM may not be there next time.
+ */
+
+#include "globalflags.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CODECACHE_MAGIC 0x45444F43 // "CODE"
+
+typedef struct {
+  uint32_t magic;
+  uint32_t mode;          // CPUEmulationMode
+  uint64_t decoderID;     // cpu6502_getDecoderID() of the writing build
+  uint64_t prgHash;
+  uint32_t prgSize;
+  uint32_t bytecodeCount;
+  uint32_t bytecodeSize;  // sizeof(Bytecode)
+  uint32_t reserved;
+} CodeCacheHeader;
+
+/**
+ * @brief Choose where every console in the process keeps decoded
+ *        programs. Call this before creating any consoles.
+ * 
+ * @param dir an existing directory, or NULL (or empty) to disable the
+ *            cache (default)
+ */
+void codecache_setDirectory(char* dir);
+
+/**
+ * @brief Fill a freshly initialized bytecode program from the cache
+ * 
+ * @param prog the bytecode program (empty)
+ * @param prg the PRG ROM
+ * @param prgSize its size in bytes
+ * @param mode the CPU mode the program is for
+ * @return bool whether a matching file was found and mapped
+ */
+bool codecache_load(BytecodeProgram* prog, uint8_t* prg, uint32_t prgSize, CPUEmulationMode mode);
+
+/**
+ * @brief Write a bytecode program to the cache if it has grown since it
+ *        was loaded. The file is replaced atomically, so other processes
+ *        loading it at the same time see either version.
+ * 
+ * @param prog the bytecode program
+ * @param prg the PRG ROM it was decoded from
+ * @param prgSize its size in bytes
+ * @param mode the CPU mode the program is for
+ */
+void codecache_save(BytecodeProgram* prog, uint8_t* prg, uint32_t prgSize, CPUEmulationMode mode);
+
+#endif
@@ -0,0 +1,310 @@
+/**
+ * @file control.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "control.h"
+#include "globalflags.h"
+
+int listenFd = -1;
+int clientFd = -1;
+char listenPath[108];
+NES* controlled = NULL;
+void (*changedCallback)() = NULL;
+
+// bytes received but not yet run, and responses not yet sent
+uint8_t* requests = NULL;
+size_t requestsSize = 0;
+size_t requestsCapacity = 0;
+uint8_t* responses = NULL;
+size_t responsesSize = 0;
+size_t responsesCapacity = 0;
+
+uint8_t* controlState = NULL;
+
+static void control_reserve(uint8_t** buffer, size_t* capacity, size_t needed) {
+  if (needed <= *capacity) return;
+  size_t grown = (*capacity > 0) ? *capacity : 4096;
+  while (grown < needed) grown *= 2;
+  *buffer = realloc(*buffer, grown);
+  *capacity = grown;
+}
+
+static uint16_t control_get16(const uint8_t* p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t control_get32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void control_put32(uint8_t* p, uint32_t val) {
+  for (int i = 0; i < 4; i++) p[i] = val >> (i * 8);
+}
+
+static void control_put64(uint8_t* p, uint64_t val) {
+  for (int i = 0; i < 8; i++) p[i] = val >> (i * 8);
+}
+
+/**
+ * @brief Begin a response, leaving space for its result
+ * 
+ * @return where the result should be written
+ */
+static uint8_t* control_reply(ControlStatus status, size_t resultSize) {
+  control_reserve(&responses, &responsesCapacity, responsesSize + 5 + resultSize);
+  uint8_t* response = responses + responsesSize;
+  control_put32(response, 1 + resultSize);
+  response[4] = status;
+  responsesSize += 5 + resultSize;
+  return response + 5;
+}
+
+static void control_notify() {
+  if (changedCallback != NULL) changedCallback();
+}
+
+static void control_run(uint8_t command, const uint8_t* payload, uint32_t size) {
+  switch (command) {
+    case CONTROL_INFO: {
+      if (size != 0) break;
+      uint8_t* result = control_reply(CONTROL_OK, 24);
+      control_put32(result, CONTROL_VERSION);
+      control_put32(result + 4, nes_state_size());
+      control_put64(result + 8, nes_cycle_count(controlled));
+      control_put64(result + 16, nes_instruction_count(controlled));
+      return;
+    }
+    case CONTROL_LOAD_ROM: {
+      NESLoadResult loaded = nes_load_rom(controlled, payload, size);
+      control_notify();
+      if (loaded == NES_LOAD_OK) {
+        control_reply(CONTROL_OK, 0);
+      } else {
+        *control_reply(CONTROL_LOAD_FAILED, 1) = loaded;
+      }
+      return;
+    }
+    case CONTROL_STEP: {
+      if (size != 4) break;
+      uint32_t frames = control_get32(payload);
+      uint32_t run = 0;
+      bool running = true;
+      while (run < frames && (running = nes_run_frame(controlled))) run += 1;
+      control_notify();
+      control_put32(control_reply(running ? CONTROL_OK : CONTROL_HALTED, 4), run);
+      return;
+    }
+    case CONTROL_SET_INPUT: {
+      if (size != 2 || payload[0] >= NES_PORT_COUNT) break;
+      nes_set_input(controlled, payload[0], payload[1]);
+      control_reply(CONTROL_OK, 0);
+      return;
+    }
+    case CONTROL_PEEK: {
+      if (size != 4) break;
+      uint16_t addr = control_get16(payload);
+      uint16_t count = control_get16(payload + 2);
+
+      // looking shouldn't change the game, so registers can't be read
+      uint8_t value;
+      uint16_t i = 0;
+      while (i < count && nes_inspect(controlled, addr + i, &value)) i++;
+      if (i < count) break;
+      uint8_t* result = control_reply(CONTROL_OK, count);
+      for (i = 0; i < count; i++) nes_inspect(controlled, addr + i, &result[i]);
+      return;
+    }
+    case CONTROL_POKE: {
+      if (size < 2) break;
+      uint16_t addr = control_get16(payload);
+      for (uint32_t i = 2; i < size; i++) nes_poke(controlled, addr + (i - 2), payload[i]);
+      control_notify();
+      control_reply(CONTROL_OK, 0);
+      return;
+    }
+    case CONTROL_SAVE_STATE: {
+      if (size != 0) break;
+      // the response may not be aligned for the state's fields either
+      nes_save_state(controlled, controlState);
+      memcpy(control_reply(CONTROL_OK, nes_state_size()), controlState, nes_state_size());
+      return;
+    }
+    case CONTROL_LOAD_STATE: {
+      if (size != nes_state_size()) break;
+      // the payload may not be aligned for the state's fields
+      memcpy(controlState, payload, size);
+      nes_load_state(controlled, controlState);
+      control_notify();
+      control_reply(CONTROL_OK, 0);
+      return;
+    }
+    case CONTROL_FRAMEBUFFER: {
+      if (size != 0) break;
+      const uint32_t* pixels = nes_framebuffer(controlled);
+      uint8_t* result = control_reply(CONTROL_OK, NES_WIDTH * NES_HEIGHT * 4);
+      for (uint32_t i = 0; i < NES_WIDTH * NES_HEIGHT; i++) control_put32(result + i * 4, pixels[i]);
+      return;
+    }
+    default:
+      control_reply(CONTROL_UNKNOWN_COMMAND, 0);
+      return;
+  }
+  control_reply(CONTROL_BAD_REQUEST, 0);
+}
+
+static void control_disconnect() {
+  if (clientFd >= 0) close(clientFd);
+  clientFd = -1;
+  requestsSize = 0;
+  responsesSize = 0;
+}
+
+static int64_t control_nowMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/**
+ * @brief Send pending responses until they're all sent or the wait runs
+ *        out, keeping the rest for later
+ * 
+ * @param timeoutMs the longest to wait for the client (-1 for no limit)
+ * @return false if the client went away
+ */
+static bool control_flush(int timeoutMs) {
+  int64_t deadline = control_nowMs() + timeoutMs;
+  size_t sent = 0;
+  while (sent < responsesSize) {
+    ssize_t n = send(clientFd, responses + sent, responsesSize - sent, MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      int64_t remaining = (timeoutMs < 0) ? -1 : (deadline - control_nowMs());
+      if (timeoutMs >= 0 && remaining <= 0) break;
+      struct pollfd pfd = {clientFd, POLLOUT, 0};
+      poll(&pfd, 1, (int)remaining);
+    } else {
+      return false;
+    }
+  }
+  memmove(responses, responses + sent, responsesSize - sent);
+  responsesSize -= sent;
+  return true;
+}
+
+int control_open(const char* path, NES* nes, void (*changed)()) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) return false;
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0) {
+    close(fd);
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  listenFd = fd;
+  strcpy(listenPath, path);
+  controlled = nes;
+  changedCallback = changed;
+  controlState = malloc(nes_state_size());
+  return true;
+}
+
+int control_poll(int timeoutMs) {
+  if (listenFd < 0) return false;
+
+  if (clientFd < 0) {
+    struct pollfd pfd = {listenFd, POLLIN, 0};
+    if (timeoutMs != 0 && poll(&pfd, 1, timeoutMs) <= 0) return false;
+    clientFd = accept(listenFd, NULL, NULL);
+    if (clientFd < 0) return false;
+    fcntl(clientFd, F_SETFL, fcntl(clientFd, F_GETFL) | O_NONBLOCK);
+  }
+
+  // a client which isn't reading its responses gets no more work done
+  if (responsesSize > 0) {
+    if (!control_flush(timeoutMs)) {
+      control_disconnect();
+      return false;
+    }
+    if (responsesSize > 0) return true;
+  }
+
+  struct pollfd pfd = {clientFd, POLLIN, 0};
+  if (poll(&pfd, 1, timeoutMs) <= 0) return true;
+
+  // take everything the client has written so far
+  while (true) {
+    control_reserve(&requests, &requestsCapacity, requestsSize + 65536);
+    ssize_t n = read(clientFd, requests + requestsSize, requestsCapacity - requestsSize);
+    if (n > 0) {
+      requestsSize += n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      control_disconnect();
+      return false;
+    }
+  }
+
+  // run each complete request, in order
+  size_t offset = 0;
+  while (requestsSize - offset >= 4) {
+    uint32_t length = control_get32(requests + offset);
+    if (length == 0 || length > CONTROL_MAX_MESSAGE) {
+      control_disconnect(); // lost framing, so nothing after it can be trusted
+      return false;
+    }
+    if (requestsSize - offset - 4 < length) break;
+    uint8_t* request = requests + offset + 4;
+    control_run(request[0], request + 1, length - 1);
+    offset += 4 + length;
+  }
+  memmove(requests, requests + offset, requestsSize - offset);
+  requestsSize -= offset;
+
+  if (!control_flush(CONTROL_FLUSH_WAIT_MS)) {
+    control_disconnect();
+    return false;
+  }
+  return true;
+}
+
+void control_close() {
+  if (listenFd < 0) return;
+  control_disconnect();
+  close(listenFd);
+  unlink(listenPath);
+  listenFd = -1;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file control.h
+ * @author Noah Sadir (development.noahsadir@gmail.com)
+ * @brief Local control socket for driving the emulator from other processes
+ * @version 1.0
+ * @date 2026-10-19
+ * 
+ * @copyright Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+/*
+ * Lets another process drive the emulator over a UNIX-domain socket.
+ *
+ * Every message, both ways, is a little-endian uint32 length followed by
+ * that many bytes. A request's first byte is its command and the rest is
+ * the payload; a response's first byte is a ControlStatus and the rest is
+ * the result. Responses come back in request order, so a client may write
+ * any number of requests before reading the first response.
+ *
+ * The socket is only serviced between frames, from whichever loop calls
+ * control_poll: the frontend's, or nescontrol's with no display at all.
+ * While a client is connected it owns the clock: frames only run when it
+ * asks.
+ *
+ * Like nes.h, this is part of libnescore and avoids the internal headers.
+ */
+
+#include "nes.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define CONTROL_VERSION 1
+
+/**
+ * @brief Largest message accepted; enough for any ROM or state
+ */
+#define CONTROL_MAX_MESSAGE (8 * 1024 * 1024)
+
+/**
+ * @brief Longest a poll waits for a slow client to take its responses;
+ *        the rest are sent on later polls
+ */
+#define CONTROL_FLUSH_WAIT_MS 16
+
+typedef enum {
+  CONTROL_INFO = 0x00,        // -> u32 version, u32 state size, u64 cycles, u64 instructions
+  CONTROL_LOAD_ROM = 0x01,    // iNES bytes
+  CONTROL_STEP = 0x02,        // u32 frames -> u32 frames run
+  CONTROL_SET_INPUT = 0x03,   // u8 port, u8 buttons
+  CONTROL_PEEK = 0x04,        // u16 address, u16 count -> bytes (not $2000-$401F)
+  CONTROL_POKE = 0x05,        // u16 address, bytes
+  CONTROL_SAVE_STATE = 0x06,  // -> state
+  CONTROL_LOAD_STATE = 0x07,  // state
+  CONTROL_FRAMEBUFFER = 0x08  // -> 256x240 0x00RRGGBB pixels
+} ControlCommand;
+
+typedef enum {
+  CONTROL_OK = 0,
+  CONTROL_UNKNOWN_COMMAND = 1,
+  CONTROL_BAD_REQUEST = 2,     // payload was the wrong size or out of range
+  CONTROL_LOAD_FAILED = 3,     // followed by the NESLoadResult
+  CONTROL_HALTED = 4           // the CPU halted; followed by u32 frames run
+} ControlStatus;
+
+/**
+ * @brief Start listening for a client on the specified socket path
+ * 
+ * @param path the socket path, which is replaced if it exists
+ * @param nes the console to control
+ * @param changed called after a command changes the console's state
+ *        outside the main loop, or NULL
+ * @return int 0 if the socket couldn't be created
+ */
+int control_open(const char* path, NES* nes, void (*changed)());
+
+/**
+ * @brief Accept a client if one is waiting, then run all of its complete
+ *        requests and send their responses. Nothing new is run for a
+ *        client until it has read the responses it was already sent.
+ * 
+ * @param timeoutMs how long to wait for a client, or for a request from a
+ *        connected one (-1 to wait indefinitely)
+ * @return int 1 if a client is connected
+ */
+int control_poll(int timeoutMs);
+
+/**
+ * @brief Disconnect any client and remove the socket
+ */
+void control_close();
+
+#endif
@@ -23,141 +23,421 @@
  */
 
 #include "cpu6502.h"
+#include "machine.h"
 
-CPURegisters reg;
-CPUEmulationMode emuMode;
-CPUClockMode clockMode = CPUCLOCK_SUSPENDED;
+machine_local CPUEmulationMode emuMode;
+machine_local bool accurateTiming = false;
 
-void(*memWrite)(uint16_t, uint8_t);
-uint8_t(*memRead)(uint16_t);
+/* PRIVATE METHODS - NOT INTENDED FOR EXTERNAL USE */
 
-BytecodeProgram* prgBytecode;
+/**
+ * @brief Execute a CPU instruction the way the given mode would
+ * 
+ * @param mode the emulation mode (constant in each specialization)
+ * @param accurate whether to use cycle-accurate timing (also constant)
+ * @param traceStr the trace string (or NULL if tracing disabled)
+ * @param c the clock callback
+ */
+static force_inline void cpu6502_stepAs(CPUEmulationMode mode, bool accurate, char* traceStr, void(*c)(uint8_t));
 
-uint8_t cpuerrno = 0;
+/**
+ * @brief Count the cycles an instruction will take from the current state,
+ *        including page crossing and branch penalties
+ * 
+ * @param b the bytecode pointer
+ * @return uint8_t the number of cycles
+ */
+static force_inline uint8_t cpu6502_cycles(Bytecode* b);
 
-void cpu6502_init(void(*w)(uint16_t, uint8_t), uint8_t(*r)(uint16_t), CPUEmulationMode mode) {
-  memWrite = w;
-  memRead = r;
-  emuMode = mode;
+/**
+ * @brief Execute a bytecode instruction, clocking the rest of the machine
+ *        before its final cycle and delivering NMI afterwards
+ * 
+ * @param b the bytecode pointer
+ * @param c the clock callback
+ */
+static force_inline void cpu6502_executeTimed(Bytecode* b, void(*c)(uint8_t));
+
+/**
+ * @brief Push a value to the stack
+ * 
+ * @param val the value to push
+ */
+static force_inline void cpu6502_stackPush(uint8_t val);
+
+/**
+ * @brief Pull a value from the stack
+ * 
+ * @return uint8_t the value pulled
+ */
+static force_inline uint8_t cpu6502_stackPull();
 
-  reg.p = 0x24;
-  reg.a = 0x00;
-  reg.x = 0x00;
-  reg.y = 0x00;
-  reg.s = 0xFD;
-  reg.pc = cpu6502_read16(0xFFFC);
-
-  if (emuMode == CPUEMU_INTERPRET_CACHED || emuMode == CPUEMU_RECOMPILE_STATIC) {
-    static BytecodeProgram prog;
-    prgBytecode = &prog;
-    prog.bytecodeCount = 0;
-    for (int i = 0; i < 65536; i++) {
-      prog.addrMap[i] = 0x0000;
-    }
-    prog.bytecodes = malloc(sizeof(Bytecode));
+/**
+ * @brief Set a CPU flag
+ * 
+ * @param flag the CPU flag
+ * @param enabled the value of the flag
+ */
+static force_inline void cpu6502_setFlag(CPUStatusFlag flag, bool enabled);
+
+/**
+ * @brief Perform a branch
+ * 
+ * @param desiredResult the branch condition
+ * @param flag the flag to check condition for
+ */
+static force_inline bool cpu6502_shouldBranch(bool desiredResult, CPUStatusFlag flag);
+
+/**
+ * @brief Execute a bytecode instruction
+ * 
+ * @param b the bytecode pointer
+ * @return uint8_t the number of clocks elapsed
+ */
+static force_inline uint8_t cpu6502_execute(Bytecode* b);
+
+/**
+ * @brief Read 16-bit value at address
+ * 
+ * @param addr the address
+ * @return uint16_t the return value
+ */
+static force_inline uint16_t cpu6502_read16(uint16_t addr);
+
+/**
+ * @brief Determine the mnemonic, addressing mode, and size of
+ *        an instruction given its opcode.
+ *
+ * @param opcode the opcode
+ * @param b the pointer to the bytecode object
+ */
+static force_inline void cpu6502_parseOpcode(uint8_t opcode, Bytecode* b);
+
+// cycles taken by each opcode on an NMOS 6502, before any penalties
+static const uint8_t baseCycles[256] = {
+  7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6, // 0x00
+  2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 0x10
+  6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6, // 0x20
+  2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 0x30
+  6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6, // 0x40
+  2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 0x50
+  6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6, // 0x60
+  2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 0x70
+  2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4, // 0x80
+  2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5, // 0x90
+  2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4, // 0xA0
+  2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4, // 0xB0
+  2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, // 0xC0
+  2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7, // 0xD0
+  2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6, // 0xE0
+  2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7  // 0xF0
+};
+
+// reads which take an extra cycle when indexing crosses a page
+static const uint8_t pageCrossPenalty[256] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x00
+  0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, // 0x10
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x20
+  0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, // 0x30
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x40
+  0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, // 0x50
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x60
+  0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, // 0x70
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x80
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x90
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xA0
+  0, 1, 0, 1, 0, 0, 0, 0, 0, 1, 0, 1, 1, 1, 1, 1, // 0xB0
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xC0
+  0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, // 0xD0
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0xE0
+  0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0, 0  // 0xF0
+};
+
+
+
+
+/**
+ * @brief Move bytecodes loaded from the code cache onto the heap, so more
+ *        can be added to them
+ * 
+ * @param prog the bytecode program
+ */
+static void cpu6502_unmapBytecodes(BytecodeProgram* prog) {
+  Bytecode* bytecodes = malloc(sizeof(Bytecode) * (prog->bytecodeCount + 1));
+  memcpy(bytecodes, prog->bytecodes, sizeof(Bytecode) * prog->bytecodeCount);
+  munmap(prog->mapping, prog->mappingSize);
+  prog->mapping = NULL;
+  prog->bytecodes = bytecodes;
+}
+
+uint64_t cpu6502_getDecoderID() {
+  // 64-bit FNV-1a over everything saved bytecode depends on
+  uint64_t id = 0xCBF29CE484222325;
+  uint32_t fields[2] = {CPU_DECODER_VERSION, sizeof(Bytecode)};
+  for (int i = 0; i < 2; i++) id = (id ^ fields[i]) * 0x100000001B3;
+  for (int opcode = 0; opcode < 256; opcode++) {
+    Bytecode b;
+    cpu6502_parseOpcode(opcode, &b);
+    uint32_t decoded[3] = {b.mnemonic, b.addressingMode, b.count};
+    for (int i = 0; i < 3; i++) id = (id ^ decoded[i]) * 0x100000001B3;
   }
+  return id;
+}
+
+BytecodeProgram* cpu6502_createBytecodeProgram() {
+  BytecodeProgram* prog = calloc(1, sizeof(BytecodeProgram));
+  prog->bytecodes = malloc(sizeof(Bytecode));
+  return prog;
+}
+
+void cpu6502_freeBytecodeProgram(BytecodeProgram* prog) {
+  if (prog == NULL) return;
+  if (prog->mapping != NULL) {
+    munmap(prog->mapping, prog->mappingSize);
+  } else {
+    free(prog->bytecodes);
+  }
+  free(prog);
+}
+
+void cpu6502_init(void(*w)(uint16_t, uint8_t), uint8_t(*r)(uint16_t), CPUEmulationMode mode, BytecodeProgram* prog) {
+  hot.memWrite = w;
+  hot.memRead = r;
+  hot.prgBytecode = prog;
+  emuMode = mode;
+  hot.clockMode = CPUCLOCK_SUSPENDED;
+  hot.cpuerrno = 0;
+
+  hot.reg.p = 0x24;
+  hot.reg.a = 0x00;
+  hot.reg.x = 0x00;
+  hot.reg.y = 0x00;
+  hot.reg.s = 0xFD;
+  hot.reg.pc = cpu6502_read16(0xFFFC);
 
   #if (CPU_DEBUG)
-  reg.pc = 0xC000;
+  hot.reg.pc = 0xC000;
   #endif
 }
 
 void cpu6502_step(char* traceStr, void(*c)(uint8_t)) {
-  if (emuMode == CPUEMU_INTERPRET_DIRECT) {
-    Bytecode bytecode;
-    cpu6502_parseOpcode(memRead(reg.pc), &bytecode);
-    for (int i = 0; i < bytecode.count; i++) {
-      bytecode.data[i] = memRead(reg.pc + i);
-    }
+  switch (emuMode) {
+    case CPUEMU_INTERPRET_DIRECT:
+      accurateTiming ? cpu6502_stepAs(CPUEMU_INTERPRET_DIRECT, true, traceStr, c) : cpu6502_stepAs(CPUEMU_INTERPRET_DIRECT, false, traceStr, c);
+      break;
+    case CPUEMU_INTERPRET_CACHED:
+      accurateTiming ? cpu6502_stepAs(CPUEMU_INTERPRET_CACHED, true, traceStr, c) : cpu6502_stepAs(CPUEMU_INTERPRET_CACHED, false, traceStr, c);
+      break;
+    case CPUEMU_RECOMPILE_STATIC:
+      accurateTiming ? cpu6502_stepAs(CPUEMU_RECOMPILE_STATIC, true, traceStr, c) : cpu6502_stepAs(CPUEMU_RECOMPILE_STATIC, false, traceStr, c);
+      break;
+    default: break;
+  }
+}
 
-    if (traceStr != NULL) {
-      logging_bytecodeToTrace(reg, &bytecode, traceStr, memWrite, memRead);
-    }
+void cpu6502_setAccurateTiming(bool accurate) {
+  accurateTiming = accurate;
+}
+
+#define CPU_RUN_LOOP(name, mode, accurate, tracing) \
+  static uint32_t name(uint8_t* stop, void(*c)(uint8_t), void(*t)(char*)) { \
+    char traceStr[150]; \
+    uint32_t count = 0; \
+    while (!*stop && hot.clockMode != CPUCLOCK_HALT) { \
+      cpu6502_stepAs(mode, accurate, (tracing) ? traceStr : NULL, c); \
+      if (tracing) t(traceStr); \
+      count += 1; \
+    } \
+    return count; \
+  }
 
-    c(cpu6502_execute(&bytecode));
-  } else if (emuMode == CPUEMU_INTERPRET_CACHED) {
-    if (prgBytecode->addrMap[reg.pc] == 0x0000) {
+CPU_RUN_LOOP(cpu6502_runDirect, CPUEMU_INTERPRET_DIRECT, false, false)
+CPU_RUN_LOOP(cpu6502_runDirectTraced, CPUEMU_INTERPRET_DIRECT, false, true)
+CPU_RUN_LOOP(cpu6502_runDirectAccurate, CPUEMU_INTERPRET_DIRECT, true, false)
+CPU_RUN_LOOP(cpu6502_runDirectAccurateTraced, CPUEMU_INTERPRET_DIRECT, true, true)
+CPU_RUN_LOOP(cpu6502_runCached, CPUEMU_INTERPRET_CACHED, false, false)
+CPU_RUN_LOOP(cpu6502_runCachedTraced, CPUEMU_INTERPRET_CACHED, false, true)
+CPU_RUN_LOOP(cpu6502_runCachedAccurate, CPUEMU_INTERPRET_CACHED, true, false)
+CPU_RUN_LOOP(cpu6502_runCachedAccurateTraced, CPUEMU_INTERPRET_CACHED, true, true)
+CPU_RUN_LOOP(cpu6502_runStatic, CPUEMU_RECOMPILE_STATIC, false, false)
+CPU_RUN_LOOP(cpu6502_runStaticTraced, CPUEMU_RECOMPILE_STATIC, false, true)
+CPU_RUN_LOOP(cpu6502_runStaticAccurate, CPUEMU_RECOMPILE_STATIC, true, false)
+CPU_RUN_LOOP(cpu6502_runStaticAccurateTraced, CPUEMU_RECOMPILE_STATIC, true, true)
+
+// [mode][accurate][tracing]
+static const CPURunLoop runLoops[3][2][2] = {
+  {{&cpu6502_runDirect, &cpu6502_runDirectTraced}, {&cpu6502_runDirectAccurate, &cpu6502_runDirectAccurateTraced}},
+  {{&cpu6502_runCached, &cpu6502_runCachedTraced}, {&cpu6502_runCachedAccurate, &cpu6502_runCachedAccurateTraced}},
+  {{&cpu6502_runStatic, &cpu6502_runStaticTraced}, {&cpu6502_runStaticAccurate, &cpu6502_runStaticAccurateTraced}}
+};
+
+CPURunLoop cpu6502_getRunLoop(CPUEmulationMode mode, bool accurate, bool tracing) {
+  if (mode > CPUEMU_RECOMPILE_STATIC) mode = CPUEMU_INTERPRET_CACHED;
+  return runLoops[mode][accurate ? 1 : 0][tracing ? 1 : 0];
+}
+
+static force_inline void cpu6502_stepAs(CPUEmulationMode mode, bool accurate, char* traceStr, void(*c)(uint8_t)) {
+  Bytecode bytecode;
+  Bytecode* b = &bytecode;
+  if (mode == CPUEMU_INTERPRET_DIRECT) {
+    cpu6502_parseOpcode(hot.memRead(hot.reg.pc), &bytecode);
+    for (int i = 0; i < bytecode.count; i++) {
+      bytecode.data[i] = hot.memRead(hot.reg.pc + i);
+    }
+  } else if (mode == CPUEMU_INTERPRET_CACHED) {
+    if (hot.prgBytecode->addrMap[hot.reg.pc] == 0x0000) {
       // bytecode not compiled yet
-      Bytecode bytecode;
-      cpu6502_parseOpcode(memRead(reg.pc), &bytecode);
+      cpu6502_parseOpcode(hot.memRead(hot.reg.pc), &bytecode);
       for (int i = 0; i < bytecode.count; i++) {
-        bytecode.data[i] = memRead(reg.pc + i);
+        bytecode.data[i] = hot.memRead(hot.reg.pc + i);
       }
-      prgBytecode->bytecodeCount += 1;
-      prgBytecode->bytecodes = realloc(prgBytecode->bytecodes, sizeof(Bytecode) * (prgBytecode->bytecodeCount + 1));
-      prgBytecode->bytecodes[prgBytecode->bytecodeCount - 1] = bytecode;
-      prgBytecode->addrMap[reg.pc] = prgBytecode->bytecodeCount - 1;
-    }
+      if (hot.prgBytecode->mapping != NULL) cpu6502_unmapBytecodes(hot.prgBytecode);
+      hot.prgBytecode->bytecodeCount += 1;
+      hot.prgBytecode->bytecodes = realloc(hot.prgBytecode->bytecodes, sizeof(Bytecode) * (hot.prgBytecode->bytecodeCount + 1));
+      hot.prgBytecode->bytecodes[hot.prgBytecode->bytecodeCount - 1] = bytecode;
+      hot.prgBytecode->addrMap[hot.reg.pc] = hot.prgBytecode->bytecodeCount - 1;
+    }
+    b = &hot.prgBytecode->bytecodes[hot.prgBytecode->addrMap[hot.reg.pc]];
+  } else if (mode == CPUEMU_RECOMPILE_STATIC) {
+    if (hot.prgBytecode->addrMap[hot.reg.pc] == 0x0000) {
+      hot.clockMode = CPUCLOCK_HALT;
+      hot.cpuerrno = 0x02;
+      if (traceStr != NULL) traceStr[0] = '\0';
+      return;
+    }
+    b = &hot.prgBytecode->bytecodes[hot.prgBytecode->addrMap[hot.reg.pc]];
+  }
 
-    Bytecode* b = &prgBytecode->bytecodes[prgBytecode->addrMap[reg.pc]];
-    if (traceStr != NULL) {
-      logging_bytecodeToTrace(reg, b, traceStr, memWrite, memRead);
-    }
+  if (traceStr != NULL) {
+    logging_bytecodeToTrace(hot.reg, b, traceStr, hot.memWrite, hot.memRead);
+  }
+
+  if (accurate) {
+    cpu6502_executeTimed(b, c);
+  } else {
     c(cpu6502_execute(b));
-  } else if (emuMode == CPUEMU_RECOMPILE_STATIC) {
-    if (prgBytecode->addrMap[reg.pc] == 0x0000) {
-      clockMode = CPUCLOCK_HALT;
-      cpuerrno = 0x02;
-    } else {
-      Bytecode* b = &prgBytecode->bytecodes[prgBytecode->addrMap[reg.pc]];
-      if (traceStr != NULL) {
-        logging_bytecodeToTrace(reg, b, traceStr, memWrite, memRead);
+  }
+}
+
+static force_inline uint8_t cpu6502_cycles(Bytecode* b) {
+  uint8_t opcode = b->data[0];
+  uint8_t cycles = baseCycles[opcode];
+  switch (b->addressingMode) {
+    case AM_ABS_X:
+    case AM_ABS_Y:
+    case AM_ZP_INDIRECT_Y:
+    {
+      if (!pageCrossPenalty[opcode]) break;
+      uint16_t base;
+      uint8_t index;
+      if (b->addressingMode == AM_ZP_INDIRECT_Y) {
+        // the pointer is in zero page, so reading it ahead is harmless
+        base = ((uint16_t)hot.memRead((uint8_t)(b->data[1] + 1)) << 8) | (uint16_t)hot.memRead(b->data[1]);
+        index = hot.reg.y;
+      } else {
+        base = ((uint16_t)b->data[2] << 8) | (uint16_t)b->data[1];
+        index = (b->addressingMode == AM_ABS_X) ? hot.reg.x : hot.reg.y;
       }
-      c(cpu6502_execute(b));
+      if (((base + index) & 0xFF00) != (base & 0xFF00)) cycles += 1;
+      break;
     }
+    case AM_RELATIVE:
+    {
+      bool taken;
+      switch (b->mnemonic) {
+        case I_BCC: taken = cpu6502_shouldBranch(0, CPUSTAT_CARRY); break;
+        case I_BCS: taken = cpu6502_shouldBranch(1, CPUSTAT_CARRY); break;
+        case I_BNE: taken = cpu6502_shouldBranch(0, CPUSTAT_ZERO); break;
+        case I_BEQ: taken = cpu6502_shouldBranch(1, CPUSTAT_ZERO); break;
+        case I_BPL: taken = cpu6502_shouldBranch(0, CPUSTAT_NEGATIVE); break;
+        case I_BMI: taken = cpu6502_shouldBranch(1, CPUSTAT_NEGATIVE); break;
+        case I_BVC: taken = cpu6502_shouldBranch(0, CPUSTAT_OVERFLOW); break;
+        case I_BVS: taken = cpu6502_shouldBranch(1, CPUSTAT_OVERFLOW); break;
+        default: taken = false; break;
+      }
+      if (taken) {
+        uint16_t next = hot.reg.pc + 2;
+        uint16_t target = next + (int8_t)b->data[1];
+        cycles += ((target & 0xFF00) != (next & 0xFF00)) ? 2 : 1;
+      }
+      break;
+    }
+    default: break;
+  }
+  return cycles;
+}
+
+static force_inline void cpu6502_executeTimed(Bytecode* b, void(*c)(uint8_t)) {
+  // the PPU catches up to the last cycle, when the instruction's own
+  // read or write happens, and any NMI it raises waits for the instruction
+  uint8_t cycles = cpu6502_cycles(b);
+  hot.deferNMI = true;
+  c(cycles - 1);
+  cpu6502_execute(b);
+  c(1);
+  hot.deferNMI = false;
+
+  if (hot.nmiPending) {
+    hot.nmiPending = false;
+    cpu6502_nmi();
+    c(7);
   }
 }
 
 void cpu6502_nmi() {
-  cpu6502_stackPush((reg.pc >> 8) & BIT_FILL_8);
-  cpu6502_stackPush(reg.pc & BIT_FILL_8);
-  cpu6502_stackPush(reg.p);
+  if (hot.deferNMI) {
+    hot.nmiPending = true;
+    return;
+  }
+  cpu6502_stackPush((hot.reg.pc >> 8) & BIT_FILL_8);
+  cpu6502_stackPush(hot.reg.pc & BIT_FILL_8);
+  cpu6502_stackPush(hot.reg.p);
   cpu6502_setFlag(CPUSTAT_NO_INTRPT, true);
-  reg.pc = ((uint16_t)memRead(0xFFFB) << 8) | (uint16_t)memRead(0xFFFA);
+  hot.reg.pc = ((uint16_t)hot.memRead(0xFFFB) << 8) | (uint16_t)hot.memRead(0xFFFA);
 }
 
 static force_inline void cpu6502_stackPush(uint8_t val) {
-  if (reg.s == 0x00) {
+  if (hot.reg.s == 0x00) {
     // overflow
   } else {
-    memWrite(0x100 + reg.s, val);
-    reg.s -= 1;
+    hot.memWrite(0x100 + hot.reg.s, val);
+    hot.reg.s -= 1;
   }
 }
 
 static force_inline uint8_t cpu6502_stackPull() {
-  if (reg.s == 0xFF) {
+  if (hot.reg.s == 0xFF) {
     // underflow
   } else {
-    reg.s += 1;
-    uint8_t val = memRead(0x100 + reg.s);
+    hot.reg.s += 1;
+    uint8_t val = hot.memRead(0x100 + hot.reg.s);
     return val;
   }
   return 0;
 }
 
 static force_inline bool cpu6502_shouldBranch(bool desiredResult, CPUStatusFlag flag) {
-  return (((reg.p & flag) > 0) == desiredResult);
+  return (((hot.reg.p & flag) > 0) == desiredResult);
 }
 
 static force_inline void cpu6502_setFlag(CPUStatusFlag flag, bool enabled) {
   if (enabled) {
-    reg.p |= flag;
+    hot.reg.p |= flag;
   } else {
-    reg.p &= ~flag;
+    hot.reg.p &= ~flag;
   }
 }
 
 CPUClockMode cpu6502_getClockMode() {
-  return clockMode;
+  return hot.clockMode;
 }
 
 void cpu6502_setClockMode(CPUClockMode mode) {
-  clockMode = mode;
+  hot.clockMode = mode;
 }
 
 static force_inline uint16_t cpu6502_read16(uint16_t addr) {
-  return (((uint16_t)memRead(addr + 1) << 8) | (uint16_t)memRead(addr));
+  return (((uint16_t)hot.memRead(addr + 1) << 8) | (uint16_t)hot.memRead(addr));
 }
 
 void cpu6502_dasm(uint8_t* prgData, uint32_t prgSize, void(*c)(char c[128]), uint8_t flags) {
@@ -187,13 +467,13 @@ void cpu6502_loadBytecodeProgram(uint8_t* prgData, uint32_t prgSize) {
       offset += 1;
     }
     
-    prgBytecode->bytecodeCount += 1;
-    prgBytecode->bytecodes = realloc(prgBytecode->bytecodes, sizeof(Bytecode) * (prgBytecode->bytecodeCount + 1));
-    prgBytecode->bytecodes[prgBytecode->bytecodeCount - 1] = bytecode;
+    hot.prgBytecode->bytecodeCount += 1;
+    hot.prgBytecode->bytecodes = realloc(hot.prgBytecode->bytecodes, sizeof(Bytecode) * (hot.prgBytecode->bytecodeCount + 1));
+    hot.prgBytecode->bytecodes[hot.prgBytecode->bytecodeCount - 1] = bytecode;
     
     // account for mirroring
     for (int i = pointer; i < 0xFFFF; i += prgSize) {
-      prgBytecode->addrMap[i] = prgBytecode->bytecodeCount - 1;
+      hot.prgBytecode->addrMap[i] = hot.prgBytecode->bytecodeCount - 1;
     }
     
     pointer += offset;
@@ -730,7 +1010,7 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
   switch (b->addressingMode) {
     case AM_IMMEDIATE:
     {
-      val = reg.pc + 1;
+      val = hot.reg.pc + 1;
       break;
     }
     case AM_ABSOLUTE: 
@@ -754,41 +1034,41 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       } else {
         pointerAddrInc += 1;
       }
-      val = ((uint16_t)memRead(pointerAddrInc) << 8) | (uint16_t)memRead(pointerAddr);
+      val = ((uint16_t)hot.memRead(pointerAddrInc) << 8) | (uint16_t)hot.memRead(pointerAddr);
       break;
     }
     case AM_ABS_X:
     {
       cycleCount += 2;
-      val = (((uint16_t)b->data[2] << 8) | (uint16_t)b->data[1]) + (uint16_t)reg.x;
+      val = (((uint16_t)b->data[2] << 8) | (uint16_t)b->data[1]) + (uint16_t)hot.reg.x;
       break;
     }
     case AM_ABS_Y:
     {
       cycleCount += 2;
-      val = (((uint16_t)b->data[2] << 8) | (uint16_t)b->data[1]) + (uint16_t)reg.y;
+      val = (((uint16_t)b->data[2] << 8) | (uint16_t)b->data[1]) + (uint16_t)hot.reg.y;
       break;
     }
     case AM_ZP_X:
     {
       cycleCount += 2;
-      uint8_t zpVal = b->data[1] + reg.x;
+      uint8_t zpVal = b->data[1] + hot.reg.x;
       val = (uint16_t)zpVal;
       break;
     }
     case AM_ZP_Y:
     {
       cycleCount += 2;
-      uint8_t zpVal = b->data[1] + reg.y;
+      uint8_t zpVal = b->data[1] + hot.reg.y;
       val = (uint16_t)zpVal;
       break;
     }
     case AM_ZP_X_INDIRECT:
     {
       cycleCount += 4;
-      uint8_t zpVal = b->data[1] + reg.x;
+      uint8_t zpVal = b->data[1] + hot.reg.x;
       uint8_t zpValInc = zpVal + 1;
-      val = ((uint16_t)memRead(zpValInc) << 8) | (uint16_t)memRead(zpVal);
+      val = ((uint16_t)hot.memRead(zpValInc) << 8) | (uint16_t)hot.memRead(zpVal);
       break;
     }
     case AM_ZP_INDIRECT_Y:
@@ -796,14 +1076,14 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       cycleCount += 3;
       uint8_t zpVal = b->data[1];
       uint8_t zpValInc = zpVal + 1;
-      val = ((uint16_t)memRead(zpValInc) << 8) | (uint16_t)memRead(zpVal);
-      val += reg.y;
+      val = ((uint16_t)hot.memRead(zpValInc) << 8) | (uint16_t)hot.memRead(zpVal);
+      val += hot.reg.y;
       break;
     }
     case AM_RELATIVE:
     {
       int8_t offset = b->data[1];
-      val = reg.pc + offset + 2;
+      val = hot.reg.pc + offset + 2;
       break;
     }
     default:
@@ -817,125 +1097,125 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
   switch(b->mnemonic) {
     case I_LDA:
     {
-      reg.a = memRead(val);
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = hot.memRead(val);
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_LDX:
     {
-      reg.x = memRead(val);
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.x == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.x & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.x = hot.memRead(val);
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.x == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.x & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_LDY:
     {
-      reg.y = memRead(val);
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.y == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.y & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.y = hot.memRead(val);
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.y == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.y & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_STA:
     {
-      memWrite(val, reg.a);
-      reg.pc += b->count;
+      hot.memWrite(val, hot.reg.a);
+      hot.reg.pc += b->count;
       break;
     }
     case I_STX:
     {
-      memWrite(val, reg.x);
-      reg.pc += b->count;
+      hot.memWrite(val, hot.reg.x);
+      hot.reg.pc += b->count;
       break;
     }
     case I_STY:
     {
-      memWrite(val, reg.y);
-      reg.pc += b->count;
+      hot.memWrite(val, hot.reg.y);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ADC:
     {
-      uint8_t memoryVal = memRead(val);
-      uint16_t sum = reg.a + memoryVal + ((uint16_t)((reg.p & CPUSTAT_CARRY) > 0));
+      uint8_t memoryVal = hot.memRead(val);
+      uint16_t sum = hot.reg.a + memoryVal + ((uint16_t)((hot.reg.p & CPUSTAT_CARRY) > 0));
       cpu6502_setFlag(CPUSTAT_CARRY, sum > 0xFF);
-      cpu6502_setFlag(CPUSTAT_OVERFLOW, (reg.a ^ sum) & (memoryVal ^ sum) & 0x80);
-      reg.a = (uint8_t) sum;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      cpu6502_setFlag(CPUSTAT_OVERFLOW, (hot.reg.a ^ sum) & (memoryVal ^ sum) & 0x80);
+      hot.reg.a = (uint8_t) sum;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_SBC:
     {
-      uint8_t memoryVal = ~memRead(val);
-      uint16_t sum = reg.a + memoryVal + ((uint16_t)((reg.p & CPUSTAT_CARRY) > 0));
+      uint8_t memoryVal = ~hot.memRead(val);
+      uint16_t sum = hot.reg.a + memoryVal + ((uint16_t)((hot.reg.p & CPUSTAT_CARRY) > 0));
       cpu6502_setFlag(CPUSTAT_CARRY, sum > 0xFF);
-      cpu6502_setFlag(CPUSTAT_OVERFLOW, (reg.a ^ sum) & (memoryVal ^ sum) & 0x80);
-      reg.a = (uint8_t) sum;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      cpu6502_setFlag(CPUSTAT_OVERFLOW, (hot.reg.a ^ sum) & (memoryVal ^ sum) & 0x80);
+      hot.reg.a = (uint8_t) sum;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_INC:
     {
-      uint8_t incval = memRead(val) + 1;
-      memWrite(val, incval);
+      uint8_t incval = hot.memRead(val) + 1;
+      hot.memWrite(val, incval);
       cpu6502_setFlag(CPUSTAT_ZERO, incval == 0);
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (incval & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_INX:
     {
-      reg.x += 1;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.x == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.x & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.x += 1;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.x == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.x & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_INY:
     {
-      reg.y += 1;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.y == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.y & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.y += 1;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.y == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.y & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_DEC:
     {
-      uint8_t decval = memRead(val) - 1;
-      memWrite(val, decval);
+      uint8_t decval = hot.memRead(val) - 1;
+      hot.memWrite(val, decval);
       cpu6502_setFlag(CPUSTAT_ZERO, decval == 0);
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (decval & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_DEX:
     {
-      reg.x -= 1;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.x == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.x & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.x -= 1;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.x == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.x & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_DEY:
     {
-      reg.y -= 1;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.y == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.y & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.y -= 1;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.y == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.y & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ASL:
     {
-      uint8_t storedVal = reg.a;
+      uint8_t storedVal = hot.reg.a;
       if (!(b->addressingMode == AM_ACCUMULATOR)) {
-        storedVal = memRead(val);
+        storedVal = hot.memRead(val);
       }
 
       cpu6502_setFlag(CPUSTAT_CARRY, (storedVal >> 7) & 1);
@@ -945,18 +1225,18 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (storedVal & BIT_MASK_8) != 0);
 
       if (b->addressingMode == AM_ACCUMULATOR) {
-        reg.a = storedVal;
+        hot.reg.a = storedVal;
       } else {
-        memWrite(val, storedVal);
+        hot.memWrite(val, storedVal);
       }
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_LSR:
     {
-      uint8_t storedVal = reg.a;
+      uint8_t storedVal = hot.reg.a;
       if (!(b->addressingMode == AM_ACCUMULATOR)) {
-        storedVal = memRead(val);
+        storedVal = hot.memRead(val);
       }
 
       cpu6502_setFlag(CPUSTAT_CARRY, storedVal & 1);
@@ -966,21 +1246,21 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (storedVal & BIT_MASK_8) != 0);
 
       if (b->addressingMode == AM_ACCUMULATOR) {
-        reg.a = storedVal;
+        hot.reg.a = storedVal;
       } else {
-        memWrite(val, storedVal);
+        hot.memWrite(val, storedVal);
       }
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_ROL:
     {
-      uint8_t storedVal = reg.a;
+      uint8_t storedVal = hot.reg.a;
       if (!(b->addressingMode == AM_ACCUMULATOR)) {
-        storedVal = memRead(val);
+        storedVal = hot.memRead(val);
       }
 
-      bool oldCarry = ((reg.p & CPUSTAT_CARRY) > 0);
+      bool oldCarry = ((hot.reg.p & CPUSTAT_CARRY) > 0);
       cpu6502_setFlag(CPUSTAT_CARRY, (storedVal >> 7) & 1);
       storedVal = storedVal << 1;
       storedVal = storedVal | oldCarry;
@@ -989,21 +1269,21 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (storedVal & BIT_MASK_8) != 0);
 
       if (b->addressingMode == AM_ACCUMULATOR) {
-        reg.a = storedVal;
+        hot.reg.a = storedVal;
       } else {
-        memWrite(val, storedVal);
+        hot.memWrite(val, storedVal);
       }
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_ROR:
     {
-      uint8_t storedVal = reg.a;
+      uint8_t storedVal = hot.reg.a;
       if (!(b->addressingMode == AM_ACCUMULATOR)) {
-        storedVal = memRead(val);
+        storedVal = hot.memRead(val);
       }
 
-      bool oldCarry = ((reg.p & CPUSTAT_CARRY) > 0);
+      bool oldCarry = ((hot.reg.p & CPUSTAT_CARRY) > 0);
       cpu6502_setFlag(CPUSTAT_CARRY, storedVal & 1);
       storedVal = storedVal >> 1;
       storedVal = storedVal | (oldCarry << 7);
@@ -1012,230 +1292,230 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (storedVal & BIT_MASK_8) != 0);
 
       if (b->addressingMode == AM_ACCUMULATOR) {
-        reg.a = storedVal;
+        hot.reg.a = storedVal;
       } else {
-        memWrite(val, storedVal);
+        hot.memWrite(val, storedVal);
       }
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_AND:
     {
-      reg.a = memRead(val) & reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = hot.memRead(val) & hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ORA:
     {
-      reg.a = memRead(val) | reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = hot.memRead(val) | hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_EOR:
     {
-      reg.a = memRead(val) ^ reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = hot.memRead(val) ^ hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_CMP:
     {
-      uint8_t memVal = memRead(val);
+      uint8_t memVal = hot.memRead(val);
 
-      int8_t signedResult = ((int8_t) reg.a) - ((int8_t) memVal);
-      if (reg.a < memVal) {
+      int8_t signedResult = ((int8_t) hot.reg.a) - ((int8_t) memVal);
+      if (hot.reg.a < memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 0);
         cpu6502_setFlag(CPUSTAT_CARRY, 0);
-      } else if (reg.a == memVal) {
+      } else if (hot.reg.a == memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 1);
         cpu6502_setFlag(CPUSTAT_CARRY, 1);
-      } else if (reg.a > memVal) {
+      } else if (hot.reg.a > memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 0);
         cpu6502_setFlag(CPUSTAT_CARRY, 1);
       }
 
       cpu6502_setFlag(CPUSTAT_NEGATIVE, signedResult < 0);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_CPX:
     {
-      uint8_t memVal = memRead(val);
+      uint8_t memVal = hot.memRead(val);
 
-      int8_t signedResult = ((int8_t) reg.x) - ((int8_t) memVal);
-      if (reg.x < memVal) {
+      int8_t signedResult = ((int8_t) hot.reg.x) - ((int8_t) memVal);
+      if (hot.reg.x < memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 0);
         cpu6502_setFlag(CPUSTAT_CARRY, 0);
-      } else if (reg.x == memVal) {
+      } else if (hot.reg.x == memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 1);
         cpu6502_setFlag(CPUSTAT_CARRY, 1);
-      } else if (reg.x > memVal) {
+      } else if (hot.reg.x > memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 0);
         cpu6502_setFlag(CPUSTAT_CARRY, 1);
       }
 
       cpu6502_setFlag(CPUSTAT_NEGATIVE, signedResult < 0);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_CPY:
     {
-      uint8_t memVal = memRead(val);
+      uint8_t memVal = hot.memRead(val);
 
-      int8_t signedResult = ((int8_t) reg.y) - ((int8_t) memVal);
-      if (reg.y < memVal) {
+      int8_t signedResult = ((int8_t) hot.reg.y) - ((int8_t) memVal);
+      if (hot.reg.y < memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 0);
         cpu6502_setFlag(CPUSTAT_CARRY, 0);
-      } else if (reg.y == memVal) {
+      } else if (hot.reg.y == memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 1);
         cpu6502_setFlag(CPUSTAT_CARRY, 1);
-      } else if (reg.y > memVal) {
+      } else if (hot.reg.y > memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 0);
         cpu6502_setFlag(CPUSTAT_CARRY, 1);
       }
 
       cpu6502_setFlag(CPUSTAT_NEGATIVE, signedResult < 0);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_BIT:
     {
-      uint8_t memVal = memRead(val);
-      cpu6502_setFlag(CPUSTAT_ZERO, (reg.a & memVal) == 0);
+      uint8_t memVal = hot.memRead(val);
+      cpu6502_setFlag(CPUSTAT_ZERO, (hot.reg.a & memVal) == 0);
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (memVal & BIT_MASK_8) != 0);
       cpu6502_setFlag(CPUSTAT_OVERFLOW, (memVal & BIT_MASK_7) != 0);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_BCC:
     {
-      cpu6502_shouldBranch(0, CPUSTAT_CARRY) ? (reg.pc = val) : (reg.pc += b->count);
+      cpu6502_shouldBranch(0, CPUSTAT_CARRY) ? (hot.reg.pc = val) : (hot.reg.pc += b->count);
       break;
     }
     case I_BCS:
     {
-      cpu6502_shouldBranch(1, CPUSTAT_CARRY) ? (reg.pc = val) : (reg.pc += b->count);
+      cpu6502_shouldBranch(1, CPUSTAT_CARRY) ? (hot.reg.pc = val) : (hot.reg.pc += b->count);
       break;
     }
     case I_BNE:
     {
-      cpu6502_shouldBranch(0, CPUSTAT_ZERO) ? (reg.pc = val) : (reg.pc += b->count);
+      cpu6502_shouldBranch(0, CPUSTAT_ZERO) ? (hot.reg.pc = val) : (hot.reg.pc += b->count);
       break;
     }
     case I_BEQ:
     {
-      cpu6502_shouldBranch(1, CPUSTAT_ZERO) ? (reg.pc = val) : (reg.pc += b->count);
+      cpu6502_shouldBranch(1, CPUSTAT_ZERO) ? (hot.reg.pc = val) : (hot.reg.pc += b->count);
       break;
     }
     case I_BPL:
     {
-      cpu6502_shouldBranch(0, CPUSTAT_NEGATIVE) ? (reg.pc = val) : (reg.pc += b->count);
+      cpu6502_shouldBranch(0, CPUSTAT_NEGATIVE) ? (hot.reg.pc = val) : (hot.reg.pc += b->count);
       break;
     }
     case I_BMI:
     {
-      cpu6502_shouldBranch(1, CPUSTAT_NEGATIVE) ? (reg.pc = val) : (reg.pc += b->count);
+      cpu6502_shouldBranch(1, CPUSTAT_NEGATIVE) ? (hot.reg.pc = val) : (hot.reg.pc += b->count);
       break;
     }
     case I_BVC:
     {
-      cpu6502_shouldBranch(0, CPUSTAT_OVERFLOW) ? (reg.pc = val) : (reg.pc += b->count);
+      cpu6502_shouldBranch(0, CPUSTAT_OVERFLOW) ? (hot.reg.pc = val) : (hot.reg.pc += b->count);
       break;
     }
     case I_BVS:
     {
-      cpu6502_shouldBranch(1, CPUSTAT_OVERFLOW) ? (reg.pc = val) : (reg.pc += b->count);
+      cpu6502_shouldBranch(1, CPUSTAT_OVERFLOW) ? (hot.reg.pc = val) : (hot.reg.pc += b->count);
       break;
     }
     case I_TAX:
     {
-      reg.x = reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.x == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.x & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.x = hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.x == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.x & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_TXA:
     {
-      reg.a = reg.x;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = hot.reg.x;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_TAY:
     {
-      reg.y = reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.y == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.y & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.y = hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.y == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.y & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_TYA:
     {
-      reg.a = reg.y;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = hot.reg.y;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_TSX:
     {
-      reg.x = reg.s;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.x == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.x & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.x = hot.reg.s;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.x == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.x & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_TXS:
     {
-      reg.s = reg.x;
-      reg.pc += b->count;
+      hot.reg.s = hot.reg.x;
+      hot.reg.pc += b->count;
       break;
     }
     case I_PLA:
     {
-      reg.a = cpu6502_stackPull();
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = cpu6502_stackPull();
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_PHA:
     {
-      cpu6502_stackPush(reg.a);
-      reg.pc += b->count;
+      cpu6502_stackPush(hot.reg.a);
+      hot.reg.pc += b->count;
       break;
     }
     case I_PLP:
     {
-      reg.p = cpu6502_stackPull();
+      hot.reg.p = cpu6502_stackPull();
       cpu6502_setFlag(CPUSTAT_BREAK2, true);
       cpu6502_setFlag(CPUSTAT_BREAK, false);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_PHP:
     {
-      uint8_t regPVal = reg.p | CPUSTAT_BREAK;
+      uint8_t regPVal = hot.reg.p | CPUSTAT_BREAK;
       cpu6502_stackPush(regPVal);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_JMP:
     {
-      reg.pc = val;
+      hot.reg.pc = val;
       break;
     }
     case I_JSR:
     {
-      uint16_t retAddr = reg.pc + 2;
-      reg.pc = val;
+      uint16_t retAddr = hot.reg.pc + 2;
+      hot.reg.pc = val;
       cpu6502_stackPush(retAddr >> 8);
       cpu6502_stackPush(retAddr & BIT_FILL_8);
       break;
@@ -1244,84 +1524,84 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
     {
       uint16_t low = cpu6502_stackPull();
       uint16_t high = cpu6502_stackPull();
-      reg.pc = ((high << 8) | low) + 1;
+      hot.reg.pc = ((high << 8) | low) + 1;
       break;
     }
     case I_RTI:
     {
-      reg.p = cpu6502_stackPull();
+      hot.reg.p = cpu6502_stackPull();
       uint16_t low = cpu6502_stackPull();
       uint16_t high = cpu6502_stackPull();
-      reg.pc = ((high << 8) | low);
+      hot.reg.pc = ((high << 8) | low);
       cpu6502_setFlag(CPUSTAT_BREAK2, true);
       break;
     }
     case I_CLC:
     {
       cpu6502_setFlag(CPUSTAT_CARRY, 0);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_SEC:
     {
       cpu6502_setFlag(CPUSTAT_CARRY, 1);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_CLD:
     {
       cpu6502_setFlag(CPUSTAT_DECIMAL, 0);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_SED:
     {
       cpu6502_setFlag(CPUSTAT_DECIMAL, 1);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_CLI:
     {
       cpu6502_setFlag(CPUSTAT_NO_INTRPT, 0);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_SEI:
     {
       cpu6502_setFlag(CPUSTAT_NO_INTRPT, 1);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_CLV:
     {
       cpu6502_setFlag(CPUSTAT_OVERFLOW, 0);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_BRK:
     {
       cpu6502_setFlag(CPUSTAT_BREAK, 1);
       cpu6502_setFlag(CPUSTAT_NO_INTRPT, 1);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_NOP:
     {
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     // illegal instructions
     case I_ILL_ALR: // AND + LSR
     {
       // AND
-      reg.a = memRead(val) & reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
+      hot.reg.a = hot.memRead(val) & hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
 
       // LSR
-      uint8_t storedVal = reg.a;
+      uint8_t storedVal = hot.reg.a;
       if (!(b->addressingMode == AM_ACCUMULATOR)) {
-        storedVal = memRead(val);
+        storedVal = hot.memRead(val);
       }
 
       cpu6502_setFlag(CPUSTAT_CARRY, storedVal & 1);
@@ -1331,49 +1611,49 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (storedVal & BIT_MASK_8) != 0);
 
       if (b->addressingMode == AM_ACCUMULATOR) {
-        reg.a = storedVal;
+        hot.reg.a = storedVal;
       } else {
-        memWrite(val, storedVal);
+        hot.memWrite(val, storedVal);
       }
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_ANC: // AND + (C<-ASL)
     {
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_ANC2: // AND + (C<-ROL)
     {
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_ANE: // (* AND X) + AND
     {
-      reg.a = (rand() % 0xFF) & reg.x;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
+      hot.reg.a = (rand() % 0xFF) & hot.reg.x;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
 
-      reg.a = memRead(val) & reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = hot.memRead(val) & hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_ARR: // AND + ROR
     {
       // AND
-      reg.a = memRead(val) & reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
+      hot.reg.a = hot.memRead(val) & hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
       
       // ROR
-      uint8_t storedVal = reg.a;
+      uint8_t storedVal = hot.reg.a;
       if (!(b->addressingMode == AM_ACCUMULATOR)) {
-        storedVal = memRead(val);
+        storedVal = hot.memRead(val);
       }
 
-      bool oldCarry = ((reg.p & CPUSTAT_CARRY) > 0);
+      bool oldCarry = ((hot.reg.p & CPUSTAT_CARRY) > 0);
       cpu6502_setFlag(CPUSTAT_CARRY, storedVal & 1);
       storedVal = storedVal >> 1;
       storedVal = storedVal | (oldCarry << 7);
@@ -1382,103 +1662,103 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (storedVal & BIT_MASK_8) != 0);
 
       if (b->addressingMode == AM_ACCUMULATOR) {
-        reg.a = storedVal;
+        hot.reg.a = storedVal;
       } else {
-        memWrite(val, storedVal);
+        hot.memWrite(val, storedVal);
       }
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_DCP: // DEC + CMP
     {
       // DEC
-      uint8_t decval = memRead(val) - 1;
-      memWrite(val, decval);
+      uint8_t decval = hot.memRead(val) - 1;
+      hot.memWrite(val, decval);
       cpu6502_setFlag(CPUSTAT_ZERO, decval == 0);
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (decval & BIT_MASK_8) != 0);
       
       // CMP
-      uint8_t memVal = memRead(val);
+      uint8_t memVal = hot.memRead(val);
 
-      int8_t signedResult = ((int8_t) reg.a) - ((int8_t) memVal);
-      if (reg.a < memVal) {
+      int8_t signedResult = ((int8_t) hot.reg.a) - ((int8_t) memVal);
+      if (hot.reg.a < memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 0);
         cpu6502_setFlag(CPUSTAT_CARRY, 0);
-      } else if (reg.a == memVal) {
+      } else if (hot.reg.a == memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 1);
         cpu6502_setFlag(CPUSTAT_CARRY, 1);
-      } else if (reg.a > memVal) {
+      } else if (hot.reg.a > memVal) {
         cpu6502_setFlag(CPUSTAT_ZERO, 0);
         cpu6502_setFlag(CPUSTAT_CARRY, 1);
       }
 
       cpu6502_setFlag(CPUSTAT_NEGATIVE, signedResult < 0);
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_ISC:
     {
       // INC
-      uint8_t incval = memRead(val) + 1;
-      memWrite(val, incval);
+      uint8_t incval = hot.memRead(val) + 1;
+      hot.memWrite(val, incval);
       cpu6502_setFlag(CPUSTAT_ZERO, incval == 0);
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (incval & BIT_MASK_8) != 0);
       
       // SBC
-      uint8_t memoryVal = ~memRead(val);
-      uint16_t sum = reg.a + memoryVal + ((uint16_t)((reg.p & CPUSTAT_CARRY) > 0));
+      uint8_t memoryVal = ~hot.memRead(val);
+      uint16_t sum = hot.reg.a + memoryVal + ((uint16_t)((hot.reg.p & CPUSTAT_CARRY) > 0));
       cpu6502_setFlag(CPUSTAT_CARRY, sum > 0xFF);
-      cpu6502_setFlag(CPUSTAT_OVERFLOW, (reg.a ^ sum) & (memoryVal ^ sum) & 0x80);
-      reg.a = (uint8_t) sum;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      cpu6502_setFlag(CPUSTAT_OVERFLOW, (hot.reg.a ^ sum) & (memoryVal ^ sum) & 0x80);
+      hot.reg.a = (uint8_t) sum;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_LAS:
     {
       // LDA
-      reg.a = memRead(val);
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
+      hot.reg.a = hot.memRead(val);
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
       
       // TSX
-      reg.x = reg.s;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.x == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.x & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.x = hot.reg.s;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.x == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.x & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_LAX:
     {
       // LDA
-      reg.a = memRead(val);
-      reg.x = reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.x == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.x & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = hot.memRead(val);
+      hot.reg.x = hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.x == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.x & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_LXA:
     {
       // (magic) AND
-      uint8_t calcVal = (rand() % 0xFF) & reg.a;
-      reg.a = calcVal;
-      reg.x = calcVal;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      uint8_t calcVal = (rand() % 0xFF) & hot.reg.a;
+      hot.reg.a = calcVal;
+      hot.reg.x = calcVal;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_RLA:
     {
       // ROL
-      uint8_t storedVal = reg.a;
+      uint8_t storedVal = hot.reg.a;
       if (!(b->addressingMode == AM_ACCUMULATOR)) {
-        storedVal = memRead(val);
+        storedVal = hot.memRead(val);
       }
 
-      bool oldCarry = ((reg.p & CPUSTAT_CARRY) > 0);
+      bool oldCarry = ((hot.reg.p & CPUSTAT_CARRY) > 0);
       cpu6502_setFlag(CPUSTAT_CARRY, (storedVal >> 7) & 1);
       storedVal = storedVal << 1;
       storedVal = storedVal | oldCarry;
@@ -1487,26 +1767,26 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (storedVal & BIT_MASK_8) != 0);
 
       if (b->addressingMode == AM_ACCUMULATOR) {
-        reg.a = storedVal;
+        hot.reg.a = storedVal;
       } else {
-        memWrite(val, storedVal);
+        hot.memWrite(val, storedVal);
       }
       
       // AND
-      reg.a = memRead(val) & reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = hot.memRead(val) & hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_RRA:
     {
-      uint8_t storedVal = reg.a;
+      uint8_t storedVal = hot.reg.a;
       if (!(b->addressingMode == AM_ACCUMULATOR)) {
-        storedVal = memRead(val);
+        storedVal = hot.memRead(val);
       }
 
-      bool oldCarry = ((reg.p & CPUSTAT_CARRY) > 0);
+      bool oldCarry = ((hot.reg.p & CPUSTAT_CARRY) > 0);
       cpu6502_setFlag(CPUSTAT_CARRY, storedVal & 1);
       storedVal = storedVal >> 1;
       storedVal = storedVal | (oldCarry << 7);
@@ -1515,65 +1795,65 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (storedVal & BIT_MASK_8) != 0);
 
       if (b->addressingMode == AM_ACCUMULATOR) {
-        reg.a = storedVal;
+        hot.reg.a = storedVal;
       } else {
-        memWrite(val, storedVal);
+        hot.memWrite(val, storedVal);
       }
 
-      uint8_t memoryVal = memRead(val);
-      uint16_t sum = reg.a + memoryVal + ((uint16_t)((reg.p & CPUSTAT_CARRY) > 0));
+      uint8_t memoryVal = hot.memRead(val);
+      uint16_t sum = hot.reg.a + memoryVal + ((uint16_t)((hot.reg.p & CPUSTAT_CARRY) > 0));
       cpu6502_setFlag(CPUSTAT_CARRY, sum > 0xFF);
-      cpu6502_setFlag(CPUSTAT_OVERFLOW, (reg.a ^ sum) & (memoryVal ^ sum) & 0x80);
-      reg.a = (uint8_t) sum;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      cpu6502_setFlag(CPUSTAT_OVERFLOW, (hot.reg.a ^ sum) & (memoryVal ^ sum) & 0x80);
+      hot.reg.a = (uint8_t) sum;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_SAX:
     {
-      memWrite(val, reg.a & reg.x);
-      reg.pc += b->count;
+      hot.memWrite(val, hot.reg.a & hot.reg.x);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_SBX:
     {
       // CMP
-      reg.x -= 1;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.x == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.x & BIT_MASK_8) != 0);
+      hot.reg.x -= 1;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.x == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.x & BIT_MASK_8) != 0);
       
       // DEX
-      reg.x -= 1;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.x == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.x & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.x -= 1;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.x == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.x & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_SHA:
     {
-      memWrite(val, reg.a & reg.x & (uint8_t)(((val & 0xF0) >> 0x0F) + 1));
-      reg.pc += b->count;
+      hot.memWrite(val, hot.reg.a & hot.reg.x & (uint8_t)(((val & 0xF0) >> 0x0F) + 1));
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_SHX:
     {
-      memWrite(val, reg.x & (uint8_t)(((val & 0xF0) >> 0x0F) + 1));
-      reg.pc += b->count;
+      hot.memWrite(val, hot.reg.x & (uint8_t)(((val & 0xF0) >> 0x0F) + 1));
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_SHY:
     {
-      memWrite(val, reg.y & (uint8_t)(((val & 0xF0) >> 0x0F) + 1));
-      reg.pc += b->count;
+      hot.memWrite(val, hot.reg.y & (uint8_t)(((val & 0xF0) >> 0x0F) + 1));
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_SLO:
     {
       // SLO
-      uint8_t storedVal = reg.a;
+      uint8_t storedVal = hot.reg.a;
       if (!(b->addressingMode == AM_ACCUMULATOR)) {
-        storedVal = memRead(val);
+        storedVal = hot.memRead(val);
       }
 
       cpu6502_setFlag(CPUSTAT_CARRY, (storedVal >> 7) & 1);
@@ -1583,24 +1863,24 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (storedVal & BIT_MASK_8) != 0);
 
       if (b->addressingMode == AM_ACCUMULATOR) {
-        reg.a = storedVal;
+        hot.reg.a = storedVal;
       } else {
-        memWrite(val, storedVal);
+        hot.memWrite(val, storedVal);
       }
       
       // ORA
-      reg.a = memRead(val) | reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = hot.memRead(val) | hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_SRE:
     {
       // LSR
-      uint8_t storedVal = reg.a;
+      uint8_t storedVal = hot.reg.a;
       if (!(b->addressingMode == AM_ACCUMULATOR)) {
-        storedVal = memRead(val);
+        storedVal = hot.memRead(val);
       }
 
       cpu6502_setFlag(CPUSTAT_CARRY, storedVal & 1);
@@ -1610,60 +1890,99 @@ static force_inline uint8_t cpu6502_execute(Bytecode* b) {
       cpu6502_setFlag(CPUSTAT_NEGATIVE, (storedVal & BIT_MASK_8) != 0);
 
       if (b->addressingMode == AM_ACCUMULATOR) {
-        reg.a = storedVal;
+        hot.reg.a = storedVal;
       } else {
-        memWrite(val, storedVal);
+        hot.memWrite(val, storedVal);
       }
 
       // EOR
-      reg.a = memRead(val) ^ reg.a;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      hot.reg.a = hot.memRead(val) ^ hot.reg.a;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_TAS:
     {
-      reg.s = reg.a & reg.x;
-      memWrite(val, reg.a & reg.x & (uint8_t)(((val & 0xF0) >> 0x0F) + 1));
-      reg.pc += b->count;
+      hot.reg.s = hot.reg.a & hot.reg.x;
+      hot.memWrite(val, hot.reg.a & hot.reg.x & (uint8_t)(((val & 0xF0) >> 0x0F) + 1));
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_USBC:
     {
-      uint8_t memoryVal = ~memRead(val);
-      uint16_t sum = reg.a + memoryVal + ((uint16_t)((reg.p & CPUSTAT_CARRY) > 0));
+      uint8_t memoryVal = ~hot.memRead(val);
+      uint16_t sum = hot.reg.a + memoryVal + ((uint16_t)((hot.reg.p & CPUSTAT_CARRY) > 0));
       cpu6502_setFlag(CPUSTAT_CARRY, sum > 0xFF);
-      cpu6502_setFlag(CPUSTAT_OVERFLOW, (reg.a ^ sum) & (memoryVal ^ sum) & 0x80);
-      reg.a = (uint8_t) sum;
-      cpu6502_setFlag(CPUSTAT_ZERO, reg.a == 0);
-      cpu6502_setFlag(CPUSTAT_NEGATIVE, (reg.a & BIT_MASK_8) != 0);
-      reg.pc += b->count;
+      cpu6502_setFlag(CPUSTAT_OVERFLOW, (hot.reg.a ^ sum) & (memoryVal ^ sum) & 0x80);
+      hot.reg.a = (uint8_t) sum;
+      cpu6502_setFlag(CPUSTAT_ZERO, hot.reg.a == 0);
+      cpu6502_setFlag(CPUSTAT_NEGATIVE, (hot.reg.a & BIT_MASK_8) != 0);
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_NOP:
     {
-      reg.pc += b->count;
+      hot.reg.pc += b->count;
       break;
     }
     case I_ILL_JAM:
     {
-      cpuerrno = 1;
-      clockMode = CPUCLOCK_HALT;
-      reg.pc += b->count;
+      hot.cpuerrno = 1;
+      hot.clockMode = CPUCLOCK_HALT;
+      hot.reg.pc += b->count;
       break;
     }
     default:
     {
-      cpuerrno = 1;
-      clockMode = CPUCLOCK_HALT;
-      reg.pc += b->count;
+      hot.cpuerrno = 1;
+      hot.clockMode = CPUCLOCK_HALT;
+      hot.reg.pc += b->count;
       break;
     }
   }
   return cycleCount;
 }
 
+void cpu6502_decode(uint8_t opcode, Bytecode* b) {
+  cpu6502_parseOpcode(opcode, b);
+}
+
+uint8_t cpu6502_executeDetached(CPUState* state, void(*w)(uint16_t, uint8_t), uint8_t(*r)(uint16_t)) {
+  CPUState saved;
+  cpu6502_saveState(&saved);
+  void(*savedWrite)(uint16_t, uint8_t) = hot.memWrite;
+  uint8_t(*savedRead)(uint16_t) = hot.memRead;
+
+  cpu6502_loadState(state);
+  hot.memWrite = w;
+  hot.memRead = r;
+  Bytecode bytecode;
+  cpu6502_parseOpcode(hot.memRead(hot.reg.pc), &bytecode);
+  for (int i = 0; i < bytecode.count; i++) {
+    bytecode.data[i] = hot.memRead(hot.reg.pc + i);
+  }
+  uint8_t cycles = cpu6502_execute(&bytecode);
+  cpu6502_saveState(state);
+
+  cpu6502_loadState(&saved);
+  hot.memWrite = savedWrite;
+  hot.memRead = savedRead;
+  return cycles;
+}
+
+void cpu6502_saveState(CPUState* state) {
+  state->reg = hot.reg;
+  state->clockMode = hot.clockMode;
+  state->cpuerrno = hot.cpuerrno;
+}
+
+void cpu6502_loadState(CPUState* state) {
+  hot.reg = state->reg;
+  hot.clockMode = state->clockMode;
+  hot.cpuerrno = state->cpuerrno;
+}
+
 uint8_t cpu6502_getErrno() {
-  return cpuerrno;
+  return hot.cpuerrno;
 }
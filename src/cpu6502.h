@@ -35,69 +35,98 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
 
 #define CPU_DEBUG FALSE
 
+/**
+ * @brief Bump whenever decoding or the meaning of a Bytecode changes, so
+ *        code caches written by older builds aren't used
+ */
+#define CPU_DECODER_VERSION 1
+
 /**
  * @brief Initialize the CPU
  * 
  * @param w the pointer to the write function
  * @param r the pointer to the read function
  * @param mode the emulation mode
+ * @param prog the cartridge's decoded program (NULL when interpreting
+ *             directly), which is kept as it is
  */
-void cpu6502_init(void(*w)(uint16_t, uint8_t), uint8_t(*r)(uint16_t), CPUEmulationMode mode);
+void cpu6502_init(void(*w)(uint16_t, uint8_t), uint8_t(*r)(uint16_t), CPUEmulationMode mode, BytecodeProgram* prog);
 
 /**
- * @brief Execute a CPU instruction
+ * @brief Identify the decoder, for checking saved bytecode still matches
+ *        it. Covers CPU_DECODER_VERSION, the Bytecode layout and what
+ *        every opcode decodes to.
  * 
- * @param traceStr the trace string (or NULL if tracing disabled)
- * @param c the callback function which contains one argument:
- *          - (uint8_t) clocks : the number of clocks elapsed since last step
+ * @return uint64_t the decoder ID
  */
-void cpu6502_step(char* traceStr, void(*c)(uint8_t));
+uint64_t cpu6502_getDecoderID();
 
 /**
- * @brief Trigger NMI
+ * @brief Create an empty bytecode program for a cartridge
+ * 
+ * @return BytecodeProgram* the program
  */
-void cpu6502_nmi();
+BytecodeProgram* cpu6502_createBytecodeProgram();
 
 /**
- * @brief Push a value to the stack
+ * @brief Free a bytecode program (and unmap its code cache file)
  * 
- * @param val the value to push
+ * @param prog the program, or NULL
  */
-static force_inline void cpu6502_stackPush(uint8_t val);
+void cpu6502_freeBytecodeProgram(BytecodeProgram* prog);
 
 /**
- * @brief Pull a value from the stack
+ * @brief Execute a CPU instruction
  * 
- * @return uint8_t the value pulled
+ * @param traceStr the trace string (or NULL if tracing disabled)
+ * @param c the callback function which contains one argument:
+ *          - (uint8_t) clocks : the number of clocks elapsed since last step
  */
-static force_inline uint8_t cpu6502_stackPull();
+void cpu6502_step(char* traceStr, void(*c)(uint8_t));
 
 /**
- * @brief Set a CPU flag
+ * @brief A loop which executes instructions until a callback sets the stop
+ *        flag (nonzero) or the CPU halts. There's one per emulation mode, with and
+ *        without tracing, so the choice costs nothing per instruction.
  * 
- * @param flag the CPU flag
- * @param enabled the value of the flag
+ * @param stop checked before each instruction (a byte, since bool's size
+ *             depends on whether stdbool.h was included)
+ * @param c the clock callback, as for cpu6502_step
+ * @param t receives the trace of each instruction after it runs (or NULL
+ *          if tracing is disabled)
+ * @return uint32_t the number of instructions executed
  */
-static force_inline void cpu6502_setFlag(CPUStatusFlag flag, bool enabled);
+typedef uint32_t (*CPURunLoop)(uint8_t* stop, void(*c)(uint8_t), void(*t)(char*));
 
 /**
- * @brief Perform a branch
+ * @brief Get the run loop specialized for an emulation mode
  * 
- * @param desiredResult the branch condition
- * @param flag the flag to check condition for
+ * @param mode the emulation mode
+ * @param accurate whether to use cycle-accurate timing
+ * @param tracing whether the loop should produce traces
+ * @return CPURunLoop the run loop
  */
-static force_inline bool cpu6502_shouldBranch(bool desiredResult, CPUStatusFlag flag);
+CPURunLoop cpu6502_getRunLoop(CPUEmulationMode mode, bool accurate, bool tracing);
 
 /**
- * @brief Execute a bytecode instruction
+ * @brief Set whether cpu6502_step uses cycle-accurate timing. The accurate
+ *        path clocks the PPU up to the cycle of the instruction's own memory
+ *        access and holds NMI until the instruction finishes, which costs a
+ *        little per instruction, so only the games that need it should use it.
  * 
- * @param b the bytecode pointer
- * @return uint8_t the number of clocks elapsed
+ * @param accurate whether to use cycle-accurate timing
+ */
+void cpu6502_setAccurateTiming(bool accurate);
+
+/**
+ * @brief Trigger NMI
  */
-static force_inline uint8_t cpu6502_execute(Bytecode* b);
+void cpu6502_nmi();
 
 /**
  * @brief Set the clock mode of the CPU
@@ -113,14 +142,6 @@ void cpu6502_setClockMode(CPUClockMode mode);
  */
 CPUClockMode cpu6502_getClockMode();
 
-/**
- * @brief Read 16-bit value at address
- * 
- * @param addr the address
- * @return uint16_t the return value
- */
-static force_inline uint16_t cpu6502_read16(uint16_t addr);
-
 /**
  * @brief Disassembly program code
  * 
@@ -140,13 +161,37 @@ void cpu6502_dasm(uint8_t* prgData, uint32_t prgSize, void(*c)(char c[128]), uin
 void cpu6502_loadBytecodeProgram(uint8_t* prgData, uint32_t prgSize);
 
 /**
- * @brief Determine the mnemonic, addressing mode, and size of
- *        an instruction given its opcode.
+ * @brief Decode an opcode for other interpreters (see cpu6502_parseOpcode)
  *
  * @param opcode the opcode
  * @param b the pointer to the bytecode object
  */
-static force_inline void cpu6502_parseOpcode(uint8_t opcode, Bytecode* b);
+void cpu6502_decode(uint8_t opcode, Bytecode* b);
+
+/**
+ * @brief Execute one instruction on a CPU other than this thread's,
+ *        leaving this thread's CPU untouched
+ *
+ * @param state the registers and status to step
+ * @param w the write function of that CPU's memory
+ * @param r the read function of that CPU's memory
+ * @return uint8_t the number of clocks elapsed
+ */
+uint8_t cpu6502_executeDetached(CPUState* state, void(*w)(uint16_t, uint8_t), uint8_t(*r)(uint16_t));
+
+/**
+ * @brief Copy the registers and status of the CPU
+ * 
+ * @param state the pointer to the state object to fill
+ */
+void cpu6502_saveState(CPUState* state);
+
+/**
+ * @brief Restore the registers and status of the CPU
+ * 
+ * @param state the pointer to the state object to restore from
+ */
+void cpu6502_loadState(CPUState* state);
 
 /**
  * @brief Get error number of CPU
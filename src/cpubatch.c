@@ -0,0 +1,469 @@
+/**
+ * @file cpubatch.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "cpubatch.h"
+
+typedef int8_t LaneS8 __attribute__((vector_size(CPU_BATCH_LANES)));
+typedef int16_t LaneS16 __attribute__((vector_size(CPU_BATCH_LANES * 2)));
+
+// decoded once per thread by the scalar CPU's decoder
+static machine_local Bytecode decodeTable[256];
+static machine_local bool decoded = false;
+
+// the lane whose memory the scalar CPU is borrowed for
+static machine_local CPUBatch* scalarBatch;
+static machine_local int scalarLane;
+static machine_local CPUBatchWrite scalarWrites[4];
+static machine_local uint8_t scalarWriteCount;
+
+void cpubatch_init(CPUBatch* batch) {
+  memset(batch, 0, sizeof(CPUBatch));
+  for (int i = 0; i < CPU_BATCH_LANES; i++) {
+    batch->halted[i] = 0xFF;
+  }
+  if (!decoded) {
+    for (int op = 0; op < 256; op++) {
+      cpu6502_decode(op, &decodeTable[op]);
+    }
+    decoded = true;
+  }
+}
+
+void cpubatch_setLane(CPUBatch* batch, int lane, CPURegisters* regs, uint8_t* memory) {
+  batch->a[lane] = regs->a;
+  batch->x[lane] = regs->x;
+  batch->y[lane] = regs->y;
+  batch->s[lane] = regs->s;
+  batch->p[lane] = regs->p;
+  batch->pc[lane] = regs->pc;
+  batch->halted[lane] = 0x00;
+  batch->cpuerrno[lane] = 0;
+  batch->memory[lane] = memory;
+}
+
+void cpubatch_getLane(CPUBatch* batch, int lane, CPUState* state) {
+  state->reg.a = batch->a[lane];
+  state->reg.x = batch->x[lane];
+  state->reg.y = batch->y[lane];
+  state->reg.s = batch->s[lane];
+  state->reg.p = batch->p[lane];
+  state->reg.pc = batch->pc[lane];
+  state->clockMode = batch->halted[lane] ? CPUCLOCK_HALT : CPUCLOCK_SUSPENDED;
+  state->cpuerrno = batch->cpuerrno[lane];
+}
+
+static void cpubatch_putLane(CPUBatch* batch, int lane, CPUState* state) {
+  batch->a[lane] = state->reg.a;
+  batch->x[lane] = state->reg.x;
+  batch->y[lane] = state->reg.y;
+  batch->s[lane] = state->reg.s;
+  batch->p[lane] = state->reg.p;
+  batch->pc[lane] = state->reg.pc;
+  batch->halted[lane] = (state->clockMode == CPUCLOCK_HALT) ? 0xFF : 0x00;
+  batch->cpuerrno[lane] = state->cpuerrno;
+}
+
+void cpubatch_setVerify(CPUBatch* batch, bool enabled) {
+  batch->verify = enabled;
+}
+
+/* SCALAR FALLBACK */
+
+static uint8_t cpubatch_scalarRead(uint16_t addr) {
+  return scalarBatch->memory[scalarLane][addr];
+}
+
+static void cpubatch_scalarWrite(uint16_t addr, uint8_t val) {
+  uint8_t* cell = &scalarBatch->memory[scalarLane][addr];
+  if (scalarWriteCount < 4) {
+    scalarWrites[scalarWriteCount].addr = addr;
+    scalarWrites[scalarWriteCount].before = *cell;
+    scalarWrites[scalarWriteCount].after = val;
+    scalarWriteCount += 1;
+  }
+  *cell = val;
+}
+
+/**
+ * @brief Run one instruction of a lane on the scalar interpreter
+ */
+static uint8_t cpubatch_stepScalar(CPUBatch* batch, int lane, CPUState* state) {
+  cpubatch_getLane(batch, lane, state);
+  scalarBatch = batch;
+  scalarLane = lane;
+  scalarWriteCount = 0;
+  uint8_t cycles = cpu6502_executeDetached(state, &cpubatch_scalarWrite, &cpubatch_scalarRead);
+  cpubatch_putLane(batch, lane, state);
+  return cycles;
+}
+
+/* VECTOR OPERATIONS */
+
+static force_inline LaneU16 cpubatch_widen(LaneU8 v) {
+  return __builtin_convertvector(v, LaneU16);
+}
+
+static force_inline LaneU8 cpubatch_narrow(LaneU16 v) {
+  return __builtin_convertvector(v, LaneU8);
+}
+
+static force_inline LaneU16 cpubatch_widenMask(LaneU8 m) {
+  return (LaneU16)__builtin_convertvector((LaneS8)m, LaneS16);
+}
+
+static force_inline LaneU8 cpubatch_blend(LaneU8 m, LaneU8 taken, LaneU8 kept) {
+  return (taken & m) | (kept & ~m);
+}
+
+static force_inline LaneU16 cpubatch_blend16(LaneU16 m, LaneU16 taken, LaneU16 kept) {
+  return (taken & m) | (kept & ~m);
+}
+
+/**
+ * @brief The N and Z flags of a result
+ */
+static force_inline LaneU8 cpubatch_nz(LaneU8 v) {
+  return (v & CPUSTAT_NEGATIVE) | ((LaneU8)(v == 0) & CPUSTAT_ZERO);
+}
+
+static force_inline LaneU8 cpubatch_read(CPUBatch* batch, LaneU16 addr, LaneU8 m) {
+  LaneU8 v = {0};
+  for (int i = 0; i < CPU_BATCH_LANES; i++) {
+    if (m[i]) v[i] = batch->memory[i][addr[i]];
+  }
+  return v;
+}
+
+static force_inline void cpubatch_write(CPUBatch* batch, LaneU16 addr, LaneU8 v, LaneU8 m) {
+  for (int i = 0; i < CPU_BATCH_LANES; i++) {
+    if (!m[i]) continue;
+    uint8_t* cell = &batch->memory[i][addr[i]];
+    if (batch->verify && batch->writeCount[i] < 4) {
+      CPUBatchWrite* w = &batch->writes[i][batch->writeCount[i]++];
+      w->addr = addr[i];
+      w->before = *cell;
+      w->after = v[i];
+    }
+    *cell = v[i];
+  }
+}
+
+// the stack keeps the scalar CPU's behaviour of refusing to wrap
+static force_inline void cpubatch_push(CPUBatch* batch, LaneU8* s, LaneU8 v, LaneU8 m) {
+  LaneU8 pm = m & (LaneU8)(*s != 0x00);
+  cpubatch_write(batch, cpubatch_widen(*s) + 0x100, v, pm);
+  *s -= pm & 1;
+}
+
+static force_inline LaneU8 cpubatch_pull(CPUBatch* batch, LaneU8* s, LaneU8 m) {
+  LaneU8 pm = m & (LaneU8)(*s != 0xFF);
+  *s += pm & 1;
+  return cpubatch_read(batch, cpubatch_widen(*s) + 0x100, pm);
+}
+
+/**
+ * @brief Execute an instruction on every lane in the mask
+ *
+ * @return uint8_t the number of clocks elapsed (the same on every lane)
+ */
+static uint8_t cpubatch_execute(CPUBatch* batch, Bytecode* b, LaneU8 m) {
+  LaneU8 a = batch->a;
+  LaneU8 x = batch->x;
+  LaneU8 y = batch->y;
+  LaneU8 s = batch->s;
+  LaneU8 p = batch->p;
+  LaneU16 pc = batch->pc;
+  LaneU16 next = pc + b->count;
+  LaneU16 val = {0};
+  uint8_t cycleCount = 2;
+  uint16_t absolute = ((uint16_t)b->data[2] << 8) | (uint16_t)b->data[1];
+
+  switch (b->addressingMode) {
+    case AM_IMMEDIATE: val = pc + 1; break;
+    case AM_ABSOLUTE: cycleCount += 2; val += absolute; break;
+    case AM_ZERO_PAGE: cycleCount += 1; val += b->data[1]; break;
+    case AM_ABS_INDIRECT:
+    {
+      uint16_t pointerInc = ((absolute & 0x00FF) == 0x00FF) ? (absolute & 0xFF00) : (absolute + 1);
+      LaneU16 lo = cpubatch_widen(cpubatch_read(batch, val + absolute, m));
+      LaneU16 hi = cpubatch_widen(cpubatch_read(batch, val + pointerInc, m));
+      val = (hi << 8) | lo;
+      break;
+    }
+    case AM_ABS_X: cycleCount += 2; val = cpubatch_widen(x) + absolute; break;
+    case AM_ABS_Y: cycleCount += 2; val = cpubatch_widen(y) + absolute; break;
+    case AM_ZP_X: cycleCount += 2; val = cpubatch_widen(x + b->data[1]); break;
+    case AM_ZP_Y: cycleCount += 2; val = cpubatch_widen(y + b->data[1]); break;
+    case AM_ZP_X_INDIRECT:
+    {
+      cycleCount += 4;
+      LaneU8 zp = x + b->data[1];
+      LaneU16 lo = cpubatch_widen(cpubatch_read(batch, cpubatch_widen(zp), m));
+      LaneU16 hi = cpubatch_widen(cpubatch_read(batch, cpubatch_widen(zp + 1), m));
+      val = (hi << 8) | lo;
+      break;
+    }
+    case AM_ZP_INDIRECT_Y:
+    {
+      cycleCount += 3;
+      LaneU16 lo = cpubatch_widen(cpubatch_read(batch, val + b->data[1], m));
+      LaneU16 hi = cpubatch_widen(cpubatch_read(batch, val + (uint8_t)(b->data[1] + 1), m));
+      val = ((hi << 8) | lo) + cpubatch_widen(y);
+      break;
+    }
+    case AM_RELATIVE: val = pc + (uint16_t)(int8_t)b->data[1] + 2; break;
+    default: cycleCount += 1; break;
+  }
+
+  bool accumulator = (b->addressingMode == AM_ACCUMULATOR);
+  LaneU8 branch = {0};
+  bool branches = false;
+  switch (b->mnemonic) {
+    case I_LDA: a = cpubatch_read(batch, val, m); p = (p & 0x7D) | cpubatch_nz(a); break;
+    case I_LDX: x = cpubatch_read(batch, val, m); p = (p & 0x7D) | cpubatch_nz(x); break;
+    case I_LDY: y = cpubatch_read(batch, val, m); p = (p & 0x7D) | cpubatch_nz(y); break;
+    case I_STA: cpubatch_write(batch, val, a, m); break;
+    case I_STX: cpubatch_write(batch, val, x, m); break;
+    case I_STY: cpubatch_write(batch, val, y, m); break;
+    case I_ADC:
+    case I_SBC:
+    {
+      LaneU8 memoryVal = cpubatch_read(batch, val, m);
+      if (b->mnemonic == I_SBC) memoryVal = ~memoryVal;
+      LaneU16 sum = cpubatch_widen(a) + cpubatch_widen(memoryVal) + cpubatch_widen(p & CPUSTAT_CARRY);
+      LaneU8 result = cpubatch_narrow(sum);
+      LaneU8 overflow = ((a ^ result) & (memoryVal ^ result) & 0x80) >> 1;
+      p = (p & 0x3C) | cpubatch_narrow(sum >> 8) | overflow | cpubatch_nz(result);
+      a = result;
+      break;
+    }
+    case I_INC:
+    case I_DEC:
+    {
+      LaneU8 result = cpubatch_read(batch, val, m) + (uint8_t)((b->mnemonic == I_INC) ? 0x01 : 0xFF);
+      cpubatch_write(batch, val, result, m);
+      p = (p & 0x7D) | cpubatch_nz(result);
+      break;
+    }
+    case I_INX: x += 1; p = (p & 0x7D) | cpubatch_nz(x); break;
+    case I_INY: y += 1; p = (p & 0x7D) | cpubatch_nz(y); break;
+    case I_DEX: x -= 1; p = (p & 0x7D) | cpubatch_nz(x); break;
+    case I_DEY: y -= 1; p = (p & 0x7D) | cpubatch_nz(y); break;
+    case I_ASL:
+    case I_LSR:
+    case I_ROL:
+    case I_ROR:
+    {
+      LaneU8 in = accumulator ? a : cpubatch_read(batch, val, m);
+      LaneU8 carry = p & CPUSTAT_CARRY;
+      LaneU8 out;
+      if (b->mnemonic == I_ASL || b->mnemonic == I_ROL) {
+        out = (in << 1) | (carry & (uint8_t)((b->mnemonic == I_ROL) ? 0x01 : 0x00));
+        carry = in >> 7;
+      } else {
+        out = (in >> 1) | ((carry << 7) & (uint8_t)((b->mnemonic == I_ROR) ? 0x80 : 0x00));
+        carry = in & 1;
+      }
+      p = (p & 0x7C) | carry | cpubatch_nz(out);
+      if (accumulator) {
+        a = out;
+      } else {
+        cpubatch_write(batch, val, out, m);
+      }
+      break;
+    }
+    case I_AND: a &= cpubatch_read(batch, val, m); p = (p & 0x7D) | cpubatch_nz(a); break;
+    case I_ORA: a |= cpubatch_read(batch, val, m); p = (p & 0x7D) | cpubatch_nz(a); break;
+    case I_EOR: a ^= cpubatch_read(batch, val, m); p = (p & 0x7D) | cpubatch_nz(a); break;
+    case I_CMP:
+    case I_CPX:
+    case I_CPY:
+    {
+      LaneU8 r = (b->mnemonic == I_CMP) ? a : (b->mnemonic == I_CPX) ? x : y;
+      LaneU8 memVal = cpubatch_read(batch, val, m);
+      p = (p & 0x7C) | ((LaneU8)(r >= memVal) & CPUSTAT_CARRY) | cpubatch_nz(r - memVal);
+      break;
+    }
+    case I_BIT:
+    {
+      LaneU8 memVal = cpubatch_read(batch, val, m);
+      p = (p & 0x3D) | (memVal & 0xC0) | ((LaneU8)((a & memVal) == 0) & CPUSTAT_ZERO);
+      break;
+    }
+    case I_BCC: branches = true; branch = (LaneU8)((p & CPUSTAT_CARRY) == 0); break;
+    case I_BCS: branches = true; branch = (LaneU8)((p & CPUSTAT_CARRY) != 0); break;
+    case I_BNE: branches = true; branch = (LaneU8)((p & CPUSTAT_ZERO) == 0); break;
+    case I_BEQ: branches = true; branch = (LaneU8)((p & CPUSTAT_ZERO) != 0); break;
+    case I_BPL: branches = true; branch = (LaneU8)((p & CPUSTAT_NEGATIVE) == 0); break;
+    case I_BMI: branches = true; branch = (LaneU8)((p & CPUSTAT_NEGATIVE) != 0); break;
+    case I_BVC: branches = true; branch = (LaneU8)((p & CPUSTAT_OVERFLOW) == 0); break;
+    case I_BVS: branches = true; branch = (LaneU8)((p & CPUSTAT_OVERFLOW) != 0); break;
+    case I_TAX: x = a; p = (p & 0x7D) | cpubatch_nz(x); break;
+    case I_TXA: a = x; p = (p & 0x7D) | cpubatch_nz(a); break;
+    case I_TAY: y = a; p = (p & 0x7D) | cpubatch_nz(y); break;
+    case I_TYA: a = y; p = (p & 0x7D) | cpubatch_nz(a); break;
+    case I_TSX: x = s; p = (p & 0x7D) | cpubatch_nz(x); break;
+    case I_TXS: s = x; break;
+    case I_PLA: a = cpubatch_pull(batch, &s, m); p = (p & 0x7D) | cpubatch_nz(a); break;
+    case I_PHA: cpubatch_push(batch, &s, a, m); break;
+    case I_PLP: p = (cpubatch_pull(batch, &s, m) | CPUSTAT_BREAK2) & (uint8_t)~CPUSTAT_BREAK; break;
+    case I_PHP: cpubatch_push(batch, &s, p | CPUSTAT_BREAK, m); break;
+    case I_JMP: next = val; break;
+    case I_JSR:
+    {
+      LaneU16 retAddr = pc + 2;
+      next = val;
+      cpubatch_push(batch, &s, cpubatch_narrow(retAddr >> 8), m);
+      cpubatch_push(batch, &s, cpubatch_narrow(retAddr), m);
+      break;
+    }
+    case I_RTS:
+    case I_RTI:
+    {
+      if (b->mnemonic == I_RTI) p = cpubatch_pull(batch, &s, m) | CPUSTAT_BREAK2;
+      LaneU16 lo = cpubatch_widen(cpubatch_pull(batch, &s, m));
+      LaneU16 hi = cpubatch_widen(cpubatch_pull(batch, &s, m));
+      next = ((hi << 8) | lo) + (uint16_t)((b->mnemonic == I_RTS) ? 1 : 0);
+      break;
+    }
+    case I_CLC: p &= (uint8_t)~CPUSTAT_CARRY; break;
+    case I_SEC: p |= CPUSTAT_CARRY; break;
+    case I_CLD: p &= (uint8_t)~CPUSTAT_DECIMAL; break;
+    case I_SED: p |= CPUSTAT_DECIMAL; break;
+    case I_CLI: p &= (uint8_t)~CPUSTAT_NO_INTRPT; break;
+    case I_SEI: p |= CPUSTAT_NO_INTRPT; break;
+    case I_CLV: p &= (uint8_t)~CPUSTAT_OVERFLOW; break;
+    case I_BRK: p |= CPUSTAT_BREAK | CPUSTAT_NO_INTRPT; break;
+    default: break; // NOP
+  }
+  if (branches) next = cpubatch_blend16(cpubatch_widenMask(branch), val, next);
+
+  batch->a = cpubatch_blend(m, a, batch->a);
+  batch->x = cpubatch_blend(m, x, batch->x);
+  batch->y = cpubatch_blend(m, y, batch->y);
+  batch->s = cpubatch_blend(m, s, batch->s);
+  batch->p = cpubatch_blend(m, p, batch->p);
+  batch->pc = cpubatch_blend16(cpubatch_widenMask(m), next, batch->pc);
+  return cycleCount;
+}
+
+/* DISPATCH */
+
+static bool cpubatch_sameState(CPUState* x, CPUState* y) {
+  return x->reg.a == y->reg.a && x->reg.x == y->reg.x && x->reg.y == y->reg.y
+    && x->reg.s == y->reg.s && x->reg.p == y->reg.p && x->reg.pc == y->reg.pc
+    && x->clockMode == y->clockMode;
+}
+
+/**
+ * @brief Replay a vector instruction on the scalar CPU for each lane and
+ *        keep the scalar result wherever the two disagree
+ */
+static void cpubatch_check(CPUBatch* batch, LaneU8 m, CPUState* before, uint8_t cycles) {
+  for (int lane = 0; lane < CPU_BATCH_LANES; lane++) {
+    if (!m[lane]) continue;
+    CPUState vector;
+    cpubatch_getLane(batch, lane, &vector);
+    for (int i = batch->writeCount[lane] - 1; i >= 0; i--) {
+      batch->memory[lane][batch->writes[lane][i].addr] = batch->writes[lane][i].before;
+    }
+
+    CPUState scalar;
+    cpubatch_putLane(batch, lane, &before[lane]);
+    uint8_t scalarCycles = cpubatch_stepScalar(batch, lane, &scalar);
+
+    bool same = cpubatch_sameState(&vector, &scalar)
+      && scalarCycles == cycles
+      && scalarWriteCount == batch->writeCount[lane];
+    for (int i = 0; same && i < scalarWriteCount; i++) {
+      same = scalarWrites[i].addr == batch->writes[lane][i].addr && scalarWrites[i].after == batch->writes[lane][i].after;
+    }
+    if (!same) {
+      batch->stats.mismatches += 1;
+      fprintf(stderr, "cpubatch: lane %d disagrees with the scalar CPU at PC:%04X op:%02X\n", lane, before[lane].reg.pc, batch->memory[lane][before[lane].reg.pc]);
+    }
+  }
+}
+
+bool cpubatch_step(CPUBatch* batch) {
+  // the lowest PC goes first, so lanes behind catch up at join points
+  int leader = -1;
+  LaneU8 running = ~batch->halted;
+  for (int i = 0; i < CPU_BATCH_LANES; i++) {
+    if (batch->budget[i] == 0) running[i] = 0;
+    if (running[i] && (leader < 0 || batch->pc[i] < batch->pc[leader])) leader = i;
+  }
+  if (leader < 0) return false;
+
+  uint16_t pc = batch->pc[leader];
+  Bytecode b = decodeTable[batch->memory[leader][pc]];
+  for (int i = 0; i < b.count; i++) {
+    b.data[i] = batch->memory[leader][(uint16_t)(pc + i)];
+  }
+
+  // lanes share the dispatch only if their code is the same too
+  LaneU8 m = running & cpubatch_narrow((LaneU16)(batch->pc == pc));
+  int laneCount = 0;
+  for (int lane = 0; lane < CPU_BATCH_LANES; lane++) {
+    for (int i = 0; m[lane] && i < b.count; i++) {
+      if (batch->memory[lane][(uint16_t)(pc + i)] != b.data[i]) m[lane] = 0;
+    }
+    if (m[lane]) {
+      laneCount += 1;
+      batch->budget[lane] -= 1;
+    }
+  }
+
+  batch->stats.issues += 1;
+  batch->stats.laneInstructions += laneCount;
+  bool official = (b.mnemonic != I_UNSET && b.mnemonic <= I_TYA);
+  if (laneCount > 1 && official) {
+    batch->stats.vectorIssues += 1;
+    CPUState before[CPU_BATCH_LANES];
+    if (batch->verify) {
+      for (int lane = 0; lane < CPU_BATCH_LANES; lane++) {
+        cpubatch_getLane(batch, lane, &before[lane]);
+        batch->writeCount[lane] = 0;
+      }
+    }
+    uint8_t cycles = cpubatch_execute(batch, &b, m);
+    for (int lane = 0; lane < CPU_BATCH_LANES; lane++) {
+      if (m[lane]) batch->cycles[lane] += cycles;
+    }
+    if (batch->verify) cpubatch_check(batch, m, before, cycles);
+  } else {
+    for (int lane = 0; lane < CPU_BATCH_LANES; lane++) {
+      CPUState state;
+      if (m[lane]) batch->cycles[lane] += cpubatch_stepScalar(batch, lane, &state);
+    }
+  }
+  return true;
+}
+
+void cpubatch_run(CPUBatch* batch, uint64_t instructions) {
+  for (int i = 0; i < CPU_BATCH_LANES; i++) {
+    batch->budget[i] = instructions;
+  }
+  while (cpubatch_step(batch));
+}
@@ -0,0 +1,139 @@
+/**
+ * @file cpubatch.h
+ * @author Noah Sadir (development.noahsadir@gmail.com)
+ * @brief Lockstep 6502 interpreter over SIMD lanes
+ * @version 1.0
+ * @date 2026-10-19
+ * 
+ * @copyright Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef CPUBATCH_H
+#define CPUBATCH_H
+
+#include "globalflags.h"
+#include "cpu6502.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Experimental: CPU_BATCH_LANES copies of the 6502 running the same
+ * program, with A/X/Y/S/P/PC held as vectors (GCC vector extensions, so
+ * the compiler picks SSE, AVX2 or AVX-512 from -march). Each lane has a
+ * flat 64 KiB memory image and no PPU, which suits brute-forcing CPU-side
+ * routines (RNG, physics, menus) over many inputs.
+ *
+ * Every issue picks the lowest PC among the running lanes and executes
+ * that instruction once for all lanes which share it, so lanes which
+ * split at a branch meet again at the join. A lane left on its own runs
+ * on the scalar interpreter instead.
+ */
+
+typedef uint8_t LaneU8 __attribute__((vector_size(CPU_BATCH_LANES)));
+typedef uint16_t LaneU16 __attribute__((vector_size(CPU_BATCH_LANES * 2)));
+
+typedef struct {
+  uint16_t addr;
+  uint8_t before;
+  uint8_t after;
+} CPUBatchWrite;
+
+typedef struct {
+  uint64_t issues;            // instructions dispatched (vector or scalar)
+  uint64_t vectorIssues;      // of which ran on more than one lane
+  uint64_t laneInstructions;  // instructions executed summed over lanes
+  uint64_t mismatches;        // lanes which disagreed with the scalar CPU
+} CPUBatchStats;
+
+typedef struct {
+  LaneU8 a;
+  LaneU8 x;
+  LaneU8 y;
+  LaneU8 s;
+  LaneU8 p;
+  LaneU16 pc;
+  LaneU8 halted;             // 0xFF once the lane hits an illegal opcode
+  uint8_t cpuerrno[CPU_BATCH_LANES];
+  uint8_t* memory[CPU_BATCH_LANES];
+  uint64_t cycles[CPU_BATCH_LANES];
+  uint64_t budget[CPU_BATCH_LANES]; // instructions left to run
+
+  bool verify;
+  CPUBatchWrite writes[CPU_BATCH_LANES][4];
+  uint8_t writeCount[CPU_BATCH_LANES];
+  CPUBatchStats stats;
+} CPUBatch;
+
+/**
+ * @brief Initialize a batch with every lane halted
+ *
+ * @param batch the batch
+ */
+void cpubatch_init(CPUBatch* batch);
+
+/**
+ * @brief Start a lane
+ *
+ * @param batch the batch
+ * @param lane the lane index
+ * @param regs the initial registers
+ * @param memory the lane's 64 KiB memory image (not copied)
+ */
+void cpubatch_setLane(CPUBatch* batch, int lane, CPURegisters* regs, uint8_t* memory);
+
+/**
+ * @brief Get the registers and status of a lane
+ *
+ * @param batch the batch
+ * @param lane the lane index
+ * @param state the state object to fill
+ */
+void cpubatch_getLane(CPUBatch* batch, int lane, CPUState* state);
+
+/**
+ * @brief Re-execute every vector instruction on the scalar CPU and count
+ *        (and print) lanes which end up with different registers or writes
+ *
+ * @param batch the batch
+ * @param enabled whether to verify
+ */
+void cpubatch_setVerify(CPUBatch* batch, bool enabled);
+
+/**
+ * @brief Dispatch one instruction
+ *
+ * @param batch the batch
+ * @return false if no lane is left to run
+ */
+bool cpubatch_step(CPUBatch* batch);
+
+/**
+ * @brief Run every lane for a number of instructions (or until it halts)
+ *
+ * @param batch the batch
+ * @param instructions the instructions per lane
+ */
+void cpubatch_run(CPUBatch* batch, uint64_t instructions);
+
+#endif
@@ -0,0 +1,367 @@
+/**
+ * @file debugger.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "debugger.h"
+
+machine_local void(*saveMachine)(void*);
+machine_local void(*loadMachine)(void*);
+machine_local void(*setMachineInputs)(uint8_t*);
+machine_local bool(*stepMachine)(bool);
+machine_local uint8_t(*readMachine)(uint16_t);
+
+machine_local uint32_t machineStateSize = 0;
+machine_local uint8_t* machineState = NULL;
+machine_local uint8_t* compressedState = NULL;
+machine_local uint32_t compressedCapacity = 0;
+
+// every recorded frame, and a keyframe every DEBUGGER_KEYFRAME_INTERVAL frames,
+// in rings holding the last DEBUGGER_KEYFRAME_COUNT keyframes' worth.
+// Frames and keyframes are numbered from the start of history, and those
+// before firstKeyframe have been dropped.
+machine_local DebuggerFrame* frameLog = NULL;
+machine_local uint32_t frameLogCount = 0;
+machine_local DebuggerKeyframe* keyframes = NULL;
+machine_local uint32_t keyframeCount = 0;
+machine_local uint32_t firstKeyframe = 0;
+
+// end of recorded history, and where the machine is now
+machine_local uint64_t headInstruction = 0;
+machine_local uint64_t machineInstruction = 0;
+machine_local uint32_t machineFrame = 0;
+machine_local bool machineFrameEnded = true;
+
+machine_local bool replaying = false;
+machine_local bool watching = false;
+machine_local uint16_t watchAddr = 0;
+machine_local bool watchHit = false;
+machine_local uint64_t watchIndex = 0;
+
+/* PRIVATE METHODS - NOT INTENDED FOR EXTERNAL USE */
+
+/**
+ * @brief Map mirrored addresses onto the same address
+ * 
+ * @param addr the address
+ * @return uint16_t the canonical address
+ */
+static force_inline uint16_t debugger_canonicalAddress(uint16_t addr);
+
+void debugger_init(uint32_t stateSize, void(*save)(void*), void(*load)(void*), void(*setInputs)(uint8_t*), bool(*step)(bool), uint8_t(*read)(uint16_t)) {
+  saveMachine = save;
+  loadMachine = load;
+  setMachineInputs = setInputs;
+  stepMachine = step;
+  readMachine = read;
+  machineStateSize = stateSize;
+  machineState = malloc(stateSize);
+  compressedCapacity = lz_maxCompressedSize(stateSize);
+  compressedState = malloc(compressedCapacity);
+  frameLog = malloc(sizeof(DebuggerFrame) * DEBUGGER_KEYFRAME_COUNT * DEBUGGER_KEYFRAME_INTERVAL);
+  keyframes = calloc(DEBUGGER_KEYFRAME_COUNT, sizeof(DebuggerKeyframe));
+  debugger_reset();
+}
+
+/**
+ * @brief Find a recorded frame in its ring
+ */
+static DebuggerFrame* debugger_frame(uint32_t frame) {
+  return &frameLog[frame % (DEBUGGER_KEYFRAME_COUNT * DEBUGGER_KEYFRAME_INTERVAL)];
+}
+
+/**
+ * @brief Find a keyframe in its ring
+ */
+static DebuggerKeyframe* debugger_keyframe(uint32_t keyframe) {
+  return &keyframes[keyframe % DEBUGGER_KEYFRAME_COUNT];
+}
+
+void debugger_beginFrame(uint8_t* inputs) {
+  if (frameLogCount % DEBUGGER_KEYFRAME_INTERVAL == 0 && keyframeCount - firstKeyframe == DEBUGGER_KEYFRAME_COUNT) {
+    // make room by forgetting the oldest keyframe, and so its frames
+    free(debugger_keyframe(firstKeyframe)->data);
+    firstKeyframe += 1;
+  }
+  DebuggerFrame* frame = debugger_frame(frameLogCount);
+  frame->firstInstruction = headInstruction;
+  frame->inputs[0] = inputs[0];
+  frame->inputs[1] = inputs[1];
+
+  if (frameLogCount % DEBUGGER_KEYFRAME_INTERVAL == 0) {
+    // most of the machine is unchanged or zero, so keyframes compress well
+    DebuggerKeyframe* keyframe = debugger_keyframe(keyframeCount++);
+    saveMachine(machineState);
+    keyframe->size = lz_compress(machineState, machineStateSize, compressedState, compressedCapacity);
+    keyframe->data = malloc(keyframe->size);
+    memcpy(keyframe->data, compressedState, keyframe->size);
+    memset(keyframe->writtenPages, 0, sizeof(keyframe->writtenPages));
+  }
+
+  frameLogCount += 1;
+  machineFrame = frameLogCount - 1;
+  machineInstruction = headInstruction;
+  machineFrameEnded = false;
+}
+
+void debugger_endFrame(uint32_t instructionCount) {
+  headInstruction += instructionCount;
+  machineInstruction = headInstruction;
+  machineFrameEnded = true;
+}
+
+void debugger_noteWrite(uint16_t addr) {
+  addr = debugger_canonicalAddress(addr);
+  if (replaying) {
+    if (watching && addr == watchAddr) {
+      watchHit = true;
+      watchIndex = machineInstruction;
+    }
+    return;
+  }
+  if (keyframeCount > firstKeyframe) {
+    debugger_keyframe(keyframeCount - 1)->writtenPages[addr >> 11] |= 1 << ((addr >> 8) & 7);
+  }
+}
+
+void debugger_reset() {
+  for (uint32_t i = firstKeyframe; i < keyframeCount; i++) {
+    free(debugger_keyframe(i)->data);
+  }
+  keyframeCount = 0;
+  firstKeyframe = 0;
+  frameLogCount = 0;
+  headInstruction = 0;
+  machineInstruction = 0;
+  machineFrame = 0;
+  machineFrameEnded = true;
+}
+
+/**
+ * @brief Drop recorded frames (and their keyframes) past a frame count
+ */
+static void debugger_truncate(uint32_t frameCount) {
+  uint32_t keep = (frameCount + DEBUGGER_KEYFRAME_INTERVAL - 1) / DEBUGGER_KEYFRAME_INTERVAL;
+  for (uint32_t i = keep; i < keyframeCount; i++) {
+    free(debugger_keyframe(i)->data);
+  }
+  if (keep < keyframeCount) keyframeCount = keep;
+  frameLogCount = frameCount;
+}
+
+/**
+ * @brief Restore a specific keyframe and re-execute up to an instruction
+ */
+static void debugger_replayFrom(uint32_t keyframe, uint64_t index) {
+  lz_decompress(debugger_keyframe(keyframe)->data, debugger_keyframe(keyframe)->size, machineState, machineStateSize);
+  loadMachine(machineState);
+  machineFrame = keyframe * DEBUGGER_KEYFRAME_INTERVAL;
+  machineInstruction = debugger_frame(machineFrame)->firstInstruction;
+  machineFrameEnded = false;
+  setMachineInputs(debugger_frame(machineFrame)->inputs);
+
+  replaying = true;
+  while (machineInstruction < index) {
+    bool frameDone = stepMachine(false);
+    machineInstruction += 1;
+    if (frameDone) {
+      if (machineFrame + 1 < frameLogCount) {
+        machineFrame += 1;
+        setMachineInputs(debugger_frame(machineFrame)->inputs);
+      } else {
+        machineFrameEnded = true;
+      }
+    }
+  }
+  replaying = false;
+}
+
+void debugger_replay(uint64_t index) {
+  // find the last frame starting at or before the index
+  uint32_t low = firstKeyframe * DEBUGGER_KEYFRAME_INTERVAL;
+  uint32_t high = frameLogCount - 1;
+  while (low < high) {
+    uint32_t mid = (low + high + 1) / 2;
+    if (debugger_frame(mid)->firstInstruction <= index) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+  debugger_replayFrom(low / DEBUGGER_KEYFRAME_INTERVAL, index);
+}
+
+bool debugger_seek(uint64_t index) {
+  if (index == machineInstruction) return true;
+  if (index > headInstruction || keyframeCount == firstKeyframe) return false;
+  // older history has been dropped
+  if (index < debugger_frame(firstKeyframe * DEBUGGER_KEYFRAME_INTERVAL)->firstInstruction) return false;
+  debugger_replay(index);
+  return true;
+}
+
+bool debugger_findLastWrite(uint16_t addr, uint64_t* index) {
+  uint64_t before = machineInstruction;
+  if (before == 0 || keyframeCount == firstKeyframe) return false;
+
+  addr = debugger_canonicalAddress(addr);
+  watching = true;
+  watchAddr = addr;
+  watchHit = false;
+
+  // search backwards one keyframe interval at a time, skipping any
+  // interval which never wrote to the page
+  bool found = false;
+  uint32_t searchFrame = (machineFrameEnded || machineInstruction > debugger_frame(machineFrame)->firstInstruction) ? machineFrame : machineFrame - 1;
+  for (int64_t k = searchFrame / DEBUGGER_KEYFRAME_INTERVAL; k >= firstKeyframe && !found; k--) {
+    if (!(debugger_keyframe(k)->writtenPages[addr >> 11] & (1 << ((addr >> 8) & 7)))) continue;
+    uint32_t nextKeyframeFrame = (k + 1) * DEBUGGER_KEYFRAME_INTERVAL;
+    uint64_t end = (nextKeyframeFrame < frameLogCount) ? debugger_frame(nextKeyframeFrame)->firstInstruction : headInstruction;
+    if (end > before) end = before;
+    debugger_replayFrom(k, end);
+    found = watchHit;
+  }
+  watching = false;
+
+  if (found) {
+    *index = watchIndex;
+  } else {
+    debugger_replay(before); // put the machine back
+  }
+  return found;
+}
+
+uint64_t debugger_getInstructionIndex() {
+  return machineInstruction;
+}
+
+/**
+ * @brief Execute one instruction past the end of history, recording it
+ */
+static void debugger_stepLive() {
+  if (machineFrameEnded) {
+    // the user can't press anything while paused, so hold the last input
+    uint8_t inputs[2] = {0, 0};
+    if (frameLogCount > firstKeyframe * DEBUGGER_KEYFRAME_INTERVAL) memcpy(inputs, debugger_frame(frameLogCount - 1)->inputs, 2);
+    setMachineInputs(inputs);
+    debugger_beginFrame(inputs);
+  }
+  bool frameDone = stepMachine(true);
+  headInstruction += 1;
+  machineInstruction = headInstruction;
+  machineFrameEnded = frameDone;
+}
+
+void debugger_resume() {
+  if (machineInstruction == headInstruction && machineFrameEnded) return;
+
+  if (!machineFrameEnded && machineInstruction == debugger_frame(machineFrame)->firstInstruction) {
+    // at the very start of a frame, which is the end of the one before
+    debugger_truncate(machineFrame);
+    headInstruction = machineInstruction;
+    machineFrameEnded = true;
+    return;
+  }
+
+  // drop the future and finish this frame live
+  debugger_truncate(machineFrame + 1);
+  headInstruction = machineInstruction;
+  while (!machineFrameEnded && cpu6502_getClockMode() != CPUCLOCK_HALT) {
+    debugger_stepLive();
+  }
+}
+
+void debugger_printStatus() {
+  CPUState cpu;
+  cpu6502_saveState(&cpu);
+  printf("#%llu (frame %u)  PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X  op:%02X\n",
+    (unsigned long long)machineInstruction, machineFrame, cpu.reg.pc, cpu.reg.a, cpu.reg.x,
+    cpu.reg.y, cpu.reg.p, cpu.reg.s, readMachine(cpu.reg.pc));
+}
+
+void debugger_prompt() {
+  char line[64];
+  printf("** DEBUGGER ** s [n] step, b [n] step back, w ADDR back to last write, g N go to, m ADDR peek, c continue\n");
+  debugger_printStatus();
+
+  while (printf("> "), fflush(stdout), fgets(line, sizeof(line), stdin) != NULL) {
+    char cmd = '\0';
+    char argStr[32] = "";
+    sscanf(line, " %c %31s", &cmd, argStr);
+    unsigned long long arg = strtoull(argStr, NULL, (cmd == 'w' || cmd == 'm') ? 16 : 10);
+    if ((cmd == 's' || cmd == 'b') && argStr[0] == '\0') arg = 1;
+
+    struct timeval t1, t2;
+    gettimeofday(&t1, NULL);
+    if (cmd == 'c') {
+      break;
+    } else if (cmd == 's') {
+      uint64_t target = machineInstruction + arg;
+      if (target <= headInstruction) {
+        debugger_seek(target);
+      } else {
+        debugger_seek(headInstruction);
+        while (machineInstruction < target && cpu6502_getClockMode() != CPUCLOCK_HALT) {
+          debugger_stepLive();
+        }
+      }
+    } else if (cmd == 'b') {
+      if (arg > machineInstruction || !debugger_seek(machineInstruction - arg)) {
+        printf("Not recorded\n");
+        continue;
+      }
+    } else if (cmd == 'g') {
+      if (!debugger_seek(arg)) {
+        printf("Not recorded\n");
+        continue;
+      }
+    } else if (cmd == 'w') {
+      uint64_t index;
+      if (!debugger_findLastWrite(arg, &index)) {
+        printf("No recorded write to %04llX\n", arg);
+        continue;
+      }
+      debugger_seek(index + 1); // stop just after the write
+    } else if (cmd == 'm') {
+      // other addresses have side effects when read
+      if (arg < 0x2000 || (arg >= 0x6000 && arg <= 0xFFFF)) {
+        printf("%04llX: %02X\n", arg, readMachine(arg));
+      } else {
+        printf("Can't peek %04llX\n", arg);
+      }
+      continue;
+    } else {
+      continue;
+    }
+    gettimeofday(&t2, NULL);
+    debugger_printStatus();
+    printf("(%.2f ms)\n", ((t2.tv_sec - t1.tv_sec) * 1000.0) + ((t2.tv_usec - t1.tv_usec) / 1000.0));
+  }
+
+  debugger_resume();
+}
+
+static force_inline uint16_t debugger_canonicalAddress(uint16_t addr) {
+  if (addr <= 0x1FFF) return addr & 0x07FF;
+  if (addr <= 0x3FFF) return 0x2000 | (addr & 0x0007);
+  return addr;
+}
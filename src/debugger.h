@@ -0,0 +1,161 @@
+/**
+ * @file debugger.h
+ * @author Noah Sadir (development.noahsadir@gmail.com)
+ * @brief Time-travel debugger
+ * @version 1.0
+ * @date 2026-10-19
+ * 
+ * @copyright Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include "globalflags.h"
+#include "cpu6502.h"
+#include "lz.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/**
+ * @brief Number of frames between keyframes. Seeking re-executes at most
+ *        this many frames (~0.5 sec of game time).
+ */
+#define DEBUGGER_KEYFRAME_INTERVAL 30
+
+/**
+ * @brief Number of keyframes kept. Once full, the oldest keyframe and its
+ *        frames are dropped (so ~10 min of history).
+ */
+#define DEBUGGER_KEYFRAME_COUNT 1200
+
+/**
+ * @brief Number of 256-byte pages in the CPU address space
+ */
+#define DEBUGGER_PAGE_COUNT 256
+
+typedef struct {
+  uint64_t firstInstruction;
+  uint8_t inputs[2];
+} DebuggerFrame;
+
+typedef struct {
+  uint8_t* data;
+  uint32_t size;
+  uint8_t writtenPages[DEBUGGER_PAGE_COUNT / 8];
+} DebuggerKeyframe;
+
+/**
+ * @brief Initialize the debugger
+ * 
+ * @param stateSize the size of a machine snapshot (in bytes)
+ * @param save the callback which takes a machine snapshot
+ * @param load the callback which restores a machine snapshot
+ * @param setInputs the callback which sets both controller ports
+ * @param step the callback which executes one instruction (optionally
+ *             without rendering) and returns true if it completed a frame
+ * @param read the callback which reads the CPU address space
+ */
+void debugger_init(uint32_t stateSize, void(*save)(void*), void(*load)(void*), void(*setInputs)(uint8_t*), bool(*step)(bool), uint8_t(*read)(uint16_t));
+
+/**
+ * @brief Record the start of a frame, taking a keyframe if one is due
+ * 
+ * @param inputs the controller inputs of the frame (one per port)
+ */
+void debugger_beginFrame(uint8_t* inputs);
+
+/**
+ * @brief Record the end of a frame
+ * 
+ * @param instructionCount the number of instructions the frame executed
+ */
+void debugger_endFrame(uint32_t instructionCount);
+
+/**
+ * @brief Note a CPU write (for "run back to last write")
+ * 
+ * @param addr the address written to
+ */
+void debugger_noteWrite(uint16_t addr);
+
+/**
+ * @brief Discard all history (e.g. after the machine is replaced by a
+ *        save state)
+ */
+void debugger_reset();
+
+/**
+ * @brief Break into the interactive debugger on the terminal.
+ *        Returns once the user continues, at the start of a frame.
+ */
+void debugger_prompt();
+
+/**
+ * @brief Move the machine to the point just before an instruction executed
+ *        by re-executing from the nearest keyframe
+ * 
+ * @param index the instruction index (0 = first recorded instruction)
+ * @return true if the index is within the recorded history
+ */
+bool debugger_seek(uint64_t index);
+
+/**
+ * @brief Find the last instruction before the current one which wrote
+ *        to an address
+ * 
+ * @param addr the address (mirrors are treated as the same address)
+ * @param index the output instruction index
+ * @return true if a write was found
+ */
+bool debugger_findLastWrite(uint16_t addr, uint64_t* index);
+
+/**
+ * @brief Get the index of the next instruction to be executed
+ * 
+ * @return uint64_t the instruction index
+ */
+uint64_t debugger_getInstructionIndex();
+
+/**
+ * @brief Discard history after the current instruction and finish the
+ *        current frame, so recording can continue from here
+ */
+void debugger_resume();
+
+/**
+ * @brief Restore a keyframe and re-execute up to an instruction,
+ *        watching for writes along the way
+ * 
+ * @param index the instruction index to stop at
+ */
+void debugger_replay(uint64_t index);
+
+/**
+ * @brief Print the registers and next instruction
+ */
+void debugger_printStatus();
+
+#endif
@@ -34,6 +34,9 @@
 
 #define force_inline __attribute__((always_inline)) inline
 
+// emulated machine state is per-thread, so each thread can run its own machine
+#define machine_local _Thread_local
+
 /**
  * @brief Platform value
  *
@@ -50,7 +53,7 @@
 #define VERBOSE_EXC FALSE
 
 /**
- * @brief Generate CPU trace.
+ * @brief Generate CPU trace by default (--trace at runtime).
  */
 #define LOGGING FALSE
 
@@ -60,7 +63,14 @@
 #define PERFORMANCE_DEBUG TRUE
 
 /**
- * @brief Run in headless mode (PPU will not render)
+ * @brief Record keyframes & input so the debugger (F2) can step backwards.
+ *        Costs a hook on every CPU write and a snapshot every 30 frames.
+ */
+#define TIME_TRAVEL_DEBUG FALSE
+
+/**
+ * @brief Run in headless mode (PPU will not render) by default
+ *        (--ppu none at runtime)
  */
 #define HEADLESS FALSE
 
@@ -72,7 +82,8 @@
 #define MIN_DRAW_INTERVAL 8333
 
 /**
- * @brief Limit clock speed to original NES (1.789773 MHz)
+ * @brief Limit clock speed to original NES (1.789773 MHz) by default
+ *        (--sync at runtime)
  */
 #define LIMIT_CLOCK_SPEED TRUE
 
@@ -86,11 +97,13 @@
  *        Otherwise, if faslse, catch up every frame
  *        NOTE: This also affects PPU-will operate at scanline-level granularity
  *              if enabled, or just frame-level granularity if not
+ *        This is the default; --ppu chooses at runtime.
  */
 #define PPU_IMMEDIATE_CATCHUP FALSE
 
 /**
- * @brief Determine how the CPU should handle programs
+ * @brief Determine how the CPU should handle programs by default
+ *        (--cpu at runtime)
  *        CPUEMU_INTERPRET_DIRECT - Decode instruction every time 
  *                                  it is encountered.
  *        CPUEMU_INTERPRET_CACHED - Store encountered instructions as
@@ -99,6 +112,37 @@
  */
 #define EMU_MODE CPUEMU_INTERPRET_CACHED
 
+/**
+ * @brief Default CPU timing (--timing at runtime)
+ *        CPUTIMING_FAST     - Fixed cycles per addressing mode.
+ *        CPUTIMING_ACCURATE - Exact cycles per opcode, with page-cross and
+ *                             branch penalties, and each instruction's
+ *                             bus access placed on its final cycle.
+ *        CPUTIMING_AUTO     - Accurate for ROMs which poll for sprite zero
+ *                             hits (raster effects), fast otherwise.
+ */
+#define CPU_TIMING CPUTIMING_AUTO
+
+/**
+ * @brief Look up scanline colors with SSSE3/AVX2 byte shuffles when the
+ *        host CPU supports them (checked at startup). The scalar loop is
+ *        used otherwise, or everywhere if this is FALSE.
+ */
+#define PPU_SIMD TRUE
+
+/**
+ * @brief Number of 1 KB CHR banks kept decoded (at least 8, one for each
+ *        window of the pattern tables). Banks beyond this are evicted
+ *        least recently used first, and decoded again when next shown.
+ */
+#define PPU_CHR_CACHE_BANKS 16
+
+/**
+ * @brief Number of CPUs in one cpubatch vector (8 fills AVX2 registers,
+ *        16 or 32 suit AVX-512). Must be a power of two.
+ */
+#define CPU_BATCH_LANES 8
+
 // magic numbers
 
 #define DISPLAY_WIDTH 256
@@ -150,6 +194,7 @@ typedef enum { false = 0, true = 1} bool;
 typedef struct {
   uint8_t* data;
   uint32_t bytes;
+  char* path;
 } FileBinary;
 
 typedef enum {
@@ -159,6 +204,24 @@ typedef enum {
   CPUEMU_DISASSEMBLE,
 } CPUEmulationMode;
 
+typedef enum {
+  CPUTIMING_FAST,
+  CPUTIMING_ACCURATE,
+  CPUTIMING_AUTO
+} CPUTiming;
+
+typedef enum {
+  PPURENDER_FRAME,     // catch up and draw once per frame
+  PPURENDER_SCANLINE,  // catch up after every instruction, draw by scanline
+  PPURENDER_NONE,      // no PPU; frames are counted in CPU cycles
+  PPURENDER_DOT        // catch up after every instruction, draw by dot
+} PPURenderMode;
+
+typedef enum {
+  PPUFORMAT_XRGB8888,  // 0x00RRGGBB
+  PPUFORMAT_XBGR8888   // 0x00BBGGRR (R, G, B, X in memory)
+} PPUPixelFormat;
+
 typedef enum {
   CPUCLOCK_SUSPENDED,
   CPUCLOCK_STEP_MANUAL,
@@ -293,6 +356,9 @@ typedef struct {
   Bytecode* bytecodes;
   uint16_t addrMap[65536];
   uint16_t bytecodeCount;
+  uint16_t cachedCount;   // bytecodes already in the code cache file
+  void* mapping;          // the code cache file, while bytecodes points into it
+  uint32_t mappingSize;
 } BytecodeProgram;
 
 typedef struct {
@@ -304,6 +370,24 @@ typedef struct {
   uint8_t p;
 } CPURegisters;
 
+typedef struct {
+  uint8_t control;
+  uint8_t mask;
+  uint8_t ppuStatus;
+  uint8_t oamaddr;
+  uint8_t oamdata;
+  uint8_t scroll;
+  uint8_t ppuaddr;
+  uint8_t ppudata;
+  uint8_t oamdma;
+} PPURegisters;
+
+typedef struct {
+  CPURegisters reg;
+  CPUClockMode clockMode;
+  uint8_t cpuerrno;
+} CPUState;
+
 static const uint32_t colors[64] =
 {
 0x757575, 0x271B8F, 0x0000AB, 0x47009F, 0x8F0077, 0xAB0013, 0xA70000, 0x7F0B00,
@@ -334,11 +418,10 @@ static const uint32_t colors2[64] = {
 };
 
 
-extern uint32_t bitmap[DISPLAY_BITMAP_SIZE];
-extern uint8_t oamRAM[0x00FF];
-extern uint8_t vidRAM[0x2000];
-extern uint8_t paletteRAM[32];
-extern uint8_t chrCache[512][64];
+extern machine_local uint8_t bitmap[DISPLAY_BITMAP_SIZE];
+extern machine_local uint8_t oamRAM[0x0100];
+extern machine_local uint8_t vidRAM[0x2000];
+extern machine_local uint8_t paletteRAM[32];
 extern uint32_t debugbmp[DISPLAY_PIXEL_SIZE];
 
 #endif
@@ -30,12 +30,17 @@ SDL_Surface* surface;
 
 struct JoypadMapping keyMap;
 
+struct HotkeyMapping hotkeyMap;
+
 uint16_t width = 256;
 uint16_t height = 240;
 uint16_t scale = 1;
 
 uint32_t panicbmp[DISPLAY_BITMAP_SIZE];
 
+// the PPU's bitmap, converted to colors when the display is updated
+uint32_t screen[DISPLAY_BITMAP_SIZE];
+
 bool didPanic = false;
 
 int counter = 0;
@@ -61,6 +66,11 @@ void io_init(uint16_t scl) {
   keyMap.b = SDLK_RSHIFT;
   keyMap.start = SDLK_RETURN;
   keyMap.select = SDLK_p;
+
+  hotkeyMap.saveState = SDLK_F5;
+  hotkeyMap.nextSlot = SDLK_F6;
+  hotkeyMap.loadState = SDLK_F9;
+  hotkeyMap.debugBreak = SDLK_F2;
 }
 
 void io_pollJoypad(void(*toggle)(NESInput, bool)) {
@@ -92,6 +102,18 @@ void io_pollJoypad(void(*toggle)(NESInput, bool)) {
       if (event.key.keysym.sym == keyMap.start) {
         toggle(INPUT_START, true);
       }
+      if (event.key.keysym.sym == hotkeyMap.saveState) {
+        toggle(INPUT_SAVE_STATE, true);
+      }
+      if (event.key.keysym.sym == hotkeyMap.loadState) {
+        toggle(INPUT_LOAD_STATE, true);
+      }
+      if (event.key.keysym.sym == hotkeyMap.nextSlot) {
+        toggle(INPUT_NEXT_SLOT, true);
+      }
+      if (event.key.keysym.sym == hotkeyMap.debugBreak) {
+        toggle(INPUT_DEBUG_BREAK, true);
+      }
     }
 
     if (event.type == SDL_KEYUP) {
@@ -177,7 +199,7 @@ void io_printChar(char chr, uint16_t x, uint8_t y) {
           panicbmp[pos] = ((charPix >> shift) & 1) ? 0xFFFFFF : colors[0x0F];
         }
       } else {
-        bitmap[pos] = ((charPix >> shift) & 1) ? 0xFFFFFF : 0x000000;
+        bitmap[pos] = ((charPix >> shift) & 1) ? 0x30 : 0x0F; // white on black
       }
       shift -= 1;
       pos += 1;
@@ -196,10 +218,12 @@ void io_drawDebugNametable() {
       int ntRow = (i - (ntID * 0x400)) / 32;
       int ntCol = (i - (ntID * 0x400)) % 32;
       if ((i - (ntID * 0x400)) < 960) {
-        for (int k = 0; k < 64; k++) {
-          int tileCol = 8 - (k % 8);
-          int tileRow = k / 8;
-          debugbmp[(ntRow * 512 * 8) + (ntCol * 8) + (tileRow * 512) + tileCol + ((ntID % 2) * 256) + ((ntID > 1) * (DISPLAY_BITMAP_SIZE * 2))] = colors[(chrCache[vidRAM[i] + (256 * DBG_BKG_BANK)][k] * 3) + 15];
+        for (int tileRow = 0; tileRow < 8; tileRow++) {
+          uint8_t pixels[8];
+          memcpy(pixels, &ppu_getTileRows(vidRAM[i] + (256 * DBG_BKG_BANK))[tileRow], 8);
+          for (int tileCol = 0; tileCol < 8; tileCol++) {
+            debugbmp[(ntRow * 512 * 8) + (ntCol * 8) + (tileRow * 512) + tileCol + ((ntID % 2) * 256) + ((ntID > 1) * (DISPLAY_BITMAP_SIZE * 2))] = colors[(pixels[tileCol] * 3) + 15];
+          }
         }
       }
     }
@@ -226,6 +250,7 @@ void io_update(char* overlay) {
     }
     // update display
     SDL_FreeSurface(surface);
+    if (!didPanic) ppu_convertBitmap(screen, bitmap, ppu_getEmphasis(), PPUFORMAT_XRGB8888);
     uint32_t* pixels = (uint32_t*)surface->pixels;
     SDL_LockSurface(surface);
     for (int i = 0; i < (256 * (1 + PERFORMANCE_DEBUG)) * 240; i++) {
@@ -236,7 +261,7 @@ void io_update(char* overlay) {
         int px = subpix % scale;
         int py = subpix / scale;
         if (x < 256) {
-          pixels[(x * scale) + (y * scaleSquared * (width * (1 + PERFORMANCE_DEBUG))) + px + (py * (width * (1 + PERFORMANCE_DEBUG)) * scale)] = didPanic ? panicbmp[(y * 256) + x] : bitmap[(y * 256) + x];
+          pixels[(x * scale) + (y * scaleSquared * (width * (1 + PERFORMANCE_DEBUG))) + px + (py * (width * (1 + PERFORMANCE_DEBUG)) * scale)] = didPanic ? panicbmp[(y * 256) + x] : screen[(y * 256) + x];
         }
       }
     }
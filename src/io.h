@@ -30,6 +30,7 @@
 #define IO_H
 
 #include "globalflags.h"
+#include "ppu.h"
 #include "font.h"
 
 #include <SDL2/SDL.h>
@@ -48,6 +49,13 @@ struct JoypadMapping {
     SDL_KeyCode start;
 };
 
+struct HotkeyMapping {
+    SDL_KeyCode saveState;
+    SDL_KeyCode loadState;
+    SDL_KeyCode nextSlot;
+    SDL_KeyCode debugBreak;
+};
+
 typedef enum {
   INPUT_UP      = 0x0,
   INPUT_DOWN    = 0x1,
@@ -57,7 +65,11 @@ typedef enum {
   INPUT_B       = 0x5,
   INPUT_SELECT  = 0x6,
   INPUT_START   = 0x7,
-  INPUT_QUIT    = 0x8
+  INPUT_QUIT    = 0x8,
+  INPUT_SAVE_STATE  = 0x9,
+  INPUT_LOAD_STATE  = 0xA,
+  INPUT_NEXT_SLOT   = 0xB,
+  INPUT_DEBUG_BREAK = 0xC
 } NESInput;
 
 /**
@@ -23,30 +23,46 @@
  */
 
 #include "joypad.h"
+#include "machine.h"
 
-uint8_t buttonStatus = 0;
-uint8_t buttonIndex = 0;
-bool strobe = false;
 
-bool joypad_read() {
-  if (buttonIndex > 7) {
-    buttonIndex = 0;
+bool joypad_read(uint8_t port) {
+  if (hot.buttonIndex[port] > 7) {
+    hot.buttonIndex[port] = 0;
   }
-  bool result = (buttonStatus >> buttonIndex) & 1;
-  if (!strobe) buttonIndex += 1;
+  bool result = (hot.buttonStatus[port] >> hot.buttonIndex[port]) & 1;
+  if (!hot.strobe) hot.buttonIndex[port] += 1;
   return result;
 }
 
 void joypad_write(uint8_t val) {
-  strobe = val & 1;
-  if (strobe) buttonIndex = 0;
+  hot.strobe = val & 1;
+  if (hot.strobe) {
+    hot.buttonIndex[0] = 0;
+    hot.buttonIndex[1] = 0;
+  }
+}
+
+void joypad_setButton(uint8_t port, JoypadButton button) {
+  hot.buttonStatus[port] = hot.buttonStatus[port] | ((uint8_t) button);
 }
 
-void joypad_setButton(JoypadButton button) {
-  buttonStatus = buttonStatus | ((uint8_t) button);
+void joypad_unsetButton(uint8_t port, JoypadButton button) {
+  hot.buttonStatus[port] = hot.buttonStatus[port] & ~((uint8_t) button);
 }
 
-void joypad_unsetButton(JoypadButton button) {
-  buttonStatus = buttonStatus & ~((uint8_t) button);
+void joypad_setButtons(uint8_t port, uint8_t buttons) {
+  hot.buttonStatus[port] = buttons;
 }
 
+void joypad_saveState(JoypadState* state) {
+  memcpy(state->buttonStatus, hot.buttonStatus, sizeof(hot.buttonStatus));
+  memcpy(state->buttonIndex, hot.buttonIndex, sizeof(hot.buttonIndex));
+  state->strobe = hot.strobe;
+}
+
+void joypad_loadState(JoypadState* state) {
+  memcpy(hot.buttonStatus, state->buttonStatus, sizeof(hot.buttonStatus));
+  memcpy(hot.buttonIndex, state->buttonIndex, sizeof(hot.buttonIndex));
+  hot.strobe = state->strobe;
+}
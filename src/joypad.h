@@ -31,6 +31,7 @@
 
 #include "globalflags.h"
 #include <stdint.h>
+#include <string.h>
 
 typedef enum {
     JP_RIGHT   = 0x80,
@@ -44,15 +45,27 @@ typedef enum {
     JP_NULL    = 0x00
 } JoypadButton;
 
+/**
+ * @brief Number of controller ports ($4016 and $4017)
+ */
+#define JOYPAD_PORT_COUNT 2
+
+typedef struct {
+  uint8_t buttonStatus[JOYPAD_PORT_COUNT];
+  uint8_t buttonIndex[JOYPAD_PORT_COUNT];
+  uint8_t strobe;
+} JoypadState;
+
 /**
  * @brief Read button value from joypad
  * 
+ * @param port the controller port (0 or 1)
  * @return true if button is set, false if unset
  */
-bool joypad_read();
+bool joypad_read(uint8_t port);
 
 /**
- * @brief Set the value of the strobe flag
+ * @brief Set the value of the strobe flag (shared by both ports)
  * 
  * @param val the value of the strobe flag (0 = off, 1+ = on)
  */
@@ -61,15 +74,39 @@ void joypad_write(uint8_t val);
 /**
  * @brief Set a button on the joypad
  * 
+ * @param port the controller port (0 or 1)
  * @param button the button to set
  */
-void joypad_setButton(JoypadButton button);
+void joypad_setButton(uint8_t port, JoypadButton button);
 
 /**
  * @brief Unset a button on the joypad
  * 
+ * @param port the controller port (0 or 1)
  * @param button the button to unset
  */
-void joypad_unsetButton(JoypadButton button);
+void joypad_unsetButton(uint8_t port, JoypadButton button);
+
+/**
+ * @brief Replace the state of every button on the joypad
+ * 
+ * @param port the controller port (0 or 1)
+ * @param buttons the JoypadButton flags which are held
+ */
+void joypad_setButtons(uint8_t port, uint8_t buttons);
+
+/**
+ * @brief Copy the shift register state of the joypad
+ * 
+ * @param state the pointer to the state object to fill
+ */
+void joypad_saveState(JoypadState* state);
+
+/**
+ * @brief Restore the shift register state of the joypad
+ * 
+ * @param state the pointer to the state object to restore from
+ */
+void joypad_loadState(JoypadState* state);
 
 #endif
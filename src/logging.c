@@ -24,9 +24,8 @@
 
 #include "logging.h"
 
-#if (LOGGING)
-FILE* fp;
-FILE* asmfp;
+FILE* fp = NULL;
+FILE* asmfp = NULL;
 
 const char* mnemonicStr[80] = {
   "??? ", "ADC ", "AND ", "ASL ", "BCC ",
@@ -53,23 +52,24 @@ const char* hexStr[16] = {
 };
 
 void logging_init() {
+  logging_kill(); // start over if already open
   fp = fopen("./debug/output.log", "w");
-  fp = fopen("./debug/output.log", "a");
   asmfp = fopen("./debug/rom.asm", "w");
-  asmfp = fopen("./debug/rom.asm", "a");
 }
 
 void logging_kill() {
-  fclose(fp);
-  fclose(asmfp);
+  if (fp != NULL) fclose(fp);
+  if (asmfp != NULL) fclose(asmfp);
+  fp = NULL;
+  asmfp = NULL;
 }
 
 void logging_saveNESTrace(char* trace, uint32_t cpuCycles) {
-  fprintf(fp, "%s CYC: %d\n", trace, cpuCycles);
+  if (fp != NULL) fprintf(fp, "%s CYC: %d\n", trace, cpuCycles);
 }
 
 void logging_saveDisassembly(char* line) {
-  fprintf(asmfp, "%s\n", line);
+  if (asmfp != NULL) fprintf(asmfp, "%s\n", line);
 }
 
 void logging_intToHexString(uint32_t val, uint8_t size, char* output) {
@@ -389,36 +389,3 @@ void logging_bytecodeToAssembly(uint32_t pointer, Bytecode* b, char line[128], u
   }
 }
 
-#else
-
-// dummy functions for when logging is disabled
-
-void logging_init() {
-  return;
-}
-
-void logging_kill() {
-  return;
-}
-
-void logging_saveDisassembly(char* line) {
-  return;
-}
-
-void logging_saveNESTrace(char* trace, uint32_t cpuCycles) {
-  return;
-}
-
-void logging_bytecodeToTrace(CPURegisters reg, Bytecode* b, char* line, void(*memWrite)(uint16_t, uint8_t), uint8_t(*memRead)(uint16_t)) {
-  return;
-}
-
-void logging_bytecodeToAssembly(uint32_t pointer, Bytecode* b, char line[128], uint8_t flags) {
-  return;
-}
-
-void logging_intToHexString(uint32_t val, uint8_t size, char* output) {
-  return;
-}
-
-#endif
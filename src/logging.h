@@ -31,14 +31,13 @@
 
 #include "globalflags.h"
 
-#if (LOGGING)
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#endif
 
 /**
- * @brief Initialize logging functionality
+ * @brief Initialize logging functionality, opening the trace and
+ *        disassembly files in ./debug
  * 
  */
 void logging_init();
@@ -0,0 +1,151 @@
+/**
+ * @file lz.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "lz.h"
+
+// Each sequence is laid out as:
+//   token (literal length << 4 | (match length - LZ_MIN_MATCH))
+//   [extra literal length bytes] literals
+//   offset (16-bit little endian) [extra match length bytes]
+// A length nibble of 15 is continued by bytes that are added until one
+// is below 255. The final sequence only carries literals.
+
+static force_inline uint32_t lz_read32(const uint8_t* p) {
+  uint32_t val;
+  memcpy(&val, p, sizeof(val));
+  return val;
+}
+
+static force_inline uint32_t lz_writeLength(uint8_t* dst, uint32_t op, uint32_t len) {
+  while (len >= 255) {
+    dst[op++] = 255;
+    len -= 255;
+  }
+  dst[op++] = (uint8_t)len;
+  return op;
+}
+
+static force_inline uint32_t lz_emitLiterals(uint8_t* dst, uint32_t op, const uint8_t* literals, uint32_t litLen, uint8_t matchNibble) {
+  dst[op++] = ((litLen >= 15 ? 15 : litLen) << 4) | matchNibble;
+  if (litLen >= 15) op = lz_writeLength(dst, op, litLen - 15);
+  memcpy(dst + op, literals, litLen);
+  return op + litLen;
+}
+
+uint32_t lz_maxCompressedSize(uint32_t size) {
+  return size + (size / 255) + 16;
+}
+
+uint32_t lz_compress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity) {
+  // positions are stored off by one so that 0 marks an empty bucket
+  uint32_t table[1 << LZ_HASH_BITS];
+  uint32_t ip = 0;
+  uint32_t anchor = 0;
+  uint32_t op = 0;
+
+  if (dstCapacity < lz_maxCompressedSize(srcSize)) return 0;
+  memset(table, 0, sizeof(table));
+
+  while (ip + LZ_MIN_MATCH <= srcSize) {
+    uint32_t seq = lz_read32(src + ip);
+    uint32_t hash = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+    uint32_t ref = table[hash];
+    table[hash] = ip + 1;
+
+    if (ref == 0 || ip - (ref - 1) > LZ_MAX_OFFSET || lz_read32(src + ref - 1) != seq) {
+      ip += 1;
+      continue;
+    }
+    ref -= 1;
+
+    // extend the match as far as it goes
+    uint32_t matchLen = LZ_MIN_MATCH;
+    while (ip + matchLen < srcSize && src[ref + matchLen] == src[ip + matchLen]) {
+      matchLen += 1;
+    }
+
+    uint32_t extra = matchLen - LZ_MIN_MATCH;
+    op = lz_emitLiterals(dst, op, src + anchor, ip - anchor, extra >= 15 ? 15 : extra);
+    dst[op++] = (ip - ref) & BIT_FILL_8;
+    dst[op++] = (ip - ref) >> 8;
+    if (extra >= 15) op = lz_writeLength(dst, op, extra - 15);
+
+    ip += matchLen;
+    anchor = ip;
+  }
+
+  // flush trailing literals
+  return lz_emitLiterals(dst, op, src + anchor, srcSize - anchor, 0);
+}
+
+uint32_t lz_decompress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity) {
+  uint32_t ip = 0;
+  uint32_t op = 0;
+
+  while (ip < srcSize) {
+    uint8_t token = src[ip++];
+
+    // copy literals
+    uint32_t litLen = token >> 4;
+    if (litLen == 15) {
+      uint8_t b;
+      do {
+        if (ip >= srcSize) return 0;
+        b = src[ip++];
+        litLen += b;
+      } while (b == 255);
+    }
+    if (litLen > srcSize - ip || litLen > dstCapacity - op) return 0;
+    memcpy(dst + op, src + ip, litLen);
+    ip += litLen;
+    op += litLen;
+
+    // last sequence has no match
+    if (ip == srcSize) break;
+
+    // copy match
+    if (srcSize - ip < 2) return 0;
+    uint32_t offset = (uint32_t)src[ip] | ((uint32_t)src[ip + 1] << 8);
+    ip += 2;
+    uint32_t matchLen = token & BIT_FILL_4;
+    if (matchLen == 15) {
+      uint8_t b;
+      do {
+        if (ip >= srcSize) return 0;
+        b = src[ip++];
+        matchLen += b;
+      } while (b == 255);
+    }
+    matchLen += LZ_MIN_MATCH;
+    if (offset == 0 || offset > op || matchLen > dstCapacity - op) return 0;
+
+    // byte-wise so that overlapping (run-length) matches expand correctly
+    for (uint32_t i = 0; i < matchLen; i++) {
+      dst[op + i] = dst[op - offset + i];
+    }
+    op += matchLen;
+  }
+
+  return op;
+}
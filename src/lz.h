@@ -0,0 +1,83 @@
+/**
+ * @file lz.h
+ * @author Noah Sadir (development.noahsadir@gmail.com)
+ * @brief Small LZ77-style codec for save data
+ * @version 1.0
+ * @date 2026-10-19
+ * 
+ * @copyright Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LZ_H
+#define LZ_H
+
+#include "globalflags.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Shortest back-reference worth encoding
+ */
+#define LZ_MIN_MATCH 4
+
+/**
+ * @brief Number of bits used to index the match finder's hash table
+ */
+#define LZ_HASH_BITS 12
+
+/**
+ * @brief Farthest distance a back-reference may point
+ */
+#define LZ_MAX_OFFSET 0xFFFF
+
+/**
+ * @brief Get the worst-case size of compressed data
+ * 
+ * @param size the size of the uncompressed data (in bytes)
+ * @return uint32_t the size the output buffer must have
+ */
+uint32_t lz_maxCompressedSize(uint32_t size);
+
+/**
+ * @brief Compress a block of data
+ * 
+ * @param src the data to compress
+ * @param srcSize the size of the data (in bytes)
+ * @param dst the output buffer
+ * @param dstCapacity the size of the output buffer (in bytes)
+ * @return uint32_t the compressed size, or 0 if the output buffer is too small
+ */
+uint32_t lz_compress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity);
+
+/**
+ * @brief Decompress a block of data.
+ *        Malformed input is rejected rather than read or written out of bounds.
+ * 
+ * @param src the compressed data
+ * @param srcSize the size of the compressed data (in bytes)
+ * @param dst the output buffer
+ * @param dstCapacity the size of the output buffer (in bytes)
+ * @return uint32_t the decompressed size, or 0 if the input is malformed
+ */
+uint32_t lz_decompress(const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstCapacity);
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * @file machine.h
+ * @author Noah Sadir (development.noahsadir@gmail.com)
+ * @brief State touched by nearly every emulated instruction
+ * @version 1.0
+ * @date 2026-10-19
+ * 
+ * @copyright Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+/*
+ * The CPU, bus, PPU and joypad keep the state they touch on (nearly)
+ * every instruction here rather than in their own globals, so a running
+ * machine's working set is a few adjacent cache lines instead of being
+ * spread among the frame buffers, CHR cache and bytecode map. Those large,
+ * rarely touched buffers stay in their modules.
+ *
+ * Flags are bytes rather than bool, since bool's size depends on whether
+ * a file included stdbool.h.
+ */
+
+#include "globalflags.h"
+#include "joypad.h"
+
+#include <stdint.h>
+
+typedef struct {
+  // cpu6502
+  CPURegisters reg;
+  uint8_t cpuerrno;
+  uint8_t deferNMI;    // an instruction is part way through (accurate timing)
+  uint8_t nmiPending;  // raised while deferred; taken when it finishes
+  CPUClockMode clockMode;
+  uint8_t(*memRead)(uint16_t);
+  void(*memWrite)(uint16_t, uint8_t);
+  BytecodeProgram* prgBytecode;
+
+  // bus
+  uint64_t totalCPUCycles;
+  uint64_t totalInstructions;
+  int32_t cyclesUntilDelay;
+  int32_t cyclesUntilSample;
+  int32_t cyclesUntilSecond;
+  uint8_t frameComplete;
+  uint8_t prgRAMDirty;
+  void(*cpuReport)(uint8_t);
+  void(*writeHook)(uint16_t);
+  uint8_t* prgBanks[2]; // PRG ROM mapped at $8000 and $C000
+  uint8_t* prgRAM;
+
+  // ppu
+  PPURegisters ppureg;
+  uint8_t scrollX;
+  uint8_t scrollY;
+  uint8_t dataBuffer;
+  uint8_t addressLatch;
+  uint8_t scrollLatch;
+  uint8_t triggerSpriteZero;
+  uint8_t didRenderFrame;
+  uint8_t renderingEnabled;
+  uint16_t addressBuffer;
+  uint16_t scanline;
+  uint16_t spriteZeroScanline;
+  uint16_t initialScrollX;
+  uint16_t initialScrollY;
+  uint16_t scanlineCycleCounter;
+  uint64_t ppuCycles;
+  uint64_t ppuFrames;
+  uint16_t loopyV;      // current VRAM address (PPURENDER_DOT)
+  uint16_t loopyT;      // temporary VRAM address
+  uint8_t fineX;
+  uint8_t writeToggle;  // shared by PPUSCROLL and PPUADDR
+  uint8_t oddFrame;
+  uint16_t renderedDot; // dots of this scanline already drawn by dot
+
+  // joypad
+  uint8_t buttonStatus[JOYPAD_PORT_COUNT];
+  uint8_t buttonIndex[JOYPAD_PORT_COUNT];
+  uint8_t strobe;
+
+  // zero page and stack first
+  uint8_t cpuRAM[2048] __attribute__((aligned(64)));
+} __attribute__((aligned(64))) HotState;
+
+/**
+ * @brief The running machine's hot state (defined in bus.c)
+ */
+extern machine_local HotState hot;
+
+#endif
@@ -24,31 +24,290 @@
 
 #include "main.h"
 
-bool main_loadROM(char* path, FileBinary* binary) {
-  FILE* fp;
-  fp = fopen(path, "rb");
-
-  if (fp == NULL) return false;
-
-  uint8_t buffer[16];
-  uint32_t n;
-
-  // setup data struct
-  fseek(fp, 0L, SEEK_END);
-  binary->bytes = ftell(fp);
-  binary->data = malloc(sizeof(uint8_t) * binary->bytes);
-  rewind(fp);
-
-  // populate binary object with file data
-  uint32_t count = 0;
-  while ((n = fread(buffer, 1, 16, fp)) > 0) {
-    for (int i = 0; i < 16; i++) {
-      binary->data[count] = buffer[i];
-      count += 1;
+NES* nes = NULL;
+char debugOverlayString[32];
+bool halted = false;
+
+// buttons held on the local controller, applied at the start of each frame
+uint8_t localInput = 0;
+
+// save states are only taken or applied between frames
+uint8_t* stateBuffer = NULL;
+uint8_t saveSlot = 0;
+bool saveRequested = false;
+bool debugRequested = false;
+
+// frames shown since power on, and whether they're also published
+uint64_t frameNumber = 0;
+bool publishing = false;
+
+// the engine, chosen once before the console is created
+NESCPUMode cpuMode = (NESCPUMode)EMU_MODE;
+NESRenderMode renderMode = HEADLESS ? NES_RENDER_NONE : (PPU_IMMEDIATE_CATCHUP ? NES_RENDER_SCANLINE : NES_RENDER_FRAME);
+NESTiming timing = (NESTiming)CPU_TIMING;
+char* codeCachePath = NULL;
+bool tracing = LOGGING;
+void (*paceFrame)() = LIMIT_CLOCK_SPEED ? &main_paceRealtime : &main_paceUnlimited;
+uint64_t nextFrameUsec = 0;
+
+// a control client owns the clock while it's connected
+char* controlPath = NULL;
+bool controlConnected = false;
+bool controlChanged = false;
+
+NetplayTransport netplayTransport;
+bool netplayActive = false;
+uint8_t netplayPlayer = 0;
+FILE* netplayStatsLog = NULL;
+
+#if (PERFORMANCE_DEBUG)
+uint32_t framesElapsed = 0;
+uint64_t lastCycleCount = 0;
+struct timeval pd1, pd2;
+#endif
+
+void main_run(char* romPath) {
+  debugOverlayString[0] = '\0';
+  #if (PERFORMANCE_DEBUG)
+  gettimeofday(&pd1, NULL);
+  #endif
+
+  io_init(DISPLAY_SCALE);
+
+  // panic if issues with rom
+  nes_select_engine(cpuMode, renderMode, tracing);
+  nes_select_timing(timing);
+  nes_set_code_cache(codeCachePath);
+  nes = nes_create();
+
+  // listen first, so a client can still load a ROM if this one fails
+  if (controlPath != NULL && !control_open(controlPath, nes, &main_controlChanged)) {
+    fprintf(stderr, "Unable to listen on %s\n", controlPath);
+  }
+
+  NESLoadResult result = nes_load_rom_file(nes, romPath);
+  switch (result) {
+    case NES_LOAD_OK: break;
+    case NES_LOAD_NO_ROM: io_panic("(I/O) 0x00 NO_ROM"); break;
+    case NES_LOAD_INVALID_ROM: io_panic("(I/O) 0x01 INVALID_ROM"); break;
+    case NES_LOAD_UNSUPPORTED_MAPPER: io_panic("(I/O) 0x02 UNSUPPORTED_MAPPER"); break;
+  }
+  while (!nes_loaded(nes)) { // wait to quit, or for a client to load one
+    control_poll(16);
+    io_pollJoypad(&main_handleInput);
+  }
+
+  if (renderMode == NES_RENDER_NONE) {
+    // looks like somebody chopped off the PPU!
+    io_printString("DISPLAY OFF", 88, 64);
+  }
+
+  stateBuffer = malloc(nes_state_size());
+  savestate_init(romPath, nes_state_size());
+
+  if (netplayActive) {
+    netplay_init(&netplayTransport, netplayPlayer, nes_state_size(), &main_saveState, &main_loadState, &main_runNetplayFrame);
+    netplay_setStatsLog(netplayStatsLog);
+  }
+  #if (TIME_TRAVEL_DEBUG)
+  debugger_init(nes_state_size(), &main_saveState, &main_loadState, &main_setInputs, &main_stepInstruction, &main_peek);
+  nes_set_write_hook(nes, &debugger_noteWrite);
+  #endif
+
+  while (!halted) {
+    controlConnected = control_poll(controlConnected ? 16 : 0);
+    if (controlConnected) {
+      // only show what the client's commands changed
+      if (controlChanged) {
+        controlChanged = false;
+        main_presentFrame();
+      } else {
+        io_pollJoypad(&main_handleInput);
+      }
+      continue;
+    }
+
+    if (netplayActive) {
+      if (!netplay_runFrame(localInput)) {
+        // peer is gone; keep playing alone
+        netplay_kill();
+        netplayActive = false;
+      }
+    } else {
+      uint8_t inputs[NES_PORT_COUNT] = {localInput, 0};
+      main_setInputs(inputs);
+      #if (TIME_TRAVEL_DEBUG)
+      uint64_t firstInstruction = nes_instruction_count(nes);
+      debugger_beginFrame(inputs);
+      halted = !nes_run_frame(nes);
+      debugger_endFrame(nes_instruction_count(nes) - firstInstruction);
+      #else
+      halted = !nes_run_frame(nes);
+      #endif
     }
+    main_presentFrame();
+    main_endFrame();
+    paceFrame();
+
+    #if (TIME_TRAVEL_DEBUG)
+    if (debugRequested) {
+      debugRequested = false;
+      debugger_prompt();
+    }
+    #endif
   }
 
-  return true;
+  // CPU should never halt until shut off
+  switch (nes_cpu_error(nes))
+  {
+    case 0: io_panic("(CPU) 0x00 UNEXPECTED_HALT"); break;
+    case 1: io_panic("(CPU) 0x01 ILLEGAL_INSTR"); break;
+    case 2: io_panic("(CPU) 0x02 ILLEGAL_BYTECODE"); break;
+    default: io_panic("(CPU) 0xFF UNKNOWN"); break;
+  }
+  while (true) io_pollJoypad(&main_handleInput); // wait for user to exit, essentially
+}
+
+void main_presentFrame() {
+  // If desired, alculate & display framerate and CPU frequency
+  #if (PERFORMANCE_DEBUG)
+  gettimeofday(&pd2, NULL); // poll delay
+  uint32_t delayCounter = (pd2.tv_sec - pd1.tv_sec);
+  framesElapsed += 1;
+  if (delayCounter >= 1) {
+    uint64_t cycleCount = nes_cycle_count(nes);
+    uint32_t fq = cycleCount - lastCycleCount;
+    uint32_t fr = framesElapsed;
+    lastCycleCount = cycleCount;
+    framesElapsed = 0;
+    gettimeofday(&pd1, NULL);
+    // This is ugly, but it reduces dependency & overhead from sprintf
+    for (int i = 8; i >= 0; i--) {
+      if (i < 3) {
+        debugOverlayString[i] = '0' + (fq % 10);
+      } else if (i < 6) {
+        debugOverlayString[i + 1] = '0' + (fq % 10);
+        debugOverlayString[i] = '.';
+      }
+      fq /= 10;
+    }
+    debugOverlayString[7] = '\0';
+    strcat(debugOverlayString, " MHz (");
+    for (int i = 16; i >= 13; i--) {
+      debugOverlayString[i] = '0' + (fr % 10);
+      fr /= 10;
+    }
+    debugOverlayString[17] = '\0';
+    strcat(debugOverlayString, " FPS)");
+  }
+  #endif
+
+  if (renderMode != NES_RENDER_NONE) io_update(debugOverlayString);
+
+  frameNumber += 1;
+  if (publishing) surface_publish(frameNumber, nes_framebuffer_indexed(nes), nes_framebuffer_emphasis(nes), nes_ram(nes));
+
+  io_pollJoypad(&main_handleInput);
+}
+
+void main_endFrame() {
+  if (saveRequested) {
+    nes_save_state(nes, stateBuffer);
+    savestate_save(saveSlot, stateBuffer);
+    saveRequested = false;
+  }
+
+  if (savestate_pollLoad(stateBuffer)) {
+    nes_load_state(nes, stateBuffer);
+    #if (TIME_TRAVEL_DEBUG)
+    debugger_reset(); // history no longer leads up to this state
+    #endif
+  }
+}
+
+void main_paceRealtime() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  uint64_t now = ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+
+  // don't race to catch up after a stall; just carry on from now
+  if (now >= nextFrameUsec + DISPLAY_FRAME_USEC) {
+    nextFrameUsec = now;
+  } else if (now < nextFrameUsec) {
+    usleep(nextFrameUsec - now);
+  }
+  nextFrameUsec += DISPLAY_FRAME_USEC;
+}
+
+void main_paceUnlimited() {
+  return;
+}
+
+void main_handleInput(NESInput input, bool enabled) {
+    if (input == INPUT_QUIT) {
+      netplay_kill();
+      surface_close();
+      control_close();
+      savestate_kill(); // don't lose a save that's still being written
+      nes_destroy(nes); // flushes the battery save
+      exit(0);
+    }
+    if (input == INPUT_DEBUG_BREAK) {
+      if (enabled && !netplayActive) debugRequested = true;
+      return;
+    }
+    if (input == INPUT_SAVE_STATE || input == INPUT_LOAD_STATE || input == INPUT_NEXT_SLOT) {
+      if (!enabled || netplayActive) return; // would desync the peer
+      if (input == INPUT_SAVE_STATE) saveRequested = true;
+      if (input == INPUT_LOAD_STATE) savestate_requestLoad(saveSlot);
+      if (input == INPUT_NEXT_SLOT) saveSlot = (saveSlot + 1) % SAVESTATE_SLOT_COUNT;
+      return;
+    }
+    uint8_t jpMappings[9] = {NES_BUTTON_UP, NES_BUTTON_DOWN, NES_BUTTON_LEFT, NES_BUTTON_RIGHT, NES_BUTTON_A, NES_BUTTON_B, NES_BUTTON_SELECT, NES_BUTTON_START, 0};
+    if (enabled) {
+        localInput |= jpMappings[input];
+    } else {
+        localInput &= ~jpMappings[input];
+    }
+}
+
+void main_setInputs(uint8_t* inputs) {
+  for (int port = 0; port < NES_PORT_COUNT; port++) {
+    nes_set_input(nes, port, inputs[port]);
+  }
+}
+
+void main_saveState(void* state) {
+  nes_save_state(nes, state);
+}
+
+void main_loadState(void* state) {
+  nes_load_state(nes, state);
+}
+
+void main_runNetplayFrame(uint8_t* inputs, bool render) {
+  main_setInputs(inputs);
+  nes_set_rendering(nes, render);
+  if (!nes_run_frame(nes)) halted = true;
+  nes_set_rendering(nes, true);
+}
+
+bool main_stepInstruction(bool render) {
+  nes_set_rendering(nes, render);
+  bool frameDone = nes_step_instruction(nes);
+  nes_set_rendering(nes, true);
+  return frameDone;
+}
+
+uint8_t main_peek(uint16_t addr) {
+  return nes_peek(nes, addr);
+}
+
+void main_controlChanged() {
+  controlChanged = true;
+  #if (TIME_TRAVEL_DEBUG)
+  debugger_reset(); // history no longer leads up to this state
+  #endif
 }
 
 void main_compareCPUTraces() {
@@ -102,18 +361,137 @@ void main_compareCPUTraces() {
   #endif
 }
 
+bool main_parseArgs(int argc, char* argv[]) {
+  NetplayTransport* transport = &netplayTransport;
+  char* socketPath = NULL;
+  char* statsPath = NULL;
+  bool loopback = false;
+  bool host = false;
+  uint32_t latencyMs = 0;
+  uint32_t jitterMs = 0;
+
+  for (int i = 2; i < argc; i++) {
+    bool hasValue = (i + 1 < argc);
+    if (strcmp(argv[i], "--netplay-loopback") == 0) {
+      loopback = true;
+    } else if (strcmp(argv[i], "--netplay-host") == 0 && hasValue) {
+      socketPath = argv[++i];
+      host = true;
+    } else if (strcmp(argv[i], "--netplay-join") == 0 && hasValue) {
+      socketPath = argv[++i];
+      host = false;
+    } else if (strcmp(argv[i], "--latency") == 0 && hasValue) {
+      latencyMs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--jitter") == 0 && hasValue) {
+      jitterMs = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--netplay-stats") == 0 && hasValue) {
+      statsPath = argv[++i];
+    } else if (strcmp(argv[i], "--shm") == 0 && hasValue) {
+      uint32_t palette[SURFACE_EMPHASIS_COUNT * SURFACE_PALETTE_SIZE];
+      nes_palette(palette, NES_PIXEL_XRGB8888);
+      if (!surface_open(argv[++i], palette)) {
+        fprintf(stderr, "Unable to create shared memory %s\n", argv[i]);
+        return false;
+      }
+      publishing = true;
+    } else if (strcmp(argv[i], "--control") == 0 && hasValue) {
+      controlPath = argv[++i];
+    } else if (strcmp(argv[i], "--cpu") == 0 && hasValue) {
+      char* mode = argv[++i];
+      if (strcmp(mode, "direct") == 0) {
+        cpuMode = NES_CPU_INTERPRET_DIRECT;
+      } else if (strcmp(mode, "cached") == 0) {
+        cpuMode = NES_CPU_INTERPRET_CACHED;
+      } else if (strcmp(mode, "static") == 0) {
+        cpuMode = NES_CPU_RECOMPILE_STATIC;
+      } else {
+        fprintf(stderr, "Unknown CPU mode: %s\n", mode);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--ppu") == 0 && hasValue) {
+      char* mode = argv[++i];
+      if (strcmp(mode, "frame") == 0) {
+        renderMode = NES_RENDER_FRAME;
+      } else if (strcmp(mode, "scanline") == 0) {
+        renderMode = NES_RENDER_SCANLINE;
+      } else if (strcmp(mode, "none") == 0) {
+        renderMode = NES_RENDER_NONE;
+      } else if (strcmp(mode, "dot") == 0) {
+        renderMode = NES_RENDER_DOT;
+      } else {
+        fprintf(stderr, "Unknown PPU renderer: %s\n", mode);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--timing") == 0 && hasValue) {
+      char* mode = argv[++i];
+      if (strcmp(mode, "fast") == 0) {
+        timing = NES_TIMING_FAST;
+      } else if (strcmp(mode, "accurate") == 0) {
+        timing = NES_TIMING_ACCURATE;
+      } else if (strcmp(mode, "auto") == 0) {
+        timing = NES_TIMING_AUTO;
+      } else {
+        fprintf(stderr, "Unknown CPU timing: %s\n", mode);
+        return false;
+      }
+    } else if (strcmp(argv[i], "--code-cache") == 0 && hasValue) {
+      codeCachePath = argv[++i];
+    } else if (strcmp(argv[i], "--trace") == 0) {
+      tracing = true;
+    } else if (strcmp(argv[i], "--sync") == 0 && hasValue) {
+      char* mode = argv[++i];
+      if (strcmp(mode, "realtime") == 0) {
+        paceFrame = &main_paceRealtime;
+      } else if (strcmp(mode, "none") == 0) {
+        paceFrame = &main_paceUnlimited;
+      } else {
+        fprintf(stderr, "Unknown sync mode: %s\n", mode);
+        return false;
+      }
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return false;
+    }
+  }
+
+  if (!loopback && socketPath == NULL) return true;
+
+  if (controlPath != NULL) {
+    fprintf(stderr, "--control can't be combined with netplay\n");
+    return false;
+  }
+
+  FILE* statsLog = NULL;
+  if (statsPath != NULL && (statsLog = fopen(statsPath, "w")) == NULL) {
+    fprintf(stderr, "Unable to open %s\n", statsPath);
+    return false;
+  }
+
+  if (loopback) {
+    netplay_openLoopback(transport, latencyMs, jitterMs);
+  } else {
+    if (host) printf("Waiting for player 2 on %s...\n", socketPath);
+    if (!netplay_openUnix(transport, socketPath, host, latencyMs, jitterMs)) {
+      fprintf(stderr, "Unable to connect over %s\n", socketPath);
+      return false;
+    }
+  }
+
+  // the host (and loopback) is always player 1
+  netplayActive = true;
+  netplayPlayer = (loopback || host) ? 0 : 1;
+  netplayStatsLog = statsLog;
+  return true;
+}
+
 int main(int argc, char* argv[]) {
   char* filePath = (argc >= 2) ? argv[1] : "./rom.nes";
 
-  FileBinary binary;
-
-  if (!main_loadROM(filePath, &binary)) {
-    bus_init(NULL);
+  if (!main_parseArgs(argc, argv)) {
+    return 1;
   }
 
-  logging_init();
-  bus_init(&binary);
-  free(binary.data);
+  main_run(filePath);
   logging_kill();
 
   #if (CPU_DEBUG)
@@ -30,21 +30,119 @@
 #define MAIN_H
 
 #include "globalflags.h"
+#include "nes.h"
 #include "bus.h"
+#include "io.h"
+#include "savestate.h"
+#include "netplay.h"
+#include "debugger.h"
+#include "surface.h"
+#include "control.h"
 
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 
 /**
- * @brief Load a ROM from the specified path
+ * @brief Create a console for the ROM at the specified path and run it,
+ *        presenting each frame and handling input until the user quits
  * 
- * @param path the file path
- * @param fp the file pointer
- * @return true if the file was opened successfully
- * @return false upon failure
+ * @param romPath the file path of the ROM
  */
-bool main_loadROM(char* path, FileBinary* binary);
+void main_run(char* romPath);
+
+/**
+ * @brief Display the frame which was just emulated and poll the user's input
+ */
+void main_presentFrame();
+
+/**
+ * @brief Take or apply save states which were requested during the frame
+ */
+void main_endFrame();
+
+/**
+ * @brief Wait until the next frame is due, so games run at the NES's own
+ *        60 frames per second (--sync realtime)
+ */
+void main_paceRealtime();
+
+/**
+ * @brief Run the next frame right away (--sync none)
+ */
+void main_paceUnlimited();
+
+/**
+ * @brief Handle an input event from the frontend
+ * 
+ * @param input the input which changed
+ * @param enabled true if pressed, false if released
+ */
+void main_handleInput(NESInput input, bool enabled);
+
+/**
+ * @brief Set the buttons held on every controller port
+ * 
+ * @param inputs one button bitfield per port
+ */
+void main_setInputs(uint8_t* inputs);
+
+/**
+ * @brief Save the console state into the given buffer
+ * 
+ * @param state a buffer of nes_state_size() bytes
+ */
+void main_saveState(void* state);
+
+/**
+ * @brief Restore the console state from the given buffer
+ * 
+ * @param state a buffer of nes_state_size() bytes
+ */
+void main_loadState(void* state);
+
+/**
+ * @brief Run one netplay frame with the given inputs
+ * 
+ * @param inputs one button bitfield per port
+ * @param render false when resimulating frames which won't be displayed
+ */
+void main_runNetplayFrame(uint8_t* inputs, bool render);
+
+/**
+ * @brief Execute a single CPU instruction for the debugger
+ * 
+ * @param render whether the PPU should draw any frame completed
+ * @return true if the instruction completed a frame
+ */
+bool main_stepInstruction(bool render);
+
+/**
+ * @brief Read CPU memory without side effects for the debugger
+ * 
+ * @param addr the CPU address
+ * @return the byte at the address
+ */
+uint8_t main_peek(uint16_t addr);
+
+/**
+ * @brief Note that a control client changed the console's state, so the
+ *        next frame is presented and the debugger's history is dropped
+ */
+void main_controlChanged();
+
+/**
+ * @brief Parse the options which follow the ROM path, connecting to the
+ *        netplay peer and creating the shared-memory surface and control
+ *        socket if requested, and choosing the engine
+ * 
+ * @param argc the number of args
+ * @param argv the contents of args
+ * @return false if the options were invalid or the connection failed
+ */
+bool main_parseArgs(int argc, char* argv[]);
 
 /**
  * @brief Compare generated vs correct CPU traces.
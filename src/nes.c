@@ -0,0 +1,306 @@
+/**
+ * @file nes.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "nes.h"
+#include "bus.h"
+
+struct NES {
+  bool loaded;
+  bool rendering;
+  void(*writeHook)(uint16_t);
+
+  // where the machine lives while another handle has this thread
+  BusCartridge cartridge;
+  MachineState state;
+  uint8_t framebuffer[DISPLAY_BITMAP_SIZE];
+  uint8_t emphasis[DISPLAY_HEIGHT];
+
+  // nes_framebuffer's colors, and the cycle they were converted at
+  uint32_t rgb[DISPLAY_BITMAP_SIZE];
+  uint64_t rgbCycle;
+  bool rgbValid;
+};
+
+// the handle whose machine is in this thread's emulator state
+static machine_local NES* activeNES = NULL;
+
+/**
+ * @brief Swap the active machine of this thread out into its handle
+ */
+static void nes_deactivate() {
+  NES* nes = activeNES;
+  if (nes == NULL) return;
+  if (nes->loaded) {
+    bus_saveState(&nes->state);
+    memcpy(nes->framebuffer, ppu_getBitmap(), sizeof(nes->framebuffer));
+    memcpy(nes->emphasis, ppu_getEmphasis(), sizeof(nes->emphasis));
+    bus_detachCartridge(&nes->cartridge);
+  }
+  activeNES = NULL;
+}
+
+/**
+ * @brief Make a handle's machine the one this thread's emulator state holds
+ */
+static void nes_activate(NES* nes) {
+  if (activeNES == nes) return;
+  nes_deactivate();
+  if (nes->loaded) {
+    bus_attachCartridge(&nes->cartridge);
+    bus_loadState(&nes->state);
+    memcpy(ppu_getBitmap(), nes->framebuffer, sizeof(nes->framebuffer));
+    memcpy(ppu_getEmphasis(), nes->emphasis, sizeof(nes->emphasis));
+  }
+  bus_setWriteHook(nes->writeHook);
+  ppu_setRenderingEnabled(nes->rendering);
+  activeNES = nes;
+}
+
+void nes_select_engine(NESCPUMode cpu, NESRenderMode renderer, int tracing) {
+  EngineConfig config = bus_getEngine();
+  config.cpuMode = (CPUEmulationMode)cpu;
+  config.renderMode = (PPURenderMode)renderer;
+  config.tracing = (tracing != 0);
+  if (config.tracing) {
+    logging_init();
+  } else {
+    logging_kill();
+  }
+  bus_selectEngine(config);
+}
+
+void nes_select_timing(NESTiming timing) {
+  EngineConfig config = bus_getEngine();
+  config.timing = (CPUTiming)timing;
+  bus_selectEngine(config);
+}
+
+void nes_set_code_cache(const char* dir) {
+  codecache_setDirectory((char*)dir);
+}
+
+NES* nes_create(void) {
+  NES* nes = calloc(1, sizeof(NES));
+  if (nes == NULL) return NULL;
+  nes->rendering = true;
+  return nes;
+}
+
+static NESLoadResult nes_insert(NES* nes, FileBinary* bin) {
+  nes_activate(nes);
+  BusLoadResult result = bus_loadROM(bin);
+  nes->loaded = (result == LOADROM_OK);
+  nes->rgbValid = false;
+
+  // power on resets these
+  bus_setWriteHook(nes->writeHook);
+  ppu_setRenderingEnabled(nes->rendering);
+
+  switch (result) {
+    case LOADROM_OK: return NES_LOAD_OK;
+    case LOADROM_NO_ROM: return NES_LOAD_NO_ROM;
+    case LOADROM_INVALID: return NES_LOAD_INVALID_ROM;
+    case LOADROM_UNSUPPORTED_MAPPER: return NES_LOAD_UNSUPPORTED_MAPPER;
+  }
+  return NES_LOAD_INVALID_ROM;
+}
+
+NESLoadResult nes_load_rom(NES* nes, const uint8_t* bytes, size_t len) {
+  if (bytes == NULL) return NES_LOAD_NO_ROM;
+  FileBinary bin;
+  bin.data = (uint8_t*)bytes; // only read
+  bin.bytes = len;
+  bin.path = NULL;
+  return nes_insert(nes, &bin);
+}
+
+NESLoadResult nes_load_rom_file(NES* nes, const char* path) {
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) return NES_LOAD_NO_ROM;
+
+  FileBinary bin;
+  fseek(fp, 0L, SEEK_END);
+  long bytes = ftell(fp);
+  rewind(fp);
+  if (bytes <= 0) {
+    // empty, or not a file that can be measured (e.g. a pipe)
+    fclose(fp);
+    return NES_LOAD_NO_ROM;
+  }
+  bin.data = malloc(bytes);
+  bin.bytes = fread(bin.data, 1, bytes, fp);
+  bin.path = (char*)path;
+  fclose(fp);
+  if ((long)bin.bytes != bytes) {
+    free(bin.data);
+    return NES_LOAD_NO_ROM;
+  }
+
+  NESLoadResult result = nes_insert(nes, &bin);
+  free(bin.data);
+  return result;
+}
+
+int nes_loaded(NES* nes) {
+  return nes->loaded;
+}
+
+void nes_set_input(NES* nes, int port, uint8_t buttons) {
+  if (port < 0 || port >= JOYPAD_PORT_COUNT) return;
+  nes_activate(nes);
+  joypad_setButtons(port, buttons);
+}
+
+int nes_run_frame(NES* nes) {
+  nes_activate(nes);
+  if (!nes->loaded || cpu6502_getClockMode() == CPUCLOCK_HALT) return 0;
+  bus_runFrame();
+  bus_syncBatteryRAM(false);
+  return cpu6502_getClockMode() != CPUCLOCK_HALT;
+}
+
+const uint32_t* nes_framebuffer(NES* nes) {
+  nes_activate(nes);
+  // the PPU only draws while the CPU runs
+  uint64_t cycle = bus_getCycleCount();
+  if (!nes->rgbValid || nes->rgbCycle != cycle) {
+    ppu_convertBitmap(nes->rgb, ppu_getBitmap(), ppu_getEmphasis(), PPUFORMAT_XRGB8888);
+    nes->rgbCycle = cycle;
+    nes->rgbValid = true;
+  }
+  return nes->rgb;
+}
+
+const uint8_t* nes_framebuffer_indexed(NES* nes) {
+  nes_activate(nes);
+  return ppu_getBitmap();
+}
+
+const uint8_t* nes_framebuffer_emphasis(NES* nes) {
+  nes_activate(nes);
+  return ppu_getEmphasis();
+}
+
+void nes_convert_frame(NES* nes, uint32_t* pixels, NESPixelFormat format) {
+  nes_activate(nes);
+  ppu_convertBitmap(pixels, ppu_getBitmap(), ppu_getEmphasis(), (PPUPixelFormat)format);
+}
+
+void nes_palette(uint32_t* palette, NESPixelFormat format) {
+  for (uint8_t emphasis = 0; emphasis < 8; emphasis++) {
+    ppu_getPalette(&palette[emphasis * 64], emphasis, (PPUPixelFormat)format);
+  }
+}
+
+void nes_destroy(NES* nes) {
+  if (nes == NULL) return;
+  if (activeNES == nes) {
+    bus_unloadROM();
+    bus_setWriteHook(NULL);
+    activeNES = NULL;
+  } else if (nes->loaded) {
+    bus_freeCartridge(&nes->cartridge);
+  }
+  free(nes);
+}
+
+/* EXTENDED */
+
+size_t nes_state_size(void) {
+  return sizeof(MachineState);
+}
+
+void nes_save_state(NES* nes, void* buffer) {
+  nes_activate(nes);
+  bus_saveState((MachineState*)buffer);
+}
+
+void nes_load_state(NES* nes, const void* buffer) {
+  nes_activate(nes);
+  bus_loadState((MachineState*)buffer);
+}
+
+void nes_set_rendering(NES* nes, int enabled) {
+  nes_activate(nes);
+  nes->rendering = enabled;
+  ppu_setRenderingEnabled(enabled);
+}
+
+int nes_step_instruction(NES* nes) {
+  nes_activate(nes);
+  if (!nes->loaded) return 0;
+  return bus_stepInstruction();
+}
+
+uint8_t nes_peek(NES* nes, uint16_t addr) {
+  nes_activate(nes);
+  if (!nes->loaded) return 0;
+  return bus_readCPU(addr);
+}
+
+int nes_inspect(NES* nes, uint16_t addr, uint8_t* value) {
+  nes_activate(nes);
+  if (!nes->loaded) return 0;
+  return bus_peekCPU(addr, value);
+}
+
+void nes_poke(NES* nes, uint16_t addr, uint8_t val) {
+  nes_activate(nes);
+  if (!nes->loaded) return;
+  bus_writeCPU(addr, val);
+}
+
+uint8_t* nes_ram(NES* nes) {
+  nes_activate(nes);
+  return bus_getCPURAM();
+}
+
+uint8_t* nes_cartridge_ram(NES* nes, size_t* size) {
+  nes_activate(nes);
+  uint32_t prgRAMSize;
+  uint8_t* prgRAM = bus_getPRGRAM(&prgRAMSize);
+  *size = prgRAMSize;
+  return prgRAM;
+}
+
+void nes_set_write_hook(NES* nes, void(*hook)(uint16_t addr)) {
+  nes_activate(nes);
+  nes->writeHook = hook;
+  bus_setWriteHook(hook);
+}
+
+uint64_t nes_cycle_count(NES* nes) {
+  nes_activate(nes);
+  return bus_getCycleCount();
+}
+
+uint64_t nes_instruction_count(NES* nes) {
+  nes_activate(nes);
+  return bus_getInstructionCount();
+}
+
+uint8_t nes_cpu_error(NES* nes) {
+  nes_activate(nes);
+  return cpu6502_getErrno();
+}
@@ -0,0 +1,366 @@
+/**
+ * @file nes.h
+ * @author Noah Sadir (development.noahsadir@gmail.com)
+ * @brief Embeddable emulator core (libnescore)
+ * @version 1.0
+ * @date 2026-10-19
+ * 
+ * @copyright Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef NES_H
+#define NES_H
+
+/*
+ * This is the public interface of libnescore, so it deliberately avoids
+ * the internal headers (and their definition of bool).
+ *
+ * Each handle is a complete console. Any number can exist, but a thread
+ * runs one machine at a time, so alternating between handles on the same
+ * thread swaps them in and out (a copy the size of a save state). For
+ * throughput, use about one thread per core. A handle may only be used by one thread
+ * at a time, and only by the thread that first ran it.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define NES_WIDTH 256
+#define NES_HEIGHT 240
+#define NES_PORT_COUNT 2
+
+/**
+ * @brief Controller buttons, for nes_set_input
+ */
+#define NES_BUTTON_A      0x01
+#define NES_BUTTON_B      0x02
+#define NES_BUTTON_SELECT 0x04
+#define NES_BUTTON_START  0x08
+#define NES_BUTTON_UP     0x10
+#define NES_BUTTON_DOWN   0x20
+#define NES_BUTTON_LEFT   0x40
+#define NES_BUTTON_RIGHT  0x80
+
+typedef enum {
+  NES_LOAD_OK = 0,
+  NES_LOAD_NO_ROM,
+  NES_LOAD_INVALID_ROM,
+  NES_LOAD_UNSUPPORTED_MAPPER
+} NESLoadResult;
+
+/**
+ * @brief Engines for nes_select_engine
+ */
+typedef enum {
+  NES_CPU_INTERPRET_DIRECT = 0,  // decode every instruction as it runs
+  NES_CPU_INTERPRET_CACHED,      // decode each address once
+  NES_CPU_RECOMPILE_STATIC       // decode all of PRG ROM at power on
+} NESCPUMode;
+
+typedef enum {
+  NES_RENDER_FRAME = 0,     // draw each frame at once when it's done
+  NES_RENDER_SCANLINE,      // catch up every instruction and draw by scanline
+  NES_RENDER_NONE,          // no PPU; frames are timed by CPU cycles only
+  NES_RENDER_DOT            // catch up every instruction and draw by dot
+} NESRenderMode;
+
+typedef enum {
+  NES_TIMING_FAST = 0,      // fixed cycles per addressing mode
+  NES_TIMING_ACCURATE,      // exact cycles, bus accesses on their own cycle
+  NES_TIMING_AUTO           // accurate only for ROMs that need it
+} NESTiming;
+
+/**
+ * @brief Pixel layouts for nes_convert_frame
+ */
+typedef enum {
+  NES_PIXEL_XRGB8888 = 0,   // 0x00RRGGBB
+  NES_PIXEL_XBGR8888        // 0x00BBGGRR (R, G, B, X in memory)
+} NESPixelFormat;
+
+typedef struct NES NES;
+
+/**
+ * @brief Choose the engine every console in the process runs. Each
+ *        combination is a separately specialized loop, so nothing is
+ *        checked per instruction. Call this before creating any consoles;
+ *        the defaults come from globalflags.h.
+ * 
+ * @param cpu how instructions are decoded
+ * @param renderer how the PPU keeps up with the CPU
+ * @param tracing nonzero to write a trace of every instruction to
+ *        ./debug/output.log
+ */
+void nes_select_engine(NESCPUMode cpu, NESRenderMode renderer, int tracing);
+
+/**
+ * @brief Choose the CPU timing every console in the process uses. Fast and
+ *        accurate timing are separately specialized loops; with
+ *        NES_TIMING_AUTO each cartridge picks one when it's loaded. Call
+ *        this before creating any consoles.
+ * 
+ * @param timing the CPU timing
+ */
+void nes_select_timing(NESTiming timing);
+
+/**
+ * @brief Keep decoded programs in a directory between runs, so the cached
+ *        and static CPU engines start warm. Files are keyed by PRG ROM and
+ *        emulator build, and any number of processes can share one
+ *        directory. Call this before creating any consoles.
+ * 
+ * @param dir an existing directory, or NULL to stop caching (default)
+ */
+void nes_set_code_cache(const char* dir);
+
+/**
+ * @brief Create a console with no cartridge
+ * 
+ * @return NES* the console (or NULL if out of memory)
+ */
+NES* nes_create(void);
+
+/**
+ * @brief Insert an iNES cartridge and power on
+ * 
+ * @param nes the console
+ * @param bytes the contents of the .nes file (copied)
+ * @param len the size of the file (in bytes)
+ * @return NESLoadResult NES_LOAD_OK on success
+ */
+NESLoadResult nes_load_rom(NES* nes, const uint8_t* bytes, size_t len);
+
+/**
+ * @brief Insert a cartridge from a file and power on. Battery-backed
+ *        cartridges keep their RAM in a .sav file beside it.
+ * 
+ * @param nes the console
+ * @param path the path of the .nes file
+ * @return NESLoadResult NES_LOAD_OK on success
+ */
+NESLoadResult nes_load_rom_file(NES* nes, const char* path);
+
+/**
+ * @brief Check whether a cartridge was loaded successfully
+ * 
+ * @param nes the console
+ * @return int 1 if the last load succeeded
+ */
+int nes_loaded(NES* nes);
+
+/**
+ * @brief Set the buttons held on a controller (used from the next frame
+ *        or instruction on)
+ * 
+ * @param nes the console
+ * @param port the controller port (0 or 1)
+ * @param buttons the NES_BUTTON_ flags which are held
+ */
+void nes_set_input(NES* nes, int port, uint8_t buttons);
+
+/**
+ * @brief Run until the PPU finishes a frame
+ * 
+ * @param nes the console
+ * @return int 1 on success, 0 if the CPU has halted (see nes_cpu_error)
+ */
+int nes_run_frame(NES* nes);
+
+/**
+ * @brief Get the last frame drawn as colors, converting it on the first
+ *        call after each frame
+ * 
+ * @param nes the console
+ * @return const uint32_t* NES_WIDTH x NES_HEIGHT pixels (0x00RRGGBB),
+ *         valid until the next call on a different handle from this thread
+ */
+const uint32_t* nes_framebuffer(NES* nes);
+
+/**
+ * @brief Get the last frame drawn as the PPU drew it, a quarter of the
+ *        size of nes_framebuffer and with no conversion
+ * 
+ * @param nes the console
+ * @return const uint8_t* NES_WIDTH x NES_HEIGHT palette indices (0-63),
+ *         valid like nes_framebuffer
+ */
+const uint8_t* nes_framebuffer_indexed(NES* nes);
+
+/**
+ * @brief Get the color emphasis of each line of the last frame drawn
+ * 
+ * @param nes the console
+ * @return const uint8_t* NES_HEIGHT values (0-7: red, green and blue
+ *         emphasis bits), valid like nes_framebuffer
+ */
+const uint8_t* nes_framebuffer_emphasis(NES* nes);
+
+/**
+ * @brief Convert the last frame drawn into the caller's pixel layout
+ * 
+ * @param nes the console
+ * @param pixels the NES_WIDTH x NES_HEIGHT pixels to write
+ * @param format the pixel layout
+ */
+void nes_convert_frame(NES* nes, uint32_t* pixels, NESPixelFormat format);
+
+/**
+ * @brief Get the colors of the palette indices, for converting indexed
+ *        frames without the console
+ * 
+ * @param palette the 8 x 64 colors to fill, one row of 64 per emphasis
+ * @param format the pixel layout
+ */
+void nes_palette(uint32_t* palette, NESPixelFormat format);
+
+/**
+ * @brief Eject the cartridge (flushing any battery save) and free the console
+ * 
+ * @param nes the console
+ */
+void nes_destroy(NES* nes);
+
+/* EXTENDED */
+
+/**
+ * @brief Get the size of a snapshot
+ * 
+ * @return size_t the size (in bytes)
+ */
+size_t nes_state_size(void);
+
+/**
+ * @brief Take a snapshot of the console (not including the cartridge ROM)
+ * 
+ * @param nes the console
+ * @param buffer the buffer of nes_state_size() bytes to fill
+ */
+void nes_save_state(NES* nes, void* buffer);
+
+/**
+ * @brief Restore a snapshot taken from a console with the same cartridge
+ * 
+ * @param nes the console
+ * @param buffer the snapshot
+ */
+void nes_load_state(NES* nes, const void* buffer);
+
+/**
+ * @brief Enable or disable drawing frames (e.g. while re-simulating).
+ *        With every renderer, the game runs exactly as it would while
+ *        drawing (sprite zero hit and overflow included), and the
+ *        framebuffer keeps the last frame drawn.
+ * 
+ * @param nes the console
+ * @param enabled 0 to skip drawing
+ */
+void nes_set_rendering(NES* nes, int enabled);
+
+/**
+ * @brief Execute a single CPU instruction
+ * 
+ * @param nes the console
+ * @return int 1 if the instruction completed a frame
+ */
+int nes_step_instruction(NES* nes);
+
+/**
+ * @brief Read the CPU address space. Reading PPU or controller registers
+ *        has side effects, as on hardware.
+ * 
+ * @param nes the console
+ * @param addr the address
+ * @return uint8_t the value (0 if there's no cartridge)
+ */
+uint8_t nes_peek(NES* nes, uint16_t addr);
+
+/**
+ * @brief Read RAM, PRG RAM or PRG ROM without disturbing the console
+ * 
+ * @param nes the console
+ * @param addr the address
+ * @param value the output value
+ * @return int 0 if there's no cartridge or the address is in $2000-$401F,
+ *         where reads have side effects (use nes_peek)
+ */
+int nes_inspect(NES* nes, uint16_t addr, uint8_t* value);
+
+/**
+ * @brief Write the CPU address space, exactly as a CPU store would. Does
+ *        nothing if there's no cartridge.
+ * 
+ * @param nes the console
+ * @param addr the address
+ * @param val the value
+ */
+void nes_poke(NES* nes, uint16_t addr, uint8_t val);
+
+/**
+ * @brief Get the 2 KB of internal CPU RAM
+ * 
+ * @param nes the console
+ * @return uint8_t* the RAM (valid like nes_framebuffer)
+ */
+uint8_t* nes_ram(NES* nes);
+
+/**
+ * @brief Get the cartridge's PRG RAM
+ * 
+ * @param nes the console
+ * @param size the output size (0 if there is none)
+ * @return uint8_t* the RAM, or NULL (valid like nes_framebuffer)
+ */
+uint8_t* nes_cartridge_ram(NES* nes, size_t* size);
+
+/**
+ * @brief Call a function for every CPU write
+ * 
+ * @param nes the console
+ * @param hook the function (or NULL to stop)
+ */
+void nes_set_write_hook(NES* nes, void(*hook)(uint16_t addr));
+
+/**
+ * @brief Get the number of CPU cycles run since power on
+ * 
+ * @param nes the console
+ * @return uint64_t the cycle count
+ */
+uint64_t nes_cycle_count(NES* nes);
+
+/**
+ * @brief Get the number of instructions executed since power on
+ * 
+ * @param nes the console
+ * @return uint64_t the instruction count
+ */
+uint64_t nes_instruction_count(NES* nes);
+
+/**
+ * @brief Get the reason the CPU halted
+ * 
+ * @param nes the console
+ * @return uint8_t 0 = none/unexpected, 1 = illegal instruction,
+ *         2 = illegal bytecode
+ */
+uint8_t nes_cpu_error(NES* nes);
+
+#endif
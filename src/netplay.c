@@ -0,0 +1,316 @@
+/**
+ * @file netplay.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "netplay.h"
+
+NetplayTransport* transport = NULL;
+NetplayStats stats;
+FILE* statsLog = NULL;
+
+void(*saveCallback)(void*);
+void(*loadCallback)(void*);
+void(*runCallback)(uint8_t*, bool);
+
+uint8_t localPort = 0;
+uint32_t currentFrame = 0;
+
+// input history, indexed by frame % NETPLAY_HISTORY
+uint8_t localInputs[NETPLAY_HISTORY];
+uint8_t remoteInputs[NETPLAY_HISTORY];
+uint32_t remoteFrames[NETPLAY_HISTORY];
+uint8_t predictedInputs[NETPLAY_HISTORY];
+
+// highest frame for which every remote input has arrived (+1)
+uint32_t confirmedFrames = 0;
+uint32_t earliestMispredict = UINT32_MAX;
+
+// snapshots taken at the start of each frame, indexed by frame % (NETPLAY_MAX_ROLLBACK + 1)
+uint8_t* snapshots[NETPLAY_MAX_ROLLBACK + 1];
+
+/* TRANSPORTS */
+
+static void netplay_enqueue(NetplayTransport* t, NetplayPacket* packet) {
+  if (t->queueCount >= NETPLAY_QUEUE_SIZE) return;
+  NetplayQueueEntry* entry = &t->queue[t->queueCount++];
+  entry->packet = *packet;
+  entry->releaseTime = netplay_now() + t->latencyUsec + (t->jitterUsec ? (rand() % t->jitterUsec) : 0);
+}
+
+static bool netplay_loopbackSend(NetplayTransport* t, NetplayPacket* packet) {
+  // the stand-in peer plays whatever it is sent
+  netplay_enqueue(t, packet);
+  return true;
+}
+
+static void netplay_loopbackPoll(NetplayTransport* t) {
+  // everything is already queued on send
+}
+
+static bool netplay_unixSend(NetplayTransport* t, NetplayPacket* packet) {
+  uint8_t buf[NETPLAY_PACKET_BYTES];
+  buf[0] = packet->frame & BIT_FILL_8;
+  buf[1] = (packet->frame >> 8) & BIT_FILL_8;
+  buf[2] = (packet->frame >> 16) & BIT_FILL_8;
+  buf[3] = (packet->frame >> 24) & BIT_FILL_8;
+  buf[4] = packet->input;
+  uint8_t sent = 0;
+  while (sent < NETPLAY_PACKET_BYTES) {
+    ssize_t n = send(t->fd, buf + sent, NETPLAY_PACKET_BYTES - sent, MSG_NOSIGNAL);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+    if (n <= 0) return false;
+    sent += n;
+  }
+  return true;
+}
+
+static void netplay_unixPoll(NetplayTransport* t) {
+  // move whatever has arrived into the delay queue
+  uint8_t buf[NETPLAY_PACKET_BYTES * 32];
+  ssize_t n;
+  while ((n = recv(t->fd, buf, sizeof(buf), 0)) > 0) {
+    for (ssize_t i = 0; i < n; i++) {
+      t->partial[t->partialCount++] = buf[i];
+      if (t->partialCount == NETPLAY_PACKET_BYTES) {
+        NetplayPacket packet;
+        packet.frame = (uint32_t)t->partial[0] | ((uint32_t)t->partial[1] << 8) | ((uint32_t)t->partial[2] << 16) | ((uint32_t)t->partial[3] << 24);
+        packet.input = t->partial[4];
+        netplay_enqueue(t, &packet);
+        t->partialCount = 0;
+      }
+    }
+  }
+}
+
+bool netplay_openLoopback(NetplayTransport* t, uint32_t latencyMs, uint32_t jitterMs) {
+  memset(t, 0, sizeof(NetplayTransport));
+  t->fd = -1;
+  t->latencyUsec = latencyMs * 1000;
+  t->jitterUsec = jitterMs * 1000;
+  t->send = &netplay_loopbackSend;
+  t->poll = &netplay_loopbackPoll;
+  return true;
+}
+
+bool netplay_openUnix(NetplayTransport* t, char* path, bool host, uint32_t latencyMs, uint32_t jitterMs) {
+  memset(t, 0, sizeof(NetplayTransport));
+  t->latencyUsec = latencyMs * 1000;
+  t->jitterUsec = jitterMs * 1000;
+  t->send = &netplay_unixSend;
+  t->poll = &netplay_unixPoll;
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) return false;
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+
+  if (host) {
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0) {
+      close(fd);
+      return false;
+    }
+    t->fd = accept(fd, NULL, NULL);
+    close(fd);
+    unlink(path);
+    if (t->fd < 0) return false;
+  } else {
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+      close(fd);
+      return false;
+    }
+    t->fd = fd;
+  }
+
+  fcntl(t->fd, F_SETFL, fcntl(t->fd, F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+void netplay_closeTransport(NetplayTransport* t) {
+  if (t->fd >= 0) close(t->fd);
+  t->fd = -1;
+  t->queueCount = 0;
+}
+
+bool netplay_receive(NetplayTransport* t, NetplayPacket* packet) {
+  t->poll(t);
+
+  // release the packet which has waited out its delay the earliest
+  uint64_t now = netplay_now();
+  int16_t next = -1;
+  for (uint16_t i = 0; i < t->queueCount; i++) {
+    if (t->queue[i].releaseTime <= now && (next < 0 || t->queue[i].releaseTime < t->queue[next].releaseTime)) {
+      next = i;
+    }
+  }
+  if (next < 0) return false;
+
+  *packet = t->queue[next].packet;
+  t->queue[next] = t->queue[t->queueCount - 1];
+  t->queueCount -= 1;
+  return true;
+}
+
+/* SESSION */
+
+void netplay_init(NetplayTransport* t, uint8_t localPlayer, uint32_t stateSize, void(*save)(void*), void(*load)(void*), void(*run)(uint8_t*, bool)) {
+  transport = t;
+  localPort = localPlayer;
+  saveCallback = save;
+  loadCallback = load;
+  runCallback = run;
+
+  currentFrame = 0;
+  confirmedFrames = 0;
+  earliestMispredict = UINT32_MAX;
+  memset(&stats, 0, sizeof(stats));
+  memset(localInputs, 0, sizeof(localInputs));
+  memset(remoteInputs, 0, sizeof(remoteInputs));
+  memset(predictedInputs, 0, sizeof(predictedInputs));
+  for (int i = 0; i < NETPLAY_HISTORY; i++) {
+    remoteFrames[i] = UINT32_MAX;
+  }
+  for (int i = 0; i <= NETPLAY_MAX_ROLLBACK; i++) {
+    snapshots[i] = malloc(stateSize);
+  }
+}
+
+void netplay_receivePackets() {
+  NetplayPacket packet;
+  while (netplay_receive(transport, &packet)) {
+    // ignore anything that's already been confirmed or is absurdly far ahead
+    if (packet.frame < confirmedFrames || packet.frame >= confirmedFrames + NETPLAY_HISTORY) continue;
+
+    uint8_t slot = packet.frame % NETPLAY_HISTORY;
+    remoteInputs[slot] = packet.input;
+    remoteFrames[slot] = packet.frame;
+
+    // a frame which already ran with the wrong guess must be re-run
+    if (packet.frame < currentFrame && predictedInputs[slot] != packet.input && packet.frame < earliestMispredict) {
+      earliestMispredict = packet.frame;
+    }
+  }
+
+  while (remoteFrames[confirmedFrames % NETPLAY_HISTORY] == confirmedFrames) {
+    confirmedFrames += 1;
+  }
+}
+
+void netplay_frameInputs(uint32_t frame, uint8_t* inputs) {
+  uint8_t slot = frame % NETPLAY_HISTORY;
+  uint8_t remote;
+  if (remoteFrames[slot] == frame) {
+    remote = remoteInputs[slot];
+  } else {
+    // assume the remote player is still holding the same buttons
+    remote = (confirmedFrames > 0) ? remoteInputs[(confirmedFrames - 1) % NETPLAY_HISTORY] : 0;
+  }
+  predictedInputs[slot] = remote;
+  inputs[localPort] = localInputs[slot];
+  inputs[localPort ^ 1] = remote;
+}
+
+bool netplay_runFrame(uint8_t localInput) {
+  uint8_t inputs[2];
+
+  // share local input before anything else so the peer gets it sooner
+  localInputs[currentFrame % NETPLAY_HISTORY] = localInput;
+  NetplayPacket packet = { currentFrame, localInput };
+  if (!transport->send(transport, &packet)) return false;
+
+  netplay_receivePackets();
+
+  // don't run further ahead than can be rolled back
+  uint64_t stallStart = netplay_now();
+  while (currentFrame >= confirmedFrames + NETPLAY_MAX_ROLLBACK) {
+    if (netplay_now() - stallStart > NETPLAY_TIMEOUT_USEC) return false;
+    usleep(500);
+    netplay_receivePackets();
+  }
+  stats.stallUsec += netplay_now() - stallStart;
+
+  stats.frame = currentFrame;
+  stats.rollbackDepth = 0;
+  stats.resimUsec = 0;
+
+  // restore the last correct frame and re-simulate up to the present
+  if (earliestMispredict < currentFrame) {
+    uint64_t resimStart = netplay_now();
+    uint32_t frame = earliestMispredict;
+    loadCallback(snapshots[frame % (NETPLAY_MAX_ROLLBACK + 1)]);
+    for (; frame < currentFrame; frame++) {
+      if (frame != earliestMispredict) saveCallback(snapshots[frame % (NETPLAY_MAX_ROLLBACK + 1)]);
+      netplay_frameInputs(frame, inputs);
+      runCallback(inputs, false);
+    }
+
+    stats.rollbackDepth = currentFrame - earliestMispredict;
+    stats.resimUsec = netplay_now() - resimStart;
+    stats.rollbackCount += 1;
+    stats.totalResimUsec += stats.resimUsec;
+    if (stats.rollbackDepth > stats.maxRollbackDepth) stats.maxRollbackDepth = stats.rollbackDepth;
+  }
+  earliestMispredict = UINT32_MAX;
+
+  // run the present frame
+  saveCallback(snapshots[currentFrame % (NETPLAY_MAX_ROLLBACK + 1)]);
+  netplay_frameInputs(currentFrame, inputs);
+  runCallback(inputs, true);
+
+  if (statsLog != NULL) {
+    fprintf(statsLog, "%u,%u,%u\n", stats.frame, stats.rollbackDepth, stats.resimUsec);
+  }
+
+  currentFrame += 1;
+  return true;
+}
+
+void netplay_setStatsLog(FILE* fp) {
+  statsLog = fp;
+  if (statsLog != NULL) fprintf(statsLog, "frame,rollback_depth,resim_usec\n");
+}
+
+NetplayStats* netplay_getStats() {
+  return &stats;
+}
+
+void netplay_kill() {
+  if (transport == NULL) return;
+  netplay_closeTransport(transport);
+  transport = NULL;
+  for (int i = 0; i <= NETPLAY_MAX_ROLLBACK; i++) {
+    free(snapshots[i]);
+    snapshots[i] = NULL;
+  }
+  if (statsLog != NULL) fflush(statsLog);
+}
+
+uint64_t netplay_now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+}
@@ -0,0 +1,211 @@
+/**
+ * @file netplay.h
+ * @author Noah Sadir (development.noahsadir@gmail.com)
+ * @brief Two-player rollback netplay
+ * @version 1.0
+ * @date 2026-10-19
+ * 
+ * @copyright Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include "globalflags.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/**
+ * @brief Furthest the local player may run ahead of the last confirmed
+ *        remote input. This is also the deepest possible rollback.
+ */
+#define NETPLAY_MAX_ROLLBACK 8
+
+/**
+ * @brief Number of frames of input history kept (power of 2)
+ */
+#define NETPLAY_HISTORY 64
+
+/**
+ * @brief Number of packets a transport can hold back to simulate latency
+ */
+#define NETPLAY_QUEUE_SIZE 256
+
+/**
+ * @brief Give up on the session after this long without remote input
+ */
+#define NETPLAY_TIMEOUT_USEC 5000000
+
+/**
+ * @brief Size of a packet on the wire (frame number + input)
+ */
+#define NETPLAY_PACKET_BYTES 5
+
+typedef struct {
+  uint32_t frame;
+  uint8_t input;
+} NetplayPacket;
+
+typedef struct {
+  NetplayPacket packet;
+  uint64_t releaseTime;
+} NetplayQueueEntry;
+
+typedef struct NetplayTransport {
+  bool (*send)(struct NetplayTransport* t, NetplayPacket* packet);
+  void (*poll)(struct NetplayTransport* t);
+  int fd;
+  uint32_t latencyUsec;
+  uint32_t jitterUsec;
+  NetplayQueueEntry queue[NETPLAY_QUEUE_SIZE];
+  uint16_t queueCount;
+  uint8_t partial[NETPLAY_PACKET_BYTES];
+  uint8_t partialCount;
+} NetplayTransport;
+
+typedef struct {
+  uint32_t frame;
+  uint8_t rollbackDepth;
+  uint32_t resimUsec;
+  uint8_t maxRollbackDepth;
+  uint32_t rollbackCount;
+  uint64_t totalResimUsec;
+  uint64_t stallUsec;
+} NetplayStats;
+
+/* TRANSPORTS */
+
+/**
+ * @brief Open an in-process loopback transport.
+ *        The stand-in peer mirrors every input it is sent back as its own,
+ *        so any change of local input is mispredicted and rolled back.
+ * 
+ * @param t the transport to initialize
+ * @param latencyMs the artificial one-way latency (milliseconds)
+ * @param jitterMs the maximum random extra delay (milliseconds)
+ * @return true on success
+ */
+bool netplay_openLoopback(NetplayTransport* t, uint32_t latencyMs, uint32_t jitterMs);
+
+/**
+ * @brief Open a transport over a UNIX domain socket.
+ *        The host waits for a peer to connect before returning.
+ * 
+ * @param t the transport to initialize
+ * @param path the socket path
+ * @param host true to listen, false to connect
+ * @param latencyMs the artificial one-way latency (milliseconds)
+ * @param jitterMs the maximum random extra delay (milliseconds)
+ * @return true on success
+ */
+bool netplay_openUnix(NetplayTransport* t, char* path, bool host, uint32_t latencyMs, uint32_t jitterMs);
+
+/**
+ * @brief Close a transport
+ * 
+ * @param t the transport
+ */
+void netplay_closeTransport(NetplayTransport* t);
+
+/**
+ * @brief Take the next packet whose (artificial) delay has elapsed
+ * 
+ * @param t the transport
+ * @param packet the output packet
+ * @return true if a packet was received
+ */
+bool netplay_receive(NetplayTransport* t, NetplayPacket* packet);
+
+/* SESSION */
+
+/**
+ * @brief Start a netplay session.
+ *        Both peers must start from the same power-on state.
+ * 
+ * @param t the connected transport
+ * @param localPlayer the controller port of the local player (0 or 1)
+ * @param stateSize the size of a machine snapshot (in bytes)
+ * @param save the callback which takes a machine snapshot
+ * @param load the callback which restores a machine snapshot
+ * @param run the callback which runs a frame with both controller inputs,
+ *            optionally without rendering
+ */
+void netplay_init(NetplayTransport* t, uint8_t localPlayer, uint32_t stateSize, void(*save)(void*), void(*load)(void*), void(*run)(uint8_t*, bool));
+
+/**
+ * @brief Run the next frame, rolling back first if remote input arrived
+ *        which contradicts what was predicted.
+ * 
+ * @param localInput the local player's JoypadButton flags
+ * @return false if the session timed out
+ */
+bool netplay_runFrame(uint8_t localInput);
+
+/**
+ * @brief Log rollback depth and re-simulation cost of every frame (CSV)
+ * 
+ * @param fp the file to log to, or NULL to disable
+ */
+void netplay_setStatsLog(FILE* fp);
+
+/**
+ * @brief Get rollback statistics
+ * 
+ * @return NetplayStats* the statistics of the last frame and the session
+ */
+NetplayStats* netplay_getStats();
+
+/**
+ * @brief End the session and free its snapshots
+ */
+void netplay_kill();
+
+/**
+ * @brief Drain the transport and note the earliest mispredicted frame
+ */
+void netplay_receivePackets();
+
+/**
+ * @brief Get both controller inputs for a frame, predicting the remote
+ *        input (last confirmed) if it hasn't arrived yet
+ * 
+ * @param frame the frame number
+ * @param inputs the output inputs (one per port)
+ */
+void netplay_frameInputs(uint32_t frame, uint8_t* inputs);
+
+/**
+ * @brief Get the current time
+ * 
+ * @return uint64_t the time (microseconds)
+ */
+uint64_t netplay_now();
+
+#endif
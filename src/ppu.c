@@ -23,279 +23,1348 @@
  */
 
 #include "ppu.h"
+#include "machine.h"
 
-PPURegisters ppureg;
-
-uint16_t addressBuffer = 0x0000;
-uint8_t scrollX = 0;
-uint8_t scrollY = 0;
-uint8_t dataBuffer = 0x00;
-bool addressLatch = false;
-bool scrollLatch = false;
-bool triggerSpriteZero = false;
-bool verticalMirroring = false;
-bool didRenderFrame = false;
-
-uint8_t oamRAM[0x00FF];
-uint8_t vidRAM[0x2000];
-uint8_t paletteRAM[32];
-uint8_t* chrROM;
-uint32_t bitmap[DISPLAY_BITMAP_SIZE];
+#if PPU_SIMD && (defined(__x86_64__) || defined(__i386__))
+#define PPU_SIMD_X86 TRUE
+#include <immintrin.h>
+#else
+#define PPU_SIMD_X86 FALSE
+#endif
+
+
+machine_local bool verticalMirroring = false;
+
+machine_local uint8_t oamRAM[0x0100];
+machine_local uint8_t vidRAM[0x2000];
+machine_local uint8_t paletteRAM[32];
+machine_local uint8_t* chrROM;
+machine_local uint8_t bitmap[DISPLAY_BITMAP_SIZE];
+machine_local uint8_t lineEmphasis[DISPLAY_HEIGHT];
+
+// one bit per pixel of each line, set where the background drawn there is
+// opaque (bit x % 64 of word x / 64 is pixel x)
+machine_local uint64_t lineOpaque[DISPLAY_HEIGHT][4];
 uint32_t debugbmp[DISPLAY_PIXEL_SIZE];
-uint8_t chrCache[512][64];
+machine_local uint16_t chrBankCount;
+machine_local bool chrWritable;
+
+// the 1 KB bank of CHR each window of $0000-$1FFF shows, as bytes and as
+// the cache slot holding its decoded tiles
+machine_local uint8_t* chrMap[8];
+machine_local uint64_t (*chrWindow[8])[2][8];
+machine_local uint8_t chrWindowSlot[8];
+
+// decoded banks: chrCache[slot][tile][mirrored][row] is 8 color numbers
+// (0-3), byte n being pixel n from the left (or right, when mirrored)
+machine_local uint64_t chrCache[PPU_CHR_CACHE_BANKS][64][2][8];
+machine_local int32_t chrCacheBank[PPU_CHR_CACHE_BANKS]; // or -1 if free
+machine_local uint32_t chrCacheUsed[PPU_CHR_CACHE_BANKS];
+machine_local uint32_t chrCacheClock;
+// the CHR ROM the cache was decoded from, and its cartridge's ID
+machine_local uint8_t* chrDecodedFrom = NULL;
+machine_local uint32_t chrDecodedID = 0;
+
+// tiles of each slot to decode before they're next drawn, one bit each,
+// and whether any bit is set
+machine_local uint64_t chrDirty[PPU_CHR_CACHE_BANKS];
+machine_local bool chrCacheStale;
+
+// bumped whenever the decoded tiles seen through the windows change
+machine_local uint32_t chrGeneration;
+// bumped only when a window shows a different slot
+machine_local uint32_t chrMapGeneration;
+// tile IDs (0-511, through the windows) decoded again since the background
+// cache was last updated, one bit each
+machine_local uint64_t chrChangedTiles[8];
+
+// the four nametables drawn side by side (2 x 2) for the frame renderer,
+// as background indices ((palette << 2) | color) so palette writes don't
+// affect it; one bit per tile (960 per nametable) to draw again
+machine_local uint8_t backgroundCache[480][512];
+machine_local uint64_t backgroundDirty[60];
+machine_local bool backgroundStale;
+machine_local uint16_t backgroundBank;
+machine_local uint32_t backgroundMapGeneration;
+
+
+machine_local PPURenderMode ppuMode;
+machine_local PPUDotState dot;
+machine_local PPUTileStrip strip;
+machine_local PPUSpriteLists spriteLists;
+
+// bumped by every nametable write
+machine_local uint32_t vramGeneration;
+
+// chosen for the host CPU by ppu_selectPaletteLine, once per thread
+static machine_local void(*paletteLine)(uint8_t*, const uint8_t*, const uint8_t*);
+static machine_local void(*colorLine)(uint32_t*, const uint8_t*, const uint32_t*);
+
+machine_local void(*callback)(uint8_t*);
+machine_local uint8_t(*readCPUDirect)(uint16_t);
+
+/* PRIVATE METHODS - NOT INTENDED FOR EXTERNAL USE */
+
+/**
+ * @brief Empty the cache of decoded CHR and show banks 0-7 in the windows
+ */
+static void ppu_resetChrCache();
+
+/**
+ * @brief Decode a tile of the bank a cache slot holds
+ * 
+ * @param slot the slot of chrCache
+ * @param tile the tile within the bank (0-63)
+ */
+static force_inline void ppu_decodeChrTile(uint8_t slot, uint8_t tile);
+
+/**
+ * @brief Read a byte of the pattern tables through the CHR windows
+ * 
+ * @param address the address ($0000-$1FFF)
+ * @return uint8_t the byte
+ */
+static force_inline uint8_t ppu_readChr(uint16_t address);
+
+/**
+ * @brief Decode the tiles of newly shown banks, and of CHR RAM written
+ *        since they were last drawn
+ */
+static force_inline void ppu_decodeDirtyTiles();
+
+/**
+ * @brief Draw every tile of the nametables into the background cache
+ *        before the next frame
+ */
+static force_inline void ppu_invalidateBackground();
+
+/**
+ * @brief Mark the tiles a nametable or attribute byte affects, so they're
+ *        drawn into the background cache again before the next frame
+ * 
+ * @param address the address in the nametables ($0000-$0FFF)
+ */
+static force_inline void ppu_markBackgroundDirty(uint16_t address);
+
+/**
+ * @brief Draw a nametable tile into the background cache
+ * 
+ * @param index the tile (960 per nametable, nametable 0 first)
+ * @param bankOffset the first tile ID of the background pattern table
+ */
+static force_inline void ppu_renderBackgroundTile(uint16_t index, uint16_t bankOffset);
+
+/**
+ * @brief Mark the background cache tiles whose tile IDs were decoded again
+ *        (after CHR RAM writes) since the cache was last updated
+ * 
+ * @param bankOffset the first tile ID of the background pattern table
+ */
+static force_inline void ppu_markChangedTiles(uint16_t bankOffset);
+
+/**
+ * @brief Draw the tiles of the background cache which are out of date:
+ *        those written or whose CHR was decoded again since the last frame,
+ *        or all of them after the pattern table or its banks changed
+ * 
+ * @param bankOffset the first tile ID of the background pattern table
+ */
+static force_inline void ppu_updateBackgroundCache(uint16_t bankOffset);
+
+/**
+ * @brief Fetch the 33 background tiles (and their palettes) which a
+ *        scanline of PPURENDER_SCANLINE shows
+ * 
+ * @param tiles the 33 tile IDs to fill, including the bank
+ * @param attributes the 33 palettes to fill
+ * @param nametable base address of the nametable
+ * @param bankOffset the first tile ID of the background pattern table
+ * @param coarseX the tile column scrolled to
+ * @param adjRow the nametable row
+ */
+static force_inline void ppu_fetchTileRow(uint16_t* tiles, uint8_t* attributes, uint16_t nametable, uint16_t bankOffset, uint8_t coarseX, uint8_t adjRow);
+
+/**
+ * @brief Sort the sprites into the scanlines they cover, keeping the first
+ *        8 of each line (does nothing unless OAM or the sprite size changed)
+ */
+static void ppu_evaluateSprites();
+
+/**
+ * @brief Draw the sprites of a scanline over its background, resolving
+ *        priority against the line's background opacity mask
+ * 
+ * @param y the scanline
+ * @param spriteBankOffset the first tile ID of the 8x8 sprite pattern table
+ * @param detectSpriteZero whether an opaque pixel of sprite zero over an
+ *                         opaque background pixel triggers a sprite zero
+ *                         hit on the next scanline
+ * @param draw whether to write the sprites' pixels; if not, only sprite
+ *             zero (the line's first sprite) is looked at
+ */
+static force_inline void ppu_drawSpriteLine(uint8_t y, uint16_t spriteBankOffset, bool detectSpriteZero, bool draw);
+
+/**
+ * @brief Find which of 8 palette indices are opaque
+ * 
+ * @param pixels the 8 indices, as from ppu_decodeTileRow
+ * @return uint8_t bit n set if pixel n is opaque
+ */
+static force_inline uint8_t ppu_opaqueBits(const uint8_t* pixels);
+
+/**
+ * @brief Get 8 bits of a 256-pixel line mask
+ * 
+ * @param mask the 4 words of the mask
+ * @param x the first pixel
+ * @return uint8_t bit n for pixel x + n (0 past the end of the line)
+ */
+static force_inline uint8_t ppu_getMaskBits(const uint64_t* mask, uint8_t x);
+
+/**
+ * @brief Set 8 bits of a 256-pixel line mask
+ * 
+ * @param mask the 4 words of the mask
+ * @param x the first pixel
+ * @param bits bit n for pixel x + n (must be 0 past the end of the line)
+ */
+static force_inline void ppu_setMaskBits(uint64_t* mask, uint8_t x, uint8_t bits);
+
+/**
+ * @brief Record which pixels of a scanline's background are opaque,
+ *        clipping the left 8 pixels unless PPUMASK_BKGLEFT is set
+ * 
+ * @param y the scanline
+ * @param line the DISPLAY_WIDTH background indices, 0-15
+ */
+static force_inline void ppu_maskBackgroundLine(uint8_t y, const uint8_t* line);
+
+/**
+ * @brief Draw a scanline of background and record which of its pixels are
+ *        opaque (with ppu_maskBackgroundLine)
+ * 
+ * @param y the scanline
+ * @param line the DISPLAY_WIDTH background indices, 0-15
+ * @param palette the background palette from ppu_loadBackgroundPalette
+ */
+static force_inline void ppu_drawBackgroundLine(uint8_t y, const uint8_t* line, const uint8_t* palette);
+
+/**
+ * @brief Fill a scanline with the backdrop, for when background is hidden
+ * 
+ * @param y the scanline
+ */
+static force_inline void ppu_clearBackgroundLine(uint8_t y);
+
+/**
+ * @brief Decode one row of a tile into 8 palette indices in screen order,
+ *        0 for transparent pixels and (palette << 2) | color otherwise.
+ *        The row is a single load from the decoded bank; to flip vertically, pass
+ *        7 - row.
+ * 
+ * @param out the 8 bytes to fill
+ * @param tileID the tile ID, including the bank
+ * @param row the row within the tile
+ * @param palette the palette of the tile
+ * @param flipHorizontally whether to mirror the row
+ */
+static force_inline void ppu_decodeTileRow(uint8_t* out, uint16_t tileID, uint8_t row, uint8_t palette, bool flipHorizontally);
+
+/**
+ * @brief Resolve the background half of palette RAM to palette indices
+ * 
+ * @param palette the 16 indices to fill; entry 0 of every palette is
+ *                the backdrop
+ */
+static force_inline void ppu_loadBackgroundPalette(uint8_t* palette);
+
+/**
+ * @brief Map a scanline of 4-bit background indices through palette RAM
+ *        (paletteLine points at the fastest version for the host)
+ * 
+ * @param dst the DISPLAY_WIDTH palette indices to write
+ * @param line the background indices, 0-15
+ * @param palette the 16 palette indices to look up
+ */
+static void ppu_paletteLineScalar(uint8_t* dst, const uint8_t* line, const uint8_t* palette);
+
+/**
+ * @brief Convert a scanline of palette indices to colors
+ *        (colorLine points at the fastest version for the host)
+ * 
+ * @param dst the DISPLAY_WIDTH pixels to write
+ * @param line the palette indices, 0-63
+ * @param palette the 64 colors to look up
+ */
+static void ppu_colorLineScalar(uint32_t* dst, const uint8_t* line, const uint32_t* palette);
+
+/**
+ * @brief Pick the palette and color lookups for the host CPU
+ */
+static void ppu_selectPaletteLine();
+
+/**
+ * @brief Draw a scanline
+ * 
+ * @param y the scanline to draw
+ */
+static force_inline void ppu_drawScanline(uint8_t y);
+
+/**
+ * @brief Draw an entire frame
+ */
+static force_inline void ppu_drawFrame();
+
+/**
+ * @brief Step the dot pipeline through part of the current scanline
+ * 
+ * @param from the first dot to run
+ * @param to the dot to stop before
+ */
+static void ppu_runDots(uint16_t from, uint16_t to);
+
+/**
+ * @brief Run dots 1-256 of the current scanline in one pass, leaving the
+ *        pipeline as ppu_runDots would have
+ * 
+ * @param visible whether to draw the pixels (false on the pre-render line)
+ */
+static void ppu_runLineFast(bool visible);
+
+/**
+ * @brief Finish the current scanline and move on to the next
+ * 
+ * @param lineLength the number of dots in the scanline
+ */
+static void ppu_endDotScanline(uint16_t lineLength);
+
+/**
+ * @brief Draw the current scanline up to the current dot, before a register
+ *        access changes what the rest of it looks like
+ */
+static force_inline void ppu_catchUpDots();
 
-uint64_t ppuCycles = 0;
-uint64_t ppuFrames = 0;
-uint16_t scanline = 0;
-uint16_t spriteZeroScanline = 0;
-uint16_t initialScrollX = 0;
-uint16_t initialScrollY = 0;
-uint16_t scanlineCycleCounter = 0;
+/**
+ * @brief Draw one pixel of the current scanline from its background pixel
+ *        and the scanline's sprites
+ * 
+ * @param x the x location
+ * @param bgPixel the 2-bit background pixel
+ * @param bgPalette the background palette
+ */
+static force_inline void ppu_outputDot(uint8_t x, uint8_t bgPixel, uint8_t bgPalette);
+
+/**
+ * @brief Find the sprites on the next scanline and fetch their patterns
+ * 
+ * @param line the next scanline
+ */
+static void ppu_evaluateDotSprites(uint16_t line);
 
-void(*callback)(uint32_t*);
-uint8_t(*readCPUDirect)(uint16_t);
+/**
+ * @brief Move v to the next tile column
+ * 
+ * @param v the VRAM address
+ * @return uint16_t the new VRAM address
+ */
+static force_inline uint16_t ppu_incrementScrollX(uint16_t v);
+
+/**
+ * @brief Move v to the next pixel row
+ * 
+ * @param v the VRAM address
+ * @return uint16_t the new VRAM address
+ */
+static force_inline uint16_t ppu_incrementScrollY(uint16_t v);
 
-void ppu_init(uint8_t* crom, bool vmirror, uint8_t(*r)(uint16_t), void(*c)(uint32_t*)) {
+/**
+ * @brief Fetch the palette of the tile v points to
+ * 
+ * @param v the VRAM address
+ * @return uint8_t the 2-bit palette
+ */
+static force_inline uint8_t ppu_fetchAttribute(uint16_t v);
+
+/**
+ * @brief Fetch one plane of a background tile's row at v's fine Y
+ * 
+ * @param tile the tile ID
+ * @param v the VRAM address
+ * @param plane 0 for the low plane, 8 for the high plane
+ * @return uint8_t the row, leftmost pixel in bit 7
+ */
+static force_inline uint8_t ppu_fetchPattern(uint8_t tile, uint16_t v, uint8_t plane);
+
+/**
+ * @brief Mirror a pattern row
+ * 
+ * @param b the row
+ * @return uint8_t the row, reversed
+ */
+static force_inline uint8_t ppu_reverseBits(uint8_t b);
+
+/**
+ * @brief Perform write operation at mapped address.
+ *        Note that read operations are simply done through
+ *        direct array access.
+ * 
+ * @param address the address to write to
+ * @param data the data to write
+ */
+static force_inline void ppu_writeMem(uint16_t address, uint8_t data);
+
+void ppu_insertCartridge(uint8_t* crom, uint32_t chrSize, uint32_t cartID, bool cram, bool vmirror, uint8_t(*r)(uint16_t), void(*c)(uint8_t*), PPURenderMode mode) {
+  // the same cartridge as last time (switching back to its machine) keeps
+  // its decoded banks
+  bool sameCart = !cram && cartID != 0 && cartID == chrDecodedID && crom == chrDecodedFrom;
   callback = c;
+  ppuMode = mode;
   chrROM = crom;
+  chrBankCount = chrSize / 1024;
+  chrWritable = cram;
   readCPUDirect = r;
   verticalMirroring = vmirror;
-  ppureg.control     = 0x00;
-  ppureg.mask        = 0x00;
-  ppureg.ppuStatus   = 0x00;
-  ppureg.oamaddr     = 0x00;
-  ppureg.oamdata     = 0x00;
-  ppureg.scroll      = 0x00;
-  ppureg.ppuaddr     = 0x00;
-  ppureg.ppudata     = 0x00;
-  ppureg.oamdma      = 0x00;
-  ppu_generateChrCache();
-  for (int i = 0; i < DISPLAY_BITMAP_SIZE; i++) {
-    bitmap[i] = 0;
-  }
-}
-
-void ppu_runCycles(uint32_t cycleCount) {
-  #if (PPU_IMMEDIATE_CATCHUP)
-  ppuCycles += cycleCount;
-  if (ppuCycles >= 341) {
+  if (!sameCart) {
+    ppu_resetChrCache();
+    chrDecodedFrom = crom;
+    chrDecodedID = cartID;
+  }
+  if (colorLine == NULL) ppu_selectPaletteLine();
+}
+
+void ppu_init() {
+  hot.ppureg.control     = 0x00;
+  hot.ppureg.mask        = 0x00;
+  hot.ppureg.ppuStatus   = 0x00;
+  hot.ppureg.oamaddr     = 0x00;
+  hot.ppureg.oamdata     = 0x00;
+  hot.ppureg.scroll      = 0x00;
+  hot.ppureg.ppuaddr     = 0x00;
+  hot.ppureg.ppudata     = 0x00;
+  hot.ppureg.oamdma      = 0x00;
+  hot.addressBuffer = 0x0000;
+  hot.scrollX = 0;
+  hot.scrollY = 0;
+  hot.dataBuffer = 0x00;
+  hot.addressLatch = false;
+  hot.scrollLatch = false;
+  hot.triggerSpriteZero = false;
+  hot.didRenderFrame = false;
+  hot.renderingEnabled = true;
+  hot.ppuCycles = 0;
+  hot.ppuFrames = 0;
+  hot.scanline = 0;
+  hot.spriteZeroScanline = 0;
+  hot.initialScrollX = 0;
+  hot.initialScrollY = 0;
+  hot.scanlineCycleCounter = 0;
+  hot.loopyV = 0;
+  hot.loopyT = 0;
+  hot.fineX = 0;
+  hot.writeToggle = false;
+  hot.oddFrame = false;
+  hot.renderedDot = 0;
+  memset(&dot, 0, sizeof(dot));
+  memset(oamRAM, 0, sizeof(oamRAM));
+  memset(vidRAM, 0, sizeof(vidRAM));
+  memset(paletteRAM, 0, sizeof(paletteRAM));
+  ppu_invalidateBackground();
+  strip.valid = false;
+  spriteLists.stale = true;
+  // start out black, as the backdrop usually is
+  memset(bitmap, 0x0F, sizeof(bitmap));
+  memset(lineEmphasis, 0, sizeof(lineEmphasis));
+}
+
+void ppu_runScanlineCycles(uint32_t cycleCount) {
+  hot.ppuCycles += cycleCount;
+  if (hot.ppuCycles >= 341) {
     // render scanlines
-    if (scanline >= 0 && scanline <= 239) {
-      ppu_drawScanline(scanline);
+    if (hot.scanline <= 239) {
+      ppu_drawScanline(hot.scanline);
     }
 
     // render all at once rather than by scanline
-    if (scanline == 240) {
+    if (hot.scanline == 240) {
       callback(bitmap);
-      ppuFrames += 1;
+      hot.ppuFrames += 1;
     }
 
     // start vblank
-    if (scanline == 241) {
+    if (hot.scanline == 241) {
       ppu_setStatusFlag(PPUSTAT_VBLKSTART, true);
     }
 
     // end vblank
-    if (scanline == 261) {
+    if (hot.scanline == 261) {
       ppu_setStatusFlag(PPUSTAT_VBLKSTART, false);
       ppu_setStatusFlag(PPUSTAT_SPRITEZRO, false);
-      scanline = 0;
+      ppu_setStatusFlag(PPUSTAT_SPRITEOVF, false);
+      hot.scanline = 0;
     } else {
-      scanline += 1;
+      hot.scanline += 1;
     }
-    ppuCycles -= 341;
+    hot.ppuCycles -= 341;
   }
-  #else
-  ppuCycles += cycleCount;
-  scanlineCycleCounter += cycleCount;
+}
+
+void ppu_runFrameCycles(uint32_t cycleCount) {
+  hot.ppuCycles += cycleCount;
+  hot.scanlineCycleCounter += cycleCount;
 
   // ensures 1-scanline delay for sprite zero hit
-  if (triggerSpriteZero == true) {
+  if (hot.triggerSpriteZero == true) {
     ppu_setStatusFlag(PPUSTAT_SPRITEZRO, true);
-    triggerSpriteZero = false;
+    hot.triggerSpriteZero = false;
   }
   
-  if (ppuCycles >= PPU_FRAME_CYCLES) {
+  if (hot.ppuCycles >= PPU_FRAME_CYCLES) {
     // end of frame; reset vblank and sprite zero hit
-    ppureg.ppuStatus = 0x00;
-    ppuCycles -= PPU_FRAME_CYCLES;
-    didRenderFrame = false;
-    scrollX = 0;
-    scrollY = 0;
-    initialScrollX = 0;
-    initialScrollY = 0;
-  } else if (!didRenderFrame && ppuCycles >= PPU_SCANLINE_CYCLES * DISPLAY_HEIGHT) {
+    hot.ppureg.ppuStatus = 0x00;
+    hot.ppuCycles -= PPU_FRAME_CYCLES;
+    hot.didRenderFrame = false;
+    hot.scrollX = 0;
+    hot.scrollY = 0;
+    hot.initialScrollX = 0;
+    hot.initialScrollY = 0;
+  } else if (!hot.didRenderFrame && hot.ppuCycles >= PPU_SCANLINE_CYCLES * DISPLAY_HEIGHT) {
     // render all scanlines all at once and start vblank
-    ppu_drawFrame();
+    if (hot.renderingEnabled) ppu_drawFrame();
     callback(bitmap);
-    didRenderFrame = true;
+    hot.didRenderFrame = true;
     ppu_setStatusFlag(PPUSTAT_VBLKSTART, true);
   }
 
-  // check for sprite zero hit
-  uint16_t sl = ppuCycles / 341;
-  if (!triggerSpriteZero && ppu_getMaskFlag(PPUMASK_SHOWBKG) && ppu_getMaskFlag(PPUMASK_SHOWSPRIT) && oamRAM[0] <= sl && oamRAM[0] > sl - 8) {
-    triggerSpriteZero = true;
-    spriteZeroScanline = sl;
+  // check for sprite zero hit, from OAM Y alone (see ppu.h)
+  uint16_t sl = hot.ppuCycles / 341;
+  uint8_t spriteHeight = (hot.ppureg.control & PPUCTRL_SPRITESIZE) ? 16 : 8;
+  if (!hot.triggerSpriteZero && ppu_getMaskFlag(PPUMASK_SHOWBKG) && ppu_getMaskFlag(PPUMASK_SHOWSPRIT) && oamRAM[0] <= sl && oamRAM[0] > sl - spriteHeight) {
+    hot.triggerSpriteZero = true;
+    hot.spriteZeroScanline = sl;
+  }
+
+  // sprite overflow from the line it happens on, whether or not the frame
+  // will be drawn
+  if (sl < DISPLAY_HEIGHT && !ppu_getStatusFlag(PPUSTAT_SPRITEOVF) && (hot.ppureg.mask & (PPUMASK_SHOWBKG | PPUMASK_SHOWSPRIT))) {
+    ppu_evaluateSprites();
+    if (sl >= spriteLists.overflowLine) ppu_setStatusFlag(PPUSTAT_SPRITEOVF, true);
   }
 
   // store initial scroll values in case they're changed mid-scroll
   if (sl == 0) {
-    initialScrollX = scrollX;
-    initialScrollY = scrollY;
+    hot.initialScrollX = hot.scrollX;
+    hot.initialScrollY = hot.scrollY;
   }
-  #endif
 }
 
-static force_inline void ppu_setPixel(uint32_t color, int16_t x, int16_t y) {
-  if (x >= 0 && x < 256 && y >= 0 && y < 240) bitmap[(y * 256) + x] = color;
-}
+void ppu_runDotCycles(uint32_t cycleCount) {
+  while (true) {
+    // the pre-render line is a dot shorter on odd frames while rendering
+    uint16_t lineLength = 341;
+    if (hot.scanline == 261 && hot.oddFrame && (hot.ppureg.mask & (PPUMASK_SHOWBKG | PPUMASK_SHOWSPRIT))) lineLength = 340;
+    if (hot.ppuCycles >= lineLength) {
+      ppu_endDotScanline(lineLength);
+      continue;
+    }
+    if (cycleCount == 0) break;
 
-static force_inline void ppu_drawTile(bool flipHorizontally, bool flipVertically, bool transparent, bool behindBackground, bool background, uint16_t tileID, uint8_t palette, uint16_t x, uint16_t y) {
-  for (uint16_t row = 0; row < 8; row++) {
-    for (uint16_t col = 0; col < 8; col++) {
-      uint8_t color = chrCache[tileID][(row * 8) + col];
-      if ((transparent && color == 0)) continue;
-      if (behindBackground) {
-        // before drawing behind-background sprite, check if this pixel
-        // is same as "clear" color (palette entry 0)
-        // not 100% accurate, but good enough for now
-        int16_t bmpX = x + (flipHorizontally ? col : (7 - col));
-        int16_t bmpY = y + (flipVertically ? (7 - row) : row);
-        if (bitmap[(bmpY * 256) + bmpX] == colors[paletteRAM[0]]) {
-          ppu_setPixel(colors[paletteRAM[(palette << 2) + color]], bmpX, bmpY);
-        }
-      } else if (background && color == 0) {
-        ppu_setPixel(colors[paletteRAM[0]], x + (flipHorizontally ? col : (7 - col)), y + (flipVertically ? (7 - row) : row));
-      } else {
-        ppu_setPixel(colors[paletteRAM[(palette << 2) + color]], x + (flipHorizontally ? col : (7 - col)), y + (flipVertically ? (7 - row) : row));
+    uint32_t step = lineLength - hot.ppuCycles;
+    if (step > cycleCount) step = cycleCount;
+
+    // vblank starts and ends on dot 1
+    if (hot.ppuCycles <= 1 && hot.ppuCycles + step > 1) {
+      if (hot.scanline == 241) {
+        ppu_setStatusFlag(PPUSTAT_VBLKSTART, true);
+      } else if (hot.scanline == 261) {
+        hot.ppureg.ppuStatus &= ~(PPUSTAT_VBLKSTART | PPUSTAT_SPRITEZRO | PPUSTAT_SPRITEOVF);
       }
     }
+    hot.ppuCycles += step;
+    cycleCount -= step;
   }
 }
 
-void ppu_generateChrCache() {
-  // Storage of character data is very memory efficient, but also
-  // computationally expensive to decode.
-  // Since memory is cheap and abundant now, we can store it in a manner
-  // that's easier to read from on-the-fly
-  for (uint16_t tileID = 0; tileID < 512; tileID++) {
-    for (uint16_t row = 0; row < 8; row++) {
-      uint8_t high = chrROM[((tileID * 16) + row + 8) & 0x3FFF];
-      uint8_t low = chrROM[((tileID * 16) + row) & 0x3FFF];
-      for (uint16_t col = 0; col < 8; col++) {
-        uint8_t color = ((high & 1) << 1) | (low & 1);
-        high >>= 1;
-        low >>= 1;
-        chrCache[tileID][(row * 8) + col] = color;
-      }
+static void ppu_endDotScanline(uint16_t lineLength) {
+  if (hot.scanline < 240 || hot.scanline == 261) {
+    if (hot.renderedDot <= 1) {
+      // nothing touched the PPU during this scanline
+      ppu_runLineFast(hot.scanline < 240);
+      ppu_runDots(257, lineLength);
+    } else {
+      ppu_runDots(hot.renderedDot, lineLength);
     }
   }
+  hot.renderedDot = 0;
+  hot.ppuCycles -= lineLength;
+
+  if (hot.scanline == 239) {
+    callback(bitmap);
+    hot.ppuFrames += 1;
+  }
+  if (hot.scanline == 261) {
+    hot.scanline = 0;
+    hot.oddFrame = !hot.oddFrame;
+  } else {
+    hot.scanline += 1;
+  }
 }
 
-static force_inline void ppu_drawFrame() {
-  // decode nametable & attribute table
-  uint8_t nametables[4][960];
-  uint8_t attributeTables[4][960];
+static force_inline void ppu_catchUpDots() {
+  if ((hot.scanline < 240 || hot.scanline == 261) && hot.renderedDot < hot.ppuCycles) {
+    ppu_runDots(hot.renderedDot, hot.ppuCycles);
+    hot.renderedDot = hot.ppuCycles;
+  }
+}
 
-  uint16_t bankOffset = 256 * ppu_getControlFlag(PPUCTRL_BKGPATT);
-  uint16_t spriteBankOffset = 256 * ppu_getControlFlag(PPUCTRL_SPRITEPATT);
+static force_inline uint16_t ppu_incrementScrollX(uint16_t v) {
+  // wrap into the horizontally adjacent nametable
+  if ((v & 0x001F) == 31) return (v & ~0x001F) ^ 0x0400;
+  return v + 1;
+}
 
-  uint8_t nametableID = (((uint16_t) ppu_getControlFlag(PPUCTRL_NAMETABLE2)) << 1) | ((uint16_t) ppu_getControlFlag(PPUCTRL_NAMETABLE1));
-  
-  bool showBackground = ppu_getMaskFlag(PPUMASK_SHOWBKG);
-  bool showSprite = ppu_getMaskFlag(PPUMASK_SHOWSPRIT);
+static force_inline uint16_t ppu_incrementScrollY(uint16_t v) {
+  if ((v & 0x7000) != 0x7000) return v + 0x1000;
+  v &= ~0x7000;
+  uint16_t coarseY = (v & 0x03E0) >> 5;
+  if (coarseY == 29) {
+    // wrap into the vertically adjacent nametable
+    coarseY = 0;
+    v ^= 0x0800;
+  } else if (coarseY == 31) {
+    // attribute rows wrap without switching nametables
+    coarseY = 0;
+  } else {
+    coarseY += 1;
+  }
+  return (v & ~0x03E0) | (coarseY << 5);
+}
 
-  // render all nametables for simplicity's sake
-  for (int n = 0; n < 4; n++) {
-    for (int i = 0; i < 960; i++) {
-      uint8_t ntRow = i / 32;
-      uint8_t ntCol = i % 32;
+static force_inline uint8_t ppu_fetchAttribute(uint16_t v) {
+  uint8_t attributeByte = vidRAM[0x03C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07)];
+  if (v & 0x0040) attributeByte >>= 4;
+  if (v & 0x0002) attributeByte >>= 2;
+  return attributeByte & BIT_FILL_2;
+}
+
+static force_inline uint8_t ppu_readChr(uint16_t address) {
+  return chrMap[(address >> 10) & 7][address & 0x03FF];
+}
+
+static force_inline uint8_t ppu_fetchPattern(uint8_t tile, uint16_t v, uint8_t plane) {
+  uint16_t bank = (hot.ppureg.control & PPUCTRL_BKGPATT) ? 0x1000 : 0x0000;
+  return ppu_readChr(bank + (tile * 16) + ((v >> 12) & 7) + plane);
+}
+
+static force_inline uint8_t ppu_reverseBits(uint8_t b) {
+  b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+  b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+  return (b & 0xAA) >> 1 | (b & 0x55) << 1;
+}
 
-      // https://www.nesdev.org/wiki/PPU_attribute_tables
-      // There might be a simpler way to get palette value for tile
-      // but this is the best I could manage.
-      uint8_t attrByte = vidRAM[(0x400 * n) + 960 + ((ntRow / 4) * 8) + (ntCol / 4)];
-      uint8_t quadrantPalette = (attrByte >> ((((ntRow / 2) % 2) * 4) + (((ntCol / 2) % 2) * 2))) & BIT_FILL_2;
-      attributeTables[n][i] = quadrantPalette;
-      nametables[n][i] = vidRAM[(0x400 * n) + (ntRow * 32) + ntCol];
+static void ppu_evaluateDotSprites(uint16_t line) {
+  uint8_t height = (hot.ppureg.control & PPUCTRL_SPRITESIZE) ? 16 : 8;
+  dot.spriteCount = 0;
+  dot.spriteZeroInLine = false;
+  for (int i = 0; i < 256; i += 4) {
+    // sprites are drawn a scanline below their Y coordinate
+    int row = (int)line - (int)oamRAM[i] - 1;
+    if (row < 0 || row >= height) continue;
+    if (dot.spriteCount == 8) {
+      ppu_setStatusFlag(PPUSTAT_SPRITEOVF, true);
+      break;
     }
+
+    uint8_t tile = oamRAM[i + 1];
+    uint8_t attribute = oamRAM[i + 2];
+    if (attribute & 0x80) row = height - 1 - row;
+    uint16_t address;
+    if (height == 16) {
+      // 8x16 sprites pick their own bank with bit 0 of the tile
+      address = ((tile & 1) ? 0x1000 : 0x0000) + (((tile & 0xFE) + (row >> 3)) * 16) + (row & 7);
+    } else {
+      address = ((hot.ppureg.control & PPUCTRL_SPRITEPATT) ? 0x1000 : 0x0000) + (tile * 16) + row;
+    }
+    uint8_t lo = ppu_readChr(address);
+    uint8_t hi = ppu_readChr(address + 8);
+    if (attribute & 0x40) {
+      lo = ppu_reverseBits(lo);
+      hi = ppu_reverseBits(hi);
+    }
+
+    if (i == 0) dot.spriteZeroInLine = true;
+    dot.spriteX[dot.spriteCount] = oamRAM[i + 3];
+    dot.spriteLo[dot.spriteCount] = lo;
+    dot.spriteHi[dot.spriteCount] = hi;
+    dot.spriteAttribute[dot.spriteCount] = attribute;
+    dot.spriteCount += 1;
   }
+}
 
-  // render visible background
-  uint16_t ntRow, ntCol, ntPos, scrolledNametable;
-  for (int row = 0; row <= 30; row++) { // load 31 rows to account for scroll
-    // determine scroll value based on sprite zero hit location
-    uint8_t fineX = ((row * 8) > spriteZeroScanline ? scrollX : initialScrollX) % 8;
-    uint8_t fineY = ((row * 8) > spriteZeroScanline ? scrollY : initialScrollY) % 8;
-    uint8_t coarseX = ((row * 8) > spriteZeroScanline ? scrollX : initialScrollX) / 8;
-    uint8_t coarseY = ((row * 8) > spriteZeroScanline ? scrollY : initialScrollY) / 8;
+static force_inline void ppu_outputDot(uint8_t x, uint8_t bgPixel, uint8_t bgPalette) {
+  uint8_t mask = hot.ppureg.mask;
+  if (!(mask & PPUMASK_SHOWBKG) || (x < 8 && !(mask & PPUMASK_BKGLEFT))) bgPixel = 0;
+  uint8_t index = bgPixel ? ((bgPalette << 2) | bgPixel) : 0;
 
-    for (int col = 0; col <= 32; col++) { // load 33 rows to account for scroll
-      // adjust row & tile for scroll
-      ntCol = col + coarseX;
-      ntRow = row + coarseY;
+  if (!hot.renderingEnabled) {
+    // nothing is drawn, but sprite zero (always the first sprite) can hit
+    uint8_t dx = x - dot.spriteX[0];
+    if (dot.spriteZeroInLine && bgPixel && x != 255 && dx < 8 && (mask & PPUMASK_SHOWSPRIT) && (x >= 8 || (mask & PPUMASK_SPRITLEFT))
+      && (((dot.spriteHi[0] | dot.spriteLo[0]) >> (7 - dx)) & 1)) {
+      ppu_setStatusFlag(PPUSTAT_SPRITEZRO, true);
+    }
+    return;
+  }
 
-      // account for nametable & scroll overflow
-      scrolledNametable = nametableID;
-      if (ntCol >= 32) scrolledNametable += 1;
-      if (ntRow >= 32) scrolledNametable += 2;
-      scrolledNametable %= 4;
-      ntPos = ((ntRow % 32) * 32) + (ntCol % 32);
+  if ((mask & PPUMASK_SHOWSPRIT) && (x >= 8 || (mask & PPUMASK_SPRITLEFT))) {
+    // the first opaque sprite in OAM order wins
+    for (uint8_t i = 0; i < dot.spriteCount; i++) {
+      uint8_t dx = x - dot.spriteX[i];
+      if (dx >= 8) continue;
+      uint8_t spritePixel = (((dot.spriteHi[i] >> (7 - dx)) & 1) << 1) | ((dot.spriteLo[i] >> (7 - dx)) & 1);
+      if (spritePixel == 0) continue;
+      if (i == 0 && dot.spriteZeroInLine && bgPixel && x != 255) ppu_setStatusFlag(PPUSTAT_SPRITEZRO, true);
+      if (!bgPixel || !(dot.spriteAttribute[i] & 0x20)) index = 0x10 | ((dot.spriteAttribute[i] & BIT_FILL_2) << 2) | spritePixel;
+      break;
+    }
+  }
+  bitmap[(hot.scanline * 256) + x] = paletteRAM[index] & BIT_FILL_6;
+  lineEmphasis[hot.scanline] = mask >> 5;
+}
+
+static void ppu_runDots(uint16_t from, uint16_t to) {
+  bool visible = hot.scanline < 240;
+  // registers can't change during a run; accessing them ends it
+  bool rendering = (hot.ppureg.mask & (PPUMASK_SHOWBKG | PPUMASK_SHOWSPRIT)) != 0;
+  uint16_t mux = 0x8000 >> hot.fineX;
 
-      // ignore above calculations if before sprite zero hit
-      if ((row * 8) <= spriteZeroScanline) scrolledNametable = 0; // a little hacky to just set nametable to 0
+  for (uint16_t cycle = (from > 1) ? from : 1; cycle < to; cycle++) {
+    if (!rendering) {
+      if (visible && cycle <= 256) ppu_outputDot(cycle - 1, 0, 0);
+      if (cycle == 257) dot.spriteCount = 0;
+      continue;
+    }
 
-      if (showBackground) ppu_drawTile(false, false, false, false, true, bankOffset + nametables[scrolledNametable][ntPos], attributeTables[scrolledNametable][ntPos], (col * 8) - fineX, (row * 8) - fineY);
+    if ((cycle >= 2 && cycle <= 257) || (cycle >= 321 && cycle <= 337)) {
+      dot.patternLo <<= 1;
+      dot.patternHi <<= 1;
+      dot.attributeLo <<= 1;
+      dot.attributeHi <<= 1;
+      switch ((cycle - 1) & 7) {
+        case 0:
+          dot.patternLo = (dot.patternLo & 0xFF00) | dot.nextLo;
+          dot.patternHi = (dot.patternHi & 0xFF00) | dot.nextHi;
+          dot.attributeLo = (dot.attributeLo & 0xFF00) | ((dot.nextAttribute & 1) ? 0xFF : 0x00);
+          dot.attributeHi = (dot.attributeHi & 0xFF00) | ((dot.nextAttribute & 2) ? 0xFF : 0x00);
+          dot.nextTile = vidRAM[hot.loopyV & 0x0FFF];
+          break;
+        case 2: dot.nextAttribute = ppu_fetchAttribute(hot.loopyV); break;
+        case 4: dot.nextLo = ppu_fetchPattern(dot.nextTile, hot.loopyV, 0); break;
+        case 6: dot.nextHi = ppu_fetchPattern(dot.nextTile, hot.loopyV, 8); break;
+        case 7: hot.loopyV = ppu_incrementScrollX(hot.loopyV); break;
+      }
+    }
+    if (cycle == 256) hot.loopyV = ppu_incrementScrollY(hot.loopyV);
+    if (cycle == 257) {
+      hot.loopyV = (hot.loopyV & ~0x041F) | (hot.loopyT & 0x041F);
+      if (visible && hot.scanline < 239) {
+        ppu_evaluateDotSprites(hot.scanline + 1);
+      } else {
+        dot.spriteCount = 0;
+      }
+    }
+    if (!visible && cycle >= 280 && cycle <= 304) hot.loopyV = (hot.loopyV & ~0x7BE0) | (hot.loopyT & 0x7BE0);
+
+    if (visible && cycle <= 256) {
+      uint8_t bgPixel = ((dot.patternHi & mux) ? 2 : 0) | ((dot.patternLo & mux) ? 1 : 0);
+      uint8_t bgPalette = ((dot.attributeHi & mux) ? 2 : 0) | ((dot.attributeLo & mux) ? 1 : 0);
+      ppu_outputDot(cycle - 1, bgPixel, bgPalette);
+    }
+  }
+}
+
+static void ppu_runLineFast(bool visible) {
+  if (!(hot.ppureg.mask & (PPUMASK_SHOWBKG | PPUMASK_SHOWSPRIT))) {
+    if (visible && hot.renderingEnabled) {
+      for (uint16_t x = 0; x < 256; x++) ppu_outputDot(x, 0, 0);
+    }
+    return;
+  }
+
+  // the first two tiles are already in the shift registers; the other 32
+  // are fetched as v moves across the scanline
+  uint8_t lo[34], hi[34], attributes[34];
+  uint16_t v = hot.loopyV;
+  uint8_t tile = dot.nextTile;
+  for (int k = 2; k < 34; k++) {
+    if (k > 2) tile = vidRAM[v & 0x0FFF];
+    attributes[k] = ppu_fetchAttribute(v);
+    lo[k] = ppu_fetchPattern(tile, v, 0);
+    hi[k] = ppu_fetchPattern(tile, v, 8);
+    v = ppu_incrementScrollX(v);
+  }
+
+  // while not drawing, only sprite zero's pixels need the background
+  if (visible && (hot.renderingEnabled || dot.spriteZeroInLine)) {
+    for (uint16_t x = 0; x < 256; x++) {
+      uint16_t p = x + hot.fineX;
+      uint8_t bgPixel, bgPalette;
+      if (p < 16) {
+        uint16_t bit = 0x8000 >> p;
+        bgPixel = ((dot.patternHi & bit) ? 2 : 0) | ((dot.patternLo & bit) ? 1 : 0);
+        bgPalette = ((dot.attributeHi & bit) ? 2 : 0) | ((dot.attributeLo & bit) ? 1 : 0);
+      } else {
+        uint8_t k = p >> 3;
+        uint8_t shift = 7 - (p & 7);
+        bgPixel = (((hi[k] >> shift) & 1) << 1) | ((lo[k] >> shift) & 1);
+        bgPalette = attributes[k];
+      }
+      ppu_outputDot(x, bgPixel, bgPalette);
     }
   }
 
-  // draw sprites from OAM
+  // as of dot 256: tiles 31 and 32 loaded and shifted 7 times, 33 latched
+  dot.patternLo = (uint16_t)(((lo[31] << 8) | lo[32]) << 7);
+  dot.patternHi = (uint16_t)(((hi[31] << 8) | hi[32]) << 7);
+  dot.attributeLo = (uint16_t)((((attributes[31] & 1) ? 0xFF00 : 0) | ((attributes[32] & 1) ? 0x00FF : 0)) << 7);
+  dot.attributeHi = (uint16_t)((((attributes[31] & 2) ? 0xFF00 : 0) | ((attributes[32] & 2) ? 0x00FF : 0)) << 7);
+  dot.nextTile = tile;
+  dot.nextAttribute = attributes[33];
+  dot.nextLo = lo[33];
+  dot.nextHi = hi[33];
+  hot.loopyV = ppu_incrementScrollY(v);
+}
+
+static void ppu_evaluateSprites() {
+  uint8_t height = (hot.ppureg.control & PPUCTRL_SPRITESIZE) ? 16 : 8;
+  if (!spriteLists.stale && spriteLists.height == height) return;
+  memset(spriteLists.count, 0, sizeof(spriteLists.count));
+  spriteLists.overflowLine = DISPLAY_HEIGHT;
   for (int i = 0; i < 256; i += 4) {
-    uint8_t relY = oamRAM[i];
-    uint8_t relX = oamRAM[i + 3];
+    for (int y = oamRAM[i]; y < oamRAM[i] + height && y < DISPLAY_HEIGHT; y++) {
+      if (spriteLists.count[y] == 8) {
+        // the hardware only has room for 8 sprites per line
+        if (y < spriteLists.overflowLine) spriteLists.overflowLine = y;
+        continue;
+      }
+      spriteLists.sprites[y][spriteLists.count[y]++] = i;
+    }
+  }
+  spriteLists.height = height;
+  spriteLists.stale = false;
+}
+
+static force_inline void ppu_drawSpriteLine(uint8_t y, uint16_t spriteBankOffset, bool detectSpriteZero, bool draw) {
+  uint8_t* row = &bitmap[y * 256];
+  const uint64_t* background = lineOpaque[y];
+  uint64_t covered[4] = {0, 0, 0, 0};
+  bool clipLeft = !ppu_getMaskFlag(PPUMASK_SPRITLEFT);
+  uint8_t height = spriteLists.height;
+  uint8_t count = draw ? spriteLists.count[y] : 1;
+  for (uint8_t n = 0; n < count; n++) {
+    uint8_t i = spriteLists.sprites[y][n];
+
+    // parse sprite data
+    uint8_t relY = y - oamRAM[i];
     bool flipHorizontally = (oamRAM[i + 2] >> 6) & 1;
     bool flipVertically = (oamRAM[i + 2] >> 7) & 1;
     bool isBehindBackground = (oamRAM[i + 2] >> 5) & 1;
+    if (flipVertically) relY = height - 1 - relY;
     uint8_t paletteID = (oamRAM[i + 2]) & BIT_FILL_2;
-    // only draw sprite if visible and within bounds
-    if (relY < 0xEF && relY != 0x00 && showSprite) ppu_drawTile(flipHorizontally, flipVertically, true, isBehindBackground, false, spriteBankOffset + oamRAM[i + 1], paletteID + 4, relX, relY);
+
+    // 8x16 sprites pick their own bank with bit 0 of the tile
+    uint16_t tileID = spriteBankOffset + oamRAM[i + 1];
+    if (height == 16) tileID = ((oamRAM[i + 1] & 1) * 256) + (oamRAM[i + 1] & 0xFE) + (relY >> 3);
+
+    uint8_t pixels[8];
+    ppu_decodeTileRow(pixels, tileID, relY & 7, paletteID + 4, flipHorizontally);
+
+    // sprites are cut off at the right edge of the screen, and at the left
+    // 8 pixels unless PPUMASK_SPRITLEFT is set
+    uint8_t x = oamRAM[i + 3];
+    uint8_t opaque = ppu_opaqueBits(pixels);
+    if (x > 248) opaque &= (1 << (256 - x)) - 1;
+    if (clipLeft && x < 8) opaque &= 0xFF << (8 - x);
+
+    // an earlier sprite in OAM takes the pixel, even if it's behind the
+    // background there
+    opaque &= ~ppu_getMaskBits(covered, x);
+    if (opaque == 0) continue; // skip drawing this sprite if transparent
+    ppu_setMaskBits(covered, x, opaque);
+    uint8_t behind = ppu_getMaskBits(background, x);
+
+    // sprite zero over opaque background (except at x = 255); trigger the
+    // hit at next scanline
+    if (detectSpriteZero && i == 0) {
+      uint8_t hit = opaque & behind;
+      if (x > 247) hit &= ~(1 << (255 - x));
+      if (hit) hot.triggerSpriteZero = true;
+    }
+    if (!draw) break;
+
+    // only draw if sprite is in foreground (or if background is clear)
+    uint8_t draw = isBehindBackground ? (opaque & ~behind) : opaque;
+    for (uint8_t dx = 0; dx < 8; dx++) {
+      if (draw & (1 << dx)) row[x + dx] = paletteRAM[pixels[dx]] & BIT_FILL_6;
+    }
   }
 }
 
-static force_inline void ppu_drawScanline(uint8_t y) {
-  uint8_t fineX = scrollX % 8;
-  uint8_t fineY = scrollY % 8;
-  uint8_t coarseX = scrollX / 8;
-  uint8_t coarseY = scrollY / 8;
-  uint8_t tileRow = y / 8;
+static force_inline uint8_t ppu_opaqueBits(const uint8_t* pixels) {
+  uint64_t bytes;
+  memcpy(&bytes, pixels, 8);
+
+  // gather bit 0 of each byte into the top byte; no two products overlap
+  bytes = (bytes | (bytes >> 1)) & 0x0101010101010101ULL;
+  return (bytes * 0x0102040810204080ULL) >> 56;
+}
+
+static force_inline uint8_t ppu_getMaskBits(const uint64_t* mask, uint8_t x) {
+  uint8_t word = x >> 6;
+  uint8_t shift = x & 63;
+  uint64_t bits = mask[word] >> shift;
+  if (shift > 56 && word < 3) bits |= mask[word + 1] << (64 - shift);
+  return bits;
+}
+
+static force_inline void ppu_setMaskBits(uint64_t* mask, uint8_t x, uint8_t bits) {
+  uint8_t word = x >> 6;
+  uint8_t shift = x & 63;
+  mask[word] |= (uint64_t)bits << shift;
+  if (shift > 56 && word < 3) mask[word + 1] |= (uint64_t)bits >> (64 - shift);
+}
+
+static force_inline void ppu_maskBackgroundLine(uint8_t y, const uint8_t* line) {
+  for (uint8_t word = 0; word < 4; word++) {
+    uint64_t bits = 0;
+    for (uint8_t byte = 0; byte < 8; byte++) {
+      bits |= (uint64_t)ppu_opaqueBits(&line[(word * 64) + (byte * 8)]) << (byte * 8);
+    }
+    lineOpaque[y][word] = bits;
+  }
+  if (!ppu_getMaskFlag(PPUMASK_BKGLEFT)) lineOpaque[y][0] &= ~0xFFULL;
+}
+
+static force_inline void ppu_drawBackgroundLine(uint8_t y, const uint8_t* line, const uint8_t* palette) {
+  uint8_t* row = &bitmap[y * 256];
+  paletteLine(row, line, palette);
+  ppu_maskBackgroundLine(y, line);
+
+  // the left 8 pixels show the backdrop unless PPUMASK_BKGLEFT is set
+  if (!ppu_getMaskFlag(PPUMASK_BKGLEFT)) memset(row, palette[0], 8);
+}
+
+static force_inline void ppu_clearBackgroundLine(uint8_t y) {
+  memset(&bitmap[y * 256], paletteRAM[0] & BIT_FILL_6, 256);
+  memset(lineOpaque[y], 0, sizeof(lineOpaque[y]));
+}
+
+static force_inline void ppu_decodeTileRow(uint8_t* out, uint16_t tileID, uint8_t row, uint8_t palette, bool flipHorizontally) {
+  uint64_t pixels = chrWindow[tileID >> 6][tileID & 63][flipHorizontally][row];
+
+  // add the palette to opaque pixels only, all 8 bytes at once
+  uint64_t opaque = (pixels | (pixels >> 1)) & 0x0101010101010101ULL;
+  pixels |= opaque * (uint64_t)(palette << 2);
+  memcpy(out, &pixels, 8);
+}
+
+static force_inline void ppu_loadBackgroundPalette(uint8_t* palette) {
+  for (uint8_t i = 0; i < 16; i++) {
+    palette[i] = paletteRAM[(i & BIT_FILL_2) ? i : 0] & BIT_FILL_6;
+  }
+}
+
+static void ppu_paletteLineScalar(uint8_t* dst, const uint8_t* line, const uint8_t* palette) {
+  for (int x = 0; x < DISPLAY_WIDTH; x++) {
+    dst[x] = palette[line[x]];
+  }
+}
+
+static void ppu_colorLineScalar(uint32_t* dst, const uint8_t* line, const uint32_t* palette) {
+  for (int x = 0; x < DISPLAY_WIDTH; x++) {
+    dst[x] = palette[line[x]];
+  }
+}
+
+#if PPU_SIMD_X86
+__attribute__((target("ssse3")))
+static void ppu_paletteLineSSSE3(uint8_t* dst, const uint8_t* line, const uint8_t* palette) {
+  // palette RAM is 16 bytes, so one pshufb looks up 16 pixels
+  __m128i table = _mm_loadu_si128((const __m128i*)palette);
+  for (int x = 0; x < DISPLAY_WIDTH; x += 16) {
+    __m128i index = _mm_loadu_si128((const __m128i*)(line + x));
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_shuffle_epi8(table, index));
+  }
+}
+
+__attribute__((target("avx2")))
+static void ppu_paletteLineAVX2(uint8_t* dst, const uint8_t* line, const uint8_t* palette) {
+  __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)palette));
+  for (int x = 0; x < DISPLAY_WIDTH; x += 32) {
+    __m256i index = _mm256_loadu_si256((const __m256i*)(line + x));
+    _mm256_storeu_si256((__m256i*)(dst + x), _mm256_shuffle_epi8(table, index));
+  }
+}
+
+__attribute__((target("ssse3")))
+static void ppu_colorLineSSSE3(uint32_t* dst, const uint8_t* line, const uint32_t* palette) {
+  // split the 64 colors into 4 byte planes of 4 16-entry tables; each
+  // pshufb looks up one byte of 16 pixels in one table, the high bits of
+  // the index pick the table, then the planes are interleaved into words
+  __m128i tables[4][4];
+  for (int t = 0; t < 4; t++) {
+    uint8_t planes[4][16];
+    for (int i = 0; i < 16; i++) {
+      for (int b = 0; b < 4; b++) planes[b][i] = palette[(t * 16) + i] >> (b * 8);
+    }
+    for (int b = 0; b < 4; b++) tables[b][t] = _mm_loadu_si128((const __m128i*)planes[b]);
+  }
+
+  for (int x = 0; x < DISPLAY_WIDTH; x += 16) {
+    __m128i index = _mm_loadu_si128((const __m128i*)(line + x));
+    __m128i low = _mm_and_si128(index, _mm_set1_epi8(0x0F));
+    __m128i high = _mm_and_si128(index, _mm_set1_epi8(0x30));
+    __m128i select[4];
+    for (int t = 0; t < 4; t++) select[t] = _mm_cmpeq_epi8(high, _mm_set1_epi8(t << 4));
+    __m128i bytes[4];
+    for (int b = 0; b < 4; b++) {
+      bytes[b] = _mm_setzero_si128();
+      for (int t = 0; t < 4; t++) bytes[b] = _mm_or_si128(bytes[b], _mm_and_si128(select[t], _mm_shuffle_epi8(tables[b][t], low)));
+    }
+    __m128i lo01 = _mm_unpacklo_epi8(bytes[0], bytes[1]);
+    __m128i hi01 = _mm_unpackhi_epi8(bytes[0], bytes[1]);
+    __m128i lo23 = _mm_unpacklo_epi8(bytes[2], bytes[3]);
+    __m128i hi23 = _mm_unpackhi_epi8(bytes[2], bytes[3]);
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_unpacklo_epi16(lo01, lo23));
+    _mm_storeu_si128((__m128i*)(dst + x + 4), _mm_unpackhi_epi16(lo01, lo23));
+    _mm_storeu_si128((__m128i*)(dst + x + 8), _mm_unpacklo_epi16(hi01, hi23));
+    _mm_storeu_si128((__m128i*)(dst + x + 12), _mm_unpackhi_epi16(hi01, hi23));
+  }
+}
+
+__attribute__((target("avx2")))
+static void ppu_colorLineAVX2(uint32_t* dst, const uint8_t* line, const uint32_t* palette) {
+  // same as the SSSE3 version with 32 pixels per step; the unpacks work
+  // within 128-bit lanes, so the halves are swapped back into order
+  __m256i tables[4][4];
+  for (int t = 0; t < 4; t++) {
+    uint8_t planes[4][16];
+    for (int i = 0; i < 16; i++) {
+      for (int b = 0; b < 4; b++) planes[b][i] = palette[(t * 16) + i] >> (b * 8);
+    }
+    for (int b = 0; b < 4; b++) tables[b][t] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)planes[b]));
+  }
+
+  for (int x = 0; x < DISPLAY_WIDTH; x += 32) {
+    __m256i index = _mm256_loadu_si256((const __m256i*)(line + x));
+    __m256i low = _mm256_and_si256(index, _mm256_set1_epi8(0x0F));
+    __m256i high = _mm256_and_si256(index, _mm256_set1_epi8(0x30));
+    __m256i select[4];
+    for (int t = 0; t < 4; t++) select[t] = _mm256_cmpeq_epi8(high, _mm256_set1_epi8(t << 4));
+    __m256i bytes[4];
+    for (int b = 0; b < 4; b++) {
+      bytes[b] = _mm256_setzero_si256();
+      for (int t = 0; t < 4; t++) bytes[b] = _mm256_or_si256(bytes[b], _mm256_and_si256(select[t], _mm256_shuffle_epi8(tables[b][t], low)));
+    }
+    __m256i lo01 = _mm256_unpacklo_epi8(bytes[0], bytes[1]);
+    __m256i hi01 = _mm256_unpackhi_epi8(bytes[0], bytes[1]);
+    __m256i lo23 = _mm256_unpacklo_epi8(bytes[2], bytes[3]);
+    __m256i hi23 = _mm256_unpackhi_epi8(bytes[2], bytes[3]);
+    __m256i p0 = _mm256_unpacklo_epi16(lo01, lo23);  // pixels 0-3, 16-19
+    __m256i p1 = _mm256_unpackhi_epi16(lo01, lo23);  // pixels 4-7, 20-23
+    __m256i p2 = _mm256_unpacklo_epi16(hi01, hi23);  // pixels 8-11, 24-27
+    __m256i p3 = _mm256_unpackhi_epi16(hi01, hi23);  // pixels 12-15, 28-31
+    _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256((__m256i*)(dst + x + 8), _mm256_permute2x128_si256(p2, p3, 0x20));
+    _mm256_storeu_si256((__m256i*)(dst + x + 16), _mm256_permute2x128_si256(p0, p1, 0x31));
+    _mm256_storeu_si256((__m256i*)(dst + x + 24), _mm256_permute2x128_si256(p2, p3, 0x31));
+  }
+}
+#endif
+
+static void ppu_selectPaletteLine() {
+#if PPU_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    paletteLine = ppu_paletteLineAVX2;
+    colorLine = ppu_colorLineAVX2;
+    return;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    paletteLine = ppu_paletteLineSSSE3;
+    colorLine = ppu_colorLineSSSE3;
+    return;
+  }
+#endif
+  paletteLine = ppu_paletteLineScalar;
+  colorLine = ppu_colorLineScalar;
+}
+
+void ppu_getPalette(uint32_t* palette, uint8_t emphasis, PPUPixelFormat format) {
+  for (int i = 0; i < 64; i++) {
+    uint32_t r = (colors[i] >> 16) & 0xFF;
+    uint32_t g = (colors[i] >> 8) & 0xFF;
+    uint32_t b = colors[i] & 0xFF;
+    // each emphasis bit dims the other two channels to about 81.6%
+    uint8_t mask = emphasis << 5;
+    if (mask & (PPUMASK_EMPHGREEN | PPUMASK_EMPHBLUE)) r = (r * 209) >> 8;
+    if (mask & (PPUMASK_EMPHRED | PPUMASK_EMPHBLUE)) g = (g * 209) >> 8;
+    if (mask & (PPUMASK_EMPHRED | PPUMASK_EMPHGREEN)) b = (b * 209) >> 8;
+    palette[i] = (format == PPUFORMAT_XBGR8888) ? ((b << 16) | (g << 8) | r) : ((r << 16) | (g << 8) | b);
+  }
+}
+
+void ppu_convertBitmap(uint32_t* dst, const uint8_t* pixels, const uint8_t* emphasis, PPUPixelFormat format) {
+  if (colorLine == NULL) ppu_selectPaletteLine();
+
+  // only build the palettes the frame actually uses
+  uint32_t palettes[8][64];
+  uint8_t built = 0;
+  for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+    uint8_t e = emphasis[y] & BIT_FILL_3;
+    if (!(built & (1 << e))) {
+      ppu_getPalette(palettes[e], e, format);
+      built |= 1 << e;
+    }
+    colorLine(&dst[y * DISPLAY_WIDTH], &pixels[y * DISPLAY_WIDTH], palettes[e]);
+  }
+}
+
+static force_inline void ppu_decodeChrTile(uint8_t slot, uint8_t tile) {
+  const uint8_t* pattern = &chrROM[(chrCacheBank[slot] * 1024) + (tile * 16)];
+  for (uint16_t row = 0; row < 8; row++) {
+    uint8_t high = pattern[row + 8];
+    uint8_t low = pattern[row];
+    uint8_t normal[8];
+    uint8_t mirrored[8];
+    for (uint16_t col = 0; col < 8; col++) {
+      uint8_t color = ((high & 1) << 1) | (low & 1);
+      high >>= 1;
+      low >>= 1;
+      normal[7 - col] = color;
+      mirrored[col] = color;
+    }
+    // byte n of each row is pixel n from the left, whatever the byte order
+    memcpy(&chrCache[slot][tile][0][row], normal, 8);
+    memcpy(&chrCache[slot][tile][1][row], mirrored, 8);
+  }
+}
+
+static void ppu_resetChrCache() {
+  // Storage of character data is very memory efficient, but also
+  // computationally expensive to decode.
+  // Since memory is cheap and abundant now, we can store it in a manner
+  // that's easier to read from on-the-fly: each row packed into 8 bytes,
+  // in screen order and mirrored, so flipping either way costs nothing.
+  // Banks are decoded the first time they're drawn and kept until evicted.
+  for (uint8_t slot = 0; slot < PPU_CHR_CACHE_BANKS; slot++) {
+    chrCacheBank[slot] = -1;
+    chrCacheUsed[slot] = 0;
+    chrDirty[slot] = 0;
+  }
+  chrCacheClock = 0;
+  chrCacheStale = false;
+  for (uint8_t window = 0; window < 8; window++) {
+    chrWindowSlot[window] = window;
+    chrWindow[window] = chrCache[window];
+  }
+  for (uint8_t window = 0; window < 8; window++) {
+    ppu_mapChrBank(window, window);
+  }
+}
+
+void ppu_mapChrBank(uint8_t window, uint16_t bank) {
+  window &= 7;
+  bank %= chrBankCount;
+  chrMap[window] = &chrROM[bank * 1024];
+
+  int16_t slot = -1;
+  for (uint8_t i = 0; i < PPU_CHR_CACHE_BANKS; i++) {
+    if (chrCacheBank[i] == bank) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    // evict the least recently mapped bank that no other window shows
+    for (uint8_t i = 0; i < PPU_CHR_CACHE_BANKS; i++) {
+      bool shown = false;
+      for (uint8_t w = 0; w < 8; w++) {
+        if (w != window && chrWindowSlot[w] == i) shown = true;
+      }
+      if (shown) continue;
+      if (slot < 0 || chrCacheUsed[i] < chrCacheUsed[slot]) slot = i;
+    }
+    chrCacheBank[slot] = bank;
+    chrDirty[slot] = ~0ULL;
+    chrCacheStale = true;
+  }
+  chrCacheUsed[slot] = ++chrCacheClock;
+  if (chrWindowSlot[window] != slot) {
+    chrGeneration++;
+    chrMapGeneration++;
+  }
+  chrWindowSlot[window] = slot;
+  chrWindow[window] = chrCache[slot];
+}
+
+static force_inline void ppu_decodeDirtyTiles() {
+  if (!chrCacheStale) return;
+  for (uint8_t slot = 0; slot < PPU_CHR_CACHE_BANKS; slot++) {
+    for (uint8_t window = 0; window < 8; window++) {
+      if (chrWindowSlot[window] == slot) chrChangedTiles[window] |= chrDirty[slot];
+    }
+    while (chrDirty[slot]) {
+      ppu_decodeChrTile(slot, __builtin_ctzll(chrDirty[slot]));
+      chrDirty[slot] &= chrDirty[slot] - 1;
+    }
+  }
+  chrCacheStale = false;
+  chrGeneration++;
+}
+
+void ppu_invalidateChrCache() {
+  if (!chrWritable) return;
+  for (uint8_t slot = 0; slot < PPU_CHR_CACHE_BANKS; slot++) {
+    if (chrCacheBank[slot] >= 0) chrDirty[slot] = ~0ULL;
+  }
+  chrCacheStale = true;
+}
+
+const uint64_t* ppu_getTileRows(uint16_t tileID) {
+  ppu_decodeDirtyTiles();
+  return chrWindow[(tileID >> 6) & 7][tileID & 63][0];
+}
+
+static force_inline void ppu_invalidateBackground() {
+  memset(backgroundDirty, 0xFF, sizeof(backgroundDirty));
+  backgroundStale = true;
+}
+
+static force_inline void ppu_markBackgroundDirty(uint16_t address) {
+  uint16_t base = ((address >> 10) & 3) * 960;
+  uint16_t offset = address & 0x03FF;
+  if (offset < 960) {
+    backgroundDirty[(base + offset) / 64] |= 1ULL << ((base + offset) % 64);
+  } else {
+    // an attribute byte colors a block of 4x4 tiles
+    uint8_t blockRow = (offset - 960) / 8;
+    uint8_t blockCol = (offset - 960) % 8;
+    for (uint8_t ntRow = blockRow * 4; ntRow < (blockRow * 4) + 4 && ntRow < 30; ntRow++) {
+      for (uint8_t ntCol = blockCol * 4; ntCol < (blockCol * 4) + 4; ntCol++) {
+        uint16_t index = base + (ntRow * 32) + ntCol;
+        backgroundDirty[index / 64] |= 1ULL << (index % 64);
+      }
+    }
+  }
+  backgroundStale = true;
+}
+
+static force_inline void ppu_renderBackgroundTile(uint16_t index, uint16_t bankOffset) {
+  uint8_t n = index / 960;
+  uint8_t ntRow = (index % 960) / 32;
+  uint8_t ntCol = (index % 960) % 32;
+
+  // https://www.nesdev.org/wiki/PPU_attribute_tables
+  uint8_t attrByte = vidRAM[(0x400 * n) + 960 + ((ntRow / 4) * 8) + (ntCol / 4)];
+  uint8_t quadrantPalette = (attrByte >> ((((ntRow / 2) % 2) * 4) + (((ntCol / 2) % 2) * 2))) & BIT_FILL_2;
+  uint16_t tileID = bankOffset + vidRAM[(0x400 * n) + (ntRow * 32) + ntCol];
+
+  uint8_t* dst = &backgroundCache[((n >> 1) * 240) + (ntRow * 8)][((n & 1) * 256) + (ntCol * 8)];
+  for (uint8_t tileRow = 0; tileRow < 8; tileRow++) {
+    ppu_decodeTileRow(&dst[tileRow * 512], tileID, tileRow, quadrantPalette, false);
+  }
+}
+
+static force_inline void ppu_markChangedTiles(uint16_t bankOffset) {
+  const uint64_t* changed = &chrChangedTiles[bankOffset / 64];
+  if ((changed[0] | changed[1] | changed[2] | changed[3]) == 0) return;
+  for (uint16_t index = 0; index < 3840; index++) {
+    uint8_t tile = vidRAM[(0x400 * (index / 960)) + (index % 960)];
+    if ((changed[tile / 64] >> (tile % 64)) & 1) {
+      backgroundDirty[index / 64] |= 1ULL << (index % 64);
+      backgroundStale = true;
+    }
+  }
+}
+
+static force_inline void ppu_updateBackgroundCache(uint16_t bankOffset) {
+  if (bankOffset != backgroundBank || chrMapGeneration != backgroundMapGeneration) {
+    backgroundBank = bankOffset;
+    backgroundMapGeneration = chrMapGeneration;
+    ppu_invalidateBackground();
+  } else {
+    ppu_markChangedTiles(bankOffset);
+  }
+  memset(chrChangedTiles, 0, sizeof(chrChangedTiles));
+  if (!backgroundStale) return;
+  for (uint16_t word = 0; word < 60; word++) {
+    while (backgroundDirty[word]) {
+      ppu_renderBackgroundTile((word * 64) + __builtin_ctzll(backgroundDirty[word]), bankOffset);
+      backgroundDirty[word] &= backgroundDirty[word] - 1;
+    }
+  }
+  backgroundStale = false;
+}
+
+static force_inline void ppu_drawFrame() {
+  ppu_decodeDirtyTiles();
 
-  uint16_t nametableID = (((((uint16_t) ppu_getControlFlag(PPUCTRL_NAMETABLE2)) << 1) | ((uint16_t) ppu_getControlFlag(PPUCTRL_NAMETABLE1))) * 0x0400);
   uint16_t bankOffset = 256 * ppu_getControlFlag(PPUCTRL_BKGPATT);
   uint16_t spriteBankOffset = 256 * ppu_getControlFlag(PPUCTRL_SPRITEPATT);
+
+  uint8_t nametableID = (((uint16_t) ppu_getControlFlag(PPUCTRL_NAMETABLE2)) << 1) | ((uint16_t) ppu_getControlFlag(PPUCTRL_NAMETABLE1));
   
-  bool containsSpriteZero = false;
   bool showBackground = ppu_getMaskFlag(PPUMASK_SHOWBKG);
   bool showSprite = ppu_getMaskFlag(PPUMASK_SHOWSPRIT);
 
-  // ensures 1-scanline delay for sprite zero hit
-  if (triggerSpriteZero == true) {
-    ppu_setStatusFlag(PPUSTAT_SPRITEZRO, true);
-    triggerSpriteZero = false;
+  // only tiles written since the last frame are drawn again
+  if (showBackground) ppu_updateBackgroundCache(bankOffset);
+
+  memset(lineEmphasis, hot.ppureg.mask >> 5, sizeof(lineEmphasis));
+
+  // copy the visible background out of the cache
+  uint8_t palette[16];
+  ppu_loadBackgroundPalette(palette);
+  for (int row = 0; showBackground && row <= 30; row++) { // load 31 rows to account for scroll
+    // determine scroll value based on sprite zero hit location
+    bool split = (row * 8) > hot.spriteZeroScanline;
+    uint8_t scrollX = split ? hot.scrollX : hot.initialScrollX;
+    uint8_t scrollY = split ? hot.scrollY : hot.initialScrollY;
+    uint8_t nametable = split ? nametableID : 0; // a little hacky to just set nametable to 0
+
+    // scrolling past a nametable's edge continues into its neighbor
+    uint16_t cacheX = ((nametable & 1) * 256) + scrollX;
+    uint16_t cacheY = ((nametable >> 1) * 240) + ((scrollY / 8) * 8) + (row * 8);
+    for (int tileRow = 0; tileRow < 8; tileRow++) {
+      int y = (row * 8) - (scrollY % 8) + tileRow;
+      if (y < 0 || y >= DISPLAY_HEIGHT) continue;
+      const uint8_t* src = backgroundCache[(cacheY + tileRow) % 480];
+      if (cacheX <= 256) {
+        ppu_drawBackgroundLine(y, &src[cacheX], palette);
+      } else {
+        uint8_t line[256];
+        memcpy(line, &src[cacheX], 512 - cacheX);
+        memcpy(&line[512 - cacheX], src, cacheX - 256);
+        ppu_drawBackgroundLine(y, line, palette);
+      }
+    }
+  }
+  for (int y = 0; !showBackground && y < DISPLAY_HEIGHT; y++) {
+    ppu_clearBackgroundLine(y);
   }
 
-  // indicate that sprite zero is present in the scanline
-  if (showBackground && showSprite && oamRAM[0] <= y && oamRAM[0] > y - 8) {
-    containsSpriteZero = true;
+  // draw sprites from OAM, up to 8 per line
+  if (showSprite) ppu_evaluateSprites();
+  for (int y = 0; showSprite && y < DISPLAY_HEIGHT; y++) {
+    ppu_drawSpriteLine(y, spriteBankOffset, false, true);
   }
+}
 
-  // draw background
+static force_inline void ppu_fetchTileRow(uint16_t* tiles, uint8_t* attributes, uint16_t nametable, uint16_t bankOffset, uint8_t coarseX, uint8_t adjRow) {
   for (uint8_t tileCol = 0; tileCol < 33; tileCol++) {
     uint8_t adjCol = ((tileCol + coarseX) % 32);
-    uint8_t adjRow = ((tileRow + coarseY) % 32);
+    uint16_t nametablePos = nametable + (((tileCol + coarseX) / 32) * 0x0400);
 
-    uint16_t nametablePos = nametableID + (((tileCol + coarseX) / 32) * 0x0400);
-    
     // cycle 2-3
     uint8_t nametableByte = vidRAM[nametablePos + adjCol + (adjRow * 32)];
 
@@ -307,160 +1376,244 @@ static force_inline void ppu_drawScanline(uint8_t y) {
     if ((adjRow / 2) % 2 == 1) {
         attributeByte >>= 4;
     }
-    attributeByte &= BIT_FILL_2;
+    attributes[tileCol] = attributeByte & BIT_FILL_2;
+    tiles[tileCol] = bankOffset + nametableByte;
+  }
+}
 
-    uint8_t* tile = chrCache[bankOffset + nametableByte];
-    for (int pixCol = 0; pixCol < 8; pixCol++) {
-      uint8_t colorID = tile[((y % 8) * 8) + (7 - pixCol)];
-      if (showBackground) ppu_setPixel(colors[paletteRAM[colorID ? ((attributeByte << 2) + colorID) : 0]], (tileCol * 8) + pixCol - fineX, y - fineY);
-    }
+static force_inline void ppu_drawScanline(uint8_t y) {
+  ppu_decodeDirtyTiles();
+  uint8_t fineX = hot.scrollX % 8;
+  uint8_t fineY = hot.scrollY % 8;
+  uint8_t coarseX = hot.scrollX / 8;
+  uint8_t coarseY = hot.scrollY / 8;
+
+  // fine Y scroll moves this scanline further down the tile rows
+  uint8_t line = y + fineY;
+  uint8_t tileRow = line / 8;
+  uint8_t fineRow = line % 8;
+
+  uint16_t nametableID = (((((uint16_t) ppu_getControlFlag(PPUCTRL_NAMETABLE2)) << 1) | ((uint16_t) ppu_getControlFlag(PPUCTRL_NAMETABLE1))) * 0x0400);
+  uint16_t bankOffset = 256 * ppu_getControlFlag(PPUCTRL_BKGPATT);
+  uint16_t spriteBankOffset = 256 * ppu_getControlFlag(PPUCTRL_SPRITEPATT);
+  
+  bool containsSpriteZero = false;
+  bool showBackground = ppu_getMaskFlag(PPUMASK_SHOWBKG);
+  bool showSprite = ppu_getMaskFlag(PPUMASK_SHOWSPRIT);
+
+  // ensures 1-scanline delay for sprite zero hit
+  if (hot.triggerSpriteZero == true) {
+    ppu_setStatusFlag(PPUSTAT_SPRITEZRO, true);
+    hot.triggerSpriteZero = false;
   }
 
-  // draw sprites from OAM
-  for (int i = 0; i < 256; i += 4) {
-    // skip this sprite if not present in scanline
-    if (!(oamRAM[i] > y - 8 && oamRAM[i] <= y)) continue;
+  // indicate that sprite zero is present in the scanline
+  if (showBackground || showSprite) {
+    ppu_evaluateSprites();
+    if (y >= spriteLists.overflowLine) ppu_setStatusFlag(PPUSTAT_SPRITEOVF, true);
+  }
+  if (showBackground && showSprite && spriteLists.count[y] > 0 && spriteLists.sprites[y][0] == 0) {
+    containsSpriteZero = true;
+  }
 
-    // parse sprite data
-    uint8_t relY = y - oamRAM[i]; 
-    bool flipHorizontally = (oamRAM[i + 2] >> 6) & 1;
-    bool flipVertically = (oamRAM[i + 2] >> 7) & 1;
-    bool isBehindBackground = (oamRAM[i + 2] >> 5) & 1;
-    if (flipVertically) relY = 7 - relY;
-    uint8_t paletteID = (oamRAM[i + 2]) & BIT_FILL_2;
-    uint8_t* tile = chrCache[spriteBankOffset + oamRAM[i + 1]];
+  // while not drawing, the background is only needed under sprite zero
+  bool draw = hot.renderingEnabled;
+  if (!draw && !containsSpriteZero) return;
+
+  // draw background: decode palette indices for all 33 tiles, then look
+  // up the whole scanline's colors at once. A tile row is fetched and
+  // decoded once for its 8 scanlines, unless something it was fetched
+  // from changes partway through, in which case that scanline is fetched
+  // by itself.
+  if (showBackground) {
+    uint8_t adjRow = ((tileRow + coarseY) % 32);
+    bool fresh = strip.valid && strip.tileRow == tileRow && strip.coarseX == coarseX &&
+      strip.coarseY == coarseY && strip.nametable == nametableID && strip.bankOffset == bankOffset &&
+      strip.vramGeneration == vramGeneration && strip.chrGeneration == chrGeneration;
 
-    // only draw sprite if visible and within visible bounds
-    for (int pixCol = 7; pixCol >= 0; pixCol--) {
-      uint8_t colorID = tile[(relY * 8) + (7 - pixCol)];
-      if (colorID == 0) continue; // skip drawing this pixel if transparent
-      uint8_t relX = oamRAM[i + 3] + ((flipHorizontally) ? 7 - pixCol : pixCol);
+    uint8_t decoded[33 * 8];
+    const uint8_t* src = strip.rows[fineRow];
+    if (!fresh) {
+      uint16_t tiles[33];
+      uint8_t attributes[33];
+      ppu_fetchTileRow(tiles, attributes, nametableID, bankOffset, coarseX, adjRow);
+      if (fineRow == 0 || y == 0) {
+        for (uint8_t tileCol = 0; tileCol < 33; tileCol++) {
+          for (uint8_t row = 0; row < 8; row++) {
+            ppu_decodeTileRow(&strip.rows[row][tileCol * 8], tiles[tileCol], row, attributes[tileCol], false);
+          }
+        }
+        strip.valid = true;
+        strip.tileRow = tileRow;
+        strip.coarseX = coarseX;
+        strip.coarseY = coarseY;
+        strip.nametable = nametableID;
+        strip.bankOffset = bankOffset;
+        strip.vramGeneration = vramGeneration;
+        strip.chrGeneration = chrGeneration;
+      } else {
+        for (uint8_t tileCol = 0; tileCol < 33; tileCol++) {
+          ppu_decodeTileRow(&decoded[tileCol * 8], tiles[tileCol], fineRow, attributes[tileCol], false);
+        }
+        src = decoded;
+      }
+    }
 
-      // only draw if sprite is in foreground (or if background is clear)
-      if (bitmap[(y * 256) + relX] == colors[paletteRAM[0]] || !isBehindBackground) ppu_setPixel(colors[paletteRAM[((paletteID + 4) << 2) + colorID]], relX, y);
-      
-      // encountered sprite zero hit; trigger it at next scanline
-      if (containsSpriteZero && i == 0) triggerSpriteZero = true;
+    if (draw) {
+      uint8_t palette[16];
+      ppu_loadBackgroundPalette(palette);
+      ppu_drawBackgroundLine(y, &src[fineX], palette);
+    } else {
+      ppu_maskBackgroundLine(y, &src[fineX]);
     }
+  } else {
+    ppu_clearBackgroundLine(y);
   }
+
+  // draw sprites from OAM, up to 8 per line
+  if (draw) lineEmphasis[y] = hot.ppureg.mask >> 5;
+  if (showSprite) ppu_drawSpriteLine(y, spriteBankOffset, containsSpriteZero, draw);
 }
 
 void ppu_setStatusFlag(enum PPUStatusFlag flag, bool enable) {
   if (enable) {
-    ppureg.ppuStatus |= flag;
+    hot.ppureg.ppuStatus |= flag;
   } else {
-    ppureg.ppuStatus &= ~flag;
+    hot.ppureg.ppuStatus &= ~flag;
   }
 }
 
 bool ppu_getStatusFlag(enum PPUStatusFlag flag) {
-  return (ppureg.ppuStatus & flag) > 0;
+  return (hot.ppureg.ppuStatus & flag) > 0;
 }
 
 void ppu_setMaskFlag(enum PPUMaskFlag flag, bool enable) {
   if (enable) {
-    ppureg.mask |= flag;
+    hot.ppureg.mask |= flag;
   } else {
-    ppureg.mask &= ~flag;
+    hot.ppureg.mask &= ~flag;
   }
 }
 
 bool ppu_getMaskFlag(enum PPUMaskFlag flag) {
-  return (ppureg.mask & flag) > 0;
+  return (hot.ppureg.mask & flag) > 0;
 }
 
 void ppu_setControlFlag(enum PPUControlFlag flag, bool enable) {
   if (enable) {
-    ppureg.control |= flag;
+    hot.ppureg.control |= flag;
   } else {
-    ppureg.control &= ~flag;
+    hot.ppureg.control &= ~flag;
   }
 }
 
 bool ppu_getControlFlag(enum PPUControlFlag flag) {
-  return (ppureg.control & flag) > 0;
+  return (hot.ppureg.control & flag) > 0;
 }
 
 uint8_t ppu_readRegister(PPURegisterType r) {
+  if (ppuMode == PPURENDER_DOT) ppu_catchUpDots();
   switch (r) {
-    case PPU_CONTROL: return ppureg.control;
-    case PPU_MASK: return ppureg.mask;
+    case PPU_CONTROL: return hot.ppureg.control;
+    case PPU_MASK: return hot.ppureg.mask;
     case PPU_STATUS: {
-      uint8_t stat = ppureg.ppuStatus;
+      uint8_t stat = hot.ppureg.ppuStatus;
       ppu_setStatusFlag(PPUSTAT_VBLKSTART, false);
-      addressLatch = false;
-      scrollLatch = false;
+      hot.addressLatch = false;
+      hot.scrollLatch = false;
+      hot.writeToggle = false;
       return stat;
     }
-    case PPU_OAMADDR: return ppureg.oamaddr;
-    case PPU_OAMDATA: return oamRAM[ppureg.oamaddr];
-    case PPU_SCROLL: return ppureg.scroll;
+    case PPU_OAMADDR: return hot.ppureg.oamaddr;
+    case PPU_OAMDATA: return oamRAM[hot.ppureg.oamaddr];
+    case PPU_SCROLL: return hot.ppureg.scroll;
     case PPU_PPUDATA: {
-      if (addressBuffer < 0x2000) { // chr
-        ppureg.ppudata = dataBuffer;
-        dataBuffer = chrROM[addressBuffer & 0x3FFF];
-      } else if (addressBuffer < 0x3F00) { // nametable
-        ppureg.ppudata = dataBuffer;
-        dataBuffer = vidRAM[addressBuffer - 0x2000];
+      uint16_t address = (ppuMode == PPURENDER_DOT) ? (hot.loopyV & 0x3FFF) : hot.addressBuffer;
+      if (address < 0x2000) { // chr
+        hot.ppureg.ppudata = hot.dataBuffer;
+        hot.dataBuffer = ppu_readChr(address);
+      } else if (address < 0x3F00) { // nametable
+        hot.ppureg.ppudata = hot.dataBuffer;
+        hot.dataBuffer = vidRAM[address - 0x2000];
       } else { // palette
-        ppureg.ppudata = paletteRAM[addressBuffer - 0x3F00];
+        hot.ppureg.ppudata = paletteRAM[(address - 0x3F00) & 0x1F];
       }
-      addressBuffer += ppu_getControlFlag(PPUCTRL_INCREMENT) ? 32 : 1;
-      return ppureg.ppudata;
+      hot.addressBuffer += ppu_getControlFlag(PPUCTRL_INCREMENT) ? 32 : 1;
+      hot.loopyV = (hot.loopyV + (ppu_getControlFlag(PPUCTRL_INCREMENT) ? 32 : 1)) & 0x7FFF;
+      return hot.ppureg.ppudata;
     }
-    case PPU_PPUADDR: return ppureg.ppuaddr;
-    case PPU_OAMDMA: return ppureg.oamdma;
+    case PPU_PPUADDR: return hot.ppureg.ppuaddr;
+    case PPU_OAMDMA: return hot.ppureg.oamdma;
   }
   return 0;
 }
 
 void ppu_writeRegister(PPURegisterType r, uint8_t data) {
+  if (ppuMode == PPURENDER_DOT) ppu_catchUpDots();
   switch (r) {
     case PPU_CONTROL: {
-      ppureg.control = data;
+      hot.ppureg.control = data;
+      hot.loopyT = (hot.loopyT & 0xF3FF) | ((uint16_t)(data & BIT_FILL_2) << 10);
       break;
     }
     case PPU_MASK: {
-      ppureg.mask = data;
+      hot.ppureg.mask = data;
       break;
     }
     case PPU_STATUS: {
-      ppureg.ppuStatus = data;
-      addressLatch = false;
-      scrollLatch = false;
+      hot.ppureg.ppuStatus = data;
+      hot.addressLatch = false;
+      hot.scrollLatch = false;
+      hot.writeToggle = false;
       ppu_setStatusFlag(PPUSTAT_VBLKSTART, false);
       break;
     }
     case PPU_OAMADDR: {
-      ppureg.oamaddr = data;
+      hot.ppureg.oamaddr = data;
       break;
     }
     case PPU_OAMDATA: {
-      ppureg.oamdata = data;
-      oamRAM[ppureg.oamaddr] = ppureg.oamdata;
+      hot.ppureg.oamdata = data;
+      oamRAM[hot.ppureg.oamaddr] = hot.ppureg.oamdata;
+      spriteLists.stale = true;
       break;
     }
     case PPU_SCROLL: {
-      scrollLatch ? (scrollY = data) : (scrollX = data);
-      scrollLatch = !scrollLatch;
-      ppureg.scroll = data;
+      hot.scrollLatch ? (hot.scrollY = data) : (hot.scrollX = data);
+      hot.scrollLatch = !hot.scrollLatch;
+      hot.ppureg.scroll = data;
+      if (hot.writeToggle) {
+        hot.loopyT = (hot.loopyT & 0x0C1F) | ((uint16_t)(data & 0x07) << 12) | ((uint16_t)(data & 0xF8) << 2);
+      } else {
+        hot.loopyT = (hot.loopyT & 0x7FE0) | (data >> 3);
+        hot.fineX = data & 0x07;
+      }
+      hot.writeToggle = !hot.writeToggle;
       break;
     }
     case PPU_PPUDATA: {
-      ppureg.ppudata = data;
-      ppu_writeMem(addressBuffer, ppureg.ppudata);
-      addressBuffer += ppu_getControlFlag(PPUCTRL_INCREMENT) ? 32 : 1;
+      hot.ppureg.ppudata = data;
+      ppu_writeMem((ppuMode == PPURENDER_DOT) ? hot.loopyV : hot.addressBuffer, hot.ppureg.ppudata);
+      hot.addressBuffer += ppu_getControlFlag(PPUCTRL_INCREMENT) ? 32 : 1;
+      hot.loopyV = (hot.loopyV + (ppu_getControlFlag(PPUCTRL_INCREMENT) ? 32 : 1)) & 0x7FFF;
       break;
     }
     case PPU_PPUADDR: {
-      if (addressLatch) {
-        addressBuffer = ((uint16_t) ppureg.ppuaddr) << 8;
-        addressBuffer |= (uint16_t) data;
-        addressLatch = false;
+      if (hot.addressLatch) {
+        hot.addressBuffer = ((uint16_t) hot.ppureg.ppuaddr) << 8;
+        hot.addressBuffer |= (uint16_t) data;
+        hot.addressLatch = false;
       } else {
-        ppureg.ppuaddr = data;
-        addressLatch = true;
+        hot.ppureg.ppuaddr = data;
+        hot.addressLatch = true;
       }
+      if (hot.writeToggle) {
+        hot.loopyT = (hot.loopyT & 0x7F00) | data;
+        hot.loopyV = hot.loopyT;
+      } else {
+        hot.loopyT = (hot.loopyT & 0x00FF) | ((uint16_t)(data & 0x3F) << 8);
+      }
+      hot.writeToggle = !hot.writeToggle;
       break;
     }
     case PPU_OAMDMA: {
@@ -468,15 +1621,95 @@ void ppu_writeRegister(PPURegisterType r, uint8_t data) {
       for (int i = 0; i < 256; i++) {
         oamRAM[i] = readCPUDirect(startAddr + i);
       }
+      spriteLists.stale = true;
       break;
     }
   }
 }
 
+uint8_t* ppu_getBitmap() {
+  return bitmap;
+}
+
+uint8_t* ppu_getEmphasis() {
+  return lineEmphasis;
+}
+
+void ppu_setRenderingEnabled(bool enabled) {
+  hot.renderingEnabled = enabled;
+}
+
+void ppu_saveState(PPUState* state) {
+  state->reg = hot.ppureg;
+  state->addressBuffer = hot.addressBuffer;
+  state->scrollX = hot.scrollX;
+  state->scrollY = hot.scrollY;
+  state->dataBuffer = hot.dataBuffer;
+  state->addressLatch = hot.addressLatch;
+  state->scrollLatch = hot.scrollLatch;
+  state->triggerSpriteZero = hot.triggerSpriteZero;
+  state->didRenderFrame = hot.didRenderFrame;
+  memcpy(state->oamRAM, oamRAM, sizeof(oamRAM));
+  memcpy(state->vidRAM, vidRAM, sizeof(vidRAM));
+  memcpy(state->paletteRAM, paletteRAM, sizeof(paletteRAM));
+  state->ppuCycles = hot.ppuCycles;
+  state->ppuFrames = hot.ppuFrames;
+  state->scanline = hot.scanline;
+  state->spriteZeroScanline = hot.spriteZeroScanline;
+  state->initialScrollX = hot.initialScrollX;
+  state->initialScrollY = hot.initialScrollY;
+  state->scanlineCycleCounter = hot.scanlineCycleCounter;
+  state->loopyV = hot.loopyV;
+  state->loopyT = hot.loopyT;
+  state->fineX = hot.fineX;
+  state->writeToggle = hot.writeToggle;
+  state->oddFrame = hot.oddFrame;
+  state->renderedDot = hot.renderedDot;
+  state->dot = dot;
+}
+
+void ppu_loadState(PPUState* state) {
+  hot.ppureg = state->reg;
+  hot.addressBuffer = state->addressBuffer;
+  hot.scrollX = state->scrollX;
+  hot.scrollY = state->scrollY;
+  hot.dataBuffer = state->dataBuffer;
+  hot.addressLatch = state->addressLatch;
+  hot.scrollLatch = state->scrollLatch;
+  hot.triggerSpriteZero = state->triggerSpriteZero;
+  hot.didRenderFrame = state->didRenderFrame;
+  memcpy(oamRAM, state->oamRAM, sizeof(oamRAM));
+  memcpy(vidRAM, state->vidRAM, sizeof(vidRAM));
+  ppu_invalidateBackground();
+  strip.valid = false;
+  spriteLists.stale = true;
+  memcpy(paletteRAM, state->paletteRAM, sizeof(paletteRAM));
+  hot.ppuCycles = state->ppuCycles;
+  hot.ppuFrames = state->ppuFrames;
+  hot.scanline = state->scanline;
+  hot.spriteZeroScanline = state->spriteZeroScanline;
+  hot.initialScrollX = state->initialScrollX;
+  hot.initialScrollY = state->initialScrollY;
+  hot.scanlineCycleCounter = state->scanlineCycleCounter;
+  hot.loopyV = state->loopyV;
+  hot.loopyT = state->loopyT;
+  hot.fineX = state->fineX;
+  hot.writeToggle = state->writeToggle;
+  hot.oddFrame = state->oddFrame;
+  hot.renderedDot = state->renderedDot;
+  dot = state->dot;
+}
+
 static force_inline void ppu_writeMem(uint16_t address, uint8_t data) {
   address = address & 0x3FFF;
-  if (address < 0x2000) { // chr rom
-    // read only -- invalid operation
+  if (address < 0x2000) { // chr
+    // CHR ROM is read only; CHR RAM tiles are decoded again when next drawn
+    uint8_t* pattern = &chrMap[address >> 10][address & 0x03FF];
+    if (chrWritable && *pattern != data) {
+      *pattern = data;
+      chrDirty[chrWindowSlot[address >> 10]] |= 1ULL << ((address >> 4) & 63);
+      chrCacheStale = true;
+    }
   } else if (address < 0x3F00) {
     // I'm sure this incredibly convoluted mirroring makes more sense in
     // the real hardware implementation. But boy is this a mess in software!
@@ -490,7 +1723,7 @@ static force_inline void ppu_writeMem(uint16_t address, uint8_t data) {
     // Vertical mirroring: $2000 equals $2800 and $2400 equals $2C00 (e.g. Super Mario Bros.)
     // Horizontal mirroring: $2000 equals $2400 and $2800 equals $2C00 (e.g. Kid Icarus)
     if (verticalMirroring) {
-      if ((primaryAddr / 0x400) & 3) { // (if quadrant >= 2)
+      if ((primaryAddr / 0x400) & 2) { // (if quadrant >= 2)
         secondaryAddr = primaryAddr - 0x0800;
       } else {
         secondaryAddr = primaryAddr + 0x0800;
@@ -508,6 +1741,9 @@ static force_inline void ppu_writeMem(uint16_t address, uint8_t data) {
     // 0x2000-0x2FFF mirrors 0x3000-0x3FFF
     vidRAM[primaryAddr + 0x1000] = data;
     vidRAM[secondaryAddr + 0x1000] = data;
+    ppu_markBackgroundDirty(primaryAddr);
+    ppu_markBackgroundDirty(secondaryAddr);
+    vramGeneration++;
   } else if (address < 0x4000) {
     address &= 0x1F;
     if (address == 0x0010 || address == 0x0014 || address == 0x0018 || address == 0x001C) {
@@ -34,6 +34,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 typedef enum {
   PPU_CONTROL,
@@ -47,17 +48,83 @@ typedef enum {
   PPU_OAMDMA
 } PPURegisterType;
 
+/**
+ * @brief The background and sprite pipeline of PPURENDER_DOT
+ */
+typedef struct {
+  uint16_t patternLo;       // background shift registers
+  uint16_t patternHi;
+  uint16_t attributeLo;
+  uint16_t attributeHi;
+  uint8_t nextTile;         // latched by the background fetches
+  uint8_t nextAttribute;
+  uint8_t nextLo;
+  uint8_t nextHi;
+  uint8_t spriteCount;      // sprites on this scanline (up to 8)
+  uint8_t spriteZeroInLine;
+  uint8_t spriteX[8];
+  uint8_t spriteLo[8];      // pattern rows, already flipped horizontally
+  uint8_t spriteHi[8];
+  uint8_t spriteAttribute[8];
+} PPUDotState;
+
+/**
+ * @brief A row of background tiles fetched once by PPURENDER_SCANLINE
+ *        and drawn on each of its 8 scanlines, along with everything the
+ *        fetch depended on
+ */
+typedef struct {
+  uint8_t rows[8][33 * 8];  // background indices of each scanline
+  uint8_t valid;
+  uint8_t tileRow;          // the tile row of the screen (y / 8)
+  uint8_t coarseX;
+  uint8_t coarseY;
+  uint16_t nametable;       // base address of the nametable
+  uint16_t bankOffset;
+  uint32_t vramGeneration;
+  uint32_t chrGeneration;
+} PPUTileStrip;
+
+/**
+ * @brief The sprites on each scanline, found by one pass over OAM for
+ *        PPURENDER_SCANLINE and PPURENDER_FRAME
+ */
+typedef struct {
+  uint8_t count[DISPLAY_HEIGHT];      // sprites on each line (up to 8)
+  uint8_t sprites[DISPLAY_HEIGHT][8]; // their offsets in OAM, in OAM order
+  uint16_t overflowLine;              // first line with more than 8
+  uint8_t height;                     // 8 or 16
+  uint8_t stale;                      // OAM changed since the last pass
+} PPUSpriteLists;
+
 typedef struct {
-  uint8_t control;
-  uint8_t mask;
-  uint8_t ppuStatus;
-  uint8_t oamaddr;
-  uint8_t oamdata;
-  uint8_t scroll;
-  uint8_t ppuaddr;
-  uint8_t ppudata;
-  uint8_t oamdma;
-} PPURegisters;
+  PPURegisters reg;
+  uint16_t addressBuffer;
+  uint8_t scrollX;
+  uint8_t scrollY;
+  uint8_t dataBuffer;
+  bool addressLatch;
+  bool scrollLatch;
+  bool triggerSpriteZero;
+  bool didRenderFrame;
+  uint8_t oamRAM[0x0100];
+  uint8_t vidRAM[0x2000];
+  uint8_t paletteRAM[32];
+  uint64_t ppuCycles;
+  uint64_t ppuFrames;
+  uint16_t scanline;
+  uint16_t spriteZeroScanline;
+  uint16_t initialScrollX;
+  uint16_t initialScrollY;
+  uint16_t scanlineCycleCounter;
+  uint16_t loopyV;
+  uint16_t loopyT;
+  uint8_t fineX;
+  uint8_t writeToggle;
+  uint8_t oddFrame;
+  uint16_t renderedDot;
+  PPUDotState dot;
+} PPUState;
 
 enum PPUControlFlag {
   PPUCTRL_NAMETABLE1  = 0x1,
@@ -95,20 +162,60 @@ enum PPUStatusFlag {
 /* PUBLIC METHODS - INTENDED FOR EXTERNAL USE */
 
 /**
- * @brief Intialize PPU
+ * @brief Connect the PPU to a cartridge, without resetting it. Banks
+ *        already decoded are kept if it's the same cartridge as before.
  * 
- * @param vram the pointer to the VRAM
- * @param crom the pointer to the CHR ROM
+ * @param crom the pointer to the CHR ROM (or CHR RAM)
+ * @param chrSize the size of crom (in bytes, a multiple of 1 KB)
+ * @param cartID identifies the cartridge for the life of the process
+ *        (0 if it can't be told apart from others)
+ * @param cram whether crom is 8 KB of CHR RAM, writable through PPUDATA
+ * @param vmirror whether nametables are mirrored vertically
+ * @param r reads CPU memory for OAM DMA
+ * @param c receives each completed frame
+ * @param mode how the PPU will be run (which of the ppu_run functions)
+ */
+void ppu_insertCartridge(uint8_t* crom, uint32_t chrSize, uint32_t cartID, bool cram, bool vmirror, uint8_t(*r)(uint16_t), void(*c)(uint8_t*), PPURenderMode mode);
+
+/**
+ * @brief Intialize PPU, once a cartridge is inserted
  */
-void ppu_init(uint8_t* crom, bool vmirror, uint8_t(*r)(uint16_t), void(*c)(uint32_t*));
+void ppu_init();
 
 /**
  * 
- * @brief Run the specified amount of cycles on the PPU
+ * @brief Run the specified amount of cycles on the PPU, drawing the whole
+ *        frame at once when it reaches vblank (PPURENDER_FRAME).
+ *        Sprite zero hit is only approximated in this mode: it's raised
+ *        on the lines sprite zero's OAM Y covers whenever background and
+ *        sprites are both shown. Unlike the scanline and dot renderers, it
+ *        doesn't check for opaque pixels, PPUMASK_BKGLEFT,
+ *        PPUMASK_SPRITLEFT or x = 255.
  * 
  * @param cycleCount the number of cycles
  */
-void ppu_runCycles(uint32_t cycleCount);
+void ppu_runFrameCycles(uint32_t cycleCount);
+
+/**
+ * 
+ * @brief Run the specified amount of cycles on the PPU, drawing each
+ *        scanline as it completes (PPURENDER_SCANLINE)
+ * 
+ * @param cycleCount the number of cycles
+ */
+void ppu_runScanlineCycles(uint32_t cycleCount);
+
+/**
+ * 
+ * @brief Run the specified amount of cycles on the PPU, modelling the
+ *        v/t/x/w registers and shift registers dot by dot (PPURENDER_DOT).
+ *        Scanlines are drawn when they end; only a scanline during which a
+ *        PPU register was accessed is stepped dot by dot, and the rest are
+ *        drawn in a single pass with the same result.
+ * 
+ * @param cycleCount the number of cycles
+ */
+void ppu_runDotCycles(uint32_t cycleCount);
 
 /**
  * @brief Set a status flag of PPU
@@ -174,52 +281,89 @@ uint8_t ppu_readRegister(PPURegisterType reg);
  */
 void ppu_writeRegister(PPURegisterType r, uint8_t data);
 
-/* PRIVATE METHODS - NOT INTENDED FOR EXTERNAL USE */
+/**
+ * @brief Get the most recently drawn frame
+ * 
+ * @return uint8_t* the DISPLAY_WIDTH x DISPLAY_HEIGHT bitmap of palette
+ *         indices (0-63); see ppu_convertBitmap
+ */
+uint8_t* ppu_getBitmap();
 
 /**
- * @brief Parse CHR ROM data for quicker reading
+ * @brief Get the color emphasis of each line of the bitmap
+ * 
+ * @return uint8_t* DISPLAY_HEIGHT values of PPUMASK bits 5-7, shifted
+ *         down to 0-7
  */
-void ppu_generateChrCache();
+uint8_t* ppu_getEmphasis();
 
 /**
- * @brief Draw a tile on the screen
+ * @brief Get the colors of the 64 palette indices under one emphasis
  * 
- * @param bank the tile bank
- * @param tileID the tile ID
- * @param x the x position
- * @param y the y position
+ * @param palette the 64 colors to fill
+ * @param emphasis the emphasis (0-7)
+ * @param format the pixel layout to produce
  */
-static force_inline void ppu_drawTile(bool flipHorizontally, bool flipVertically, bool transparent, bool behindBackground, bool background, uint16_t tileID, uint8_t palette, uint16_t x, uint16_t y);
+void ppu_getPalette(uint32_t* palette, uint8_t emphasis, PPUPixelFormat format);
 
 /**
- * @brief Set a pixel on the bitmap
+ * @brief Convert an indexed bitmap to colors
  * 
- * @param color the RGB color of the pixel
- * @param x the x location on the bitmap
- * @param y the y location on the bitmap
+ * @param dst the DISPLAY_WIDTH x DISPLAY_HEIGHT pixels to write
+ * @param pixels the palette indices, as from ppu_getBitmap
+ * @param emphasis the emphasis of each line, as from ppu_getEmphasis
+ * @param format the pixel layout to produce
  */
-static force_inline void ppu_setPixel(uint32_t color, int16_t x, int16_t y);
+void ppu_convertBitmap(uint32_t* dst, const uint8_t* pixels, const uint8_t* emphasis, PPUPixelFormat format);
 
 /**
- * @brief Draw a scanline
+ * @brief Enable or disable drawing frames (e.g. while re-simulating).
+ *        Nothing is written to the bitmap while disabled, but timing and
+ *        flags are unchanged: in scanline and dot mode, the background is
+ *        still fetched where sprite zero could hit it.
  * 
- * @param y the scanline to draw
+ * @param enabled false to skip drawing frames
  */
-static force_inline void ppu_drawScanline(uint8_t y);
+void ppu_setRenderingEnabled(bool enabled);
 
 /**
- * @brief Draw an entire frame
+ * @brief Copy the internal state of the PPU
+ * 
+ * @param state the pointer to the state object to fill
+ */
+void ppu_saveState(PPUState* state);
+
+/**
+ * @brief Restore the internal state of the PPU
+ * 
+ * @param state the pointer to the state object to restore from
+ */
+void ppu_loadState(PPUState* state);
+
+/**
+ * @brief Re-decode every tile of CHR RAM before the next scanline, after
+ *        its contents were replaced (e.g. by loading a state)
+ */
+void ppu_invalidateChrCache();
+
+/**
+ * @brief Show a 1 KB bank of CHR through one of the 8 windows of the
+ *        pattern tables. This only swaps pointers: a bank that was shown
+ *        recently is still decoded, and any other is decoded before the
+ *        next scanline drawn with it.
+ * 
+ * @param window the window (0 for $0000-$03FF ... 7 for $1C00-$1FFF)
+ * @param bank the bank, counting 1 KB from the start of CHR
  */
-static force_inline void ppu_drawFrame();
+void ppu_mapChrBank(uint8_t window, uint16_t bank);
 
 /**
- * @brief Perform write operation at mapped address.
- *        Note that read operations are simply done through
- *        direct array access.
+ * @brief Get a decoded tile of the pattern tables (for debugging views)
  * 
- * @param address the address to write to
- * @param data the data to write
+ * @param tileID the tile ID, including the bank
+ * @return const uint64_t* the 8 rows, byte n of each being the color
+ *         number (0-3) of pixel n from the left
  */
-static force_inline void ppu_writeMem(uint16_t address, uint8_t data);
+const uint64_t* ppu_getTileRows(uint16_t tileID);
 
 #endif
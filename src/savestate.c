@@ -0,0 +1,222 @@
+/**
+ * @file savestate.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "savestate.h"
+
+pthread_t workerThread;
+pthread_mutex_t requestMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t requestCond = PTHREAD_COND_INITIALIZER;
+
+char* slotBasePath = NULL;
+uint32_t stateSize = 0;
+bool workerRunning = false;
+bool workerShouldExit = false;
+
+// pending save (guarded by requestMutex)
+uint8_t* pendingSnapshot = NULL;
+uint8_t pendingSaveSlot = 0;
+bool pendingSave = false;
+
+// pending load (guarded by requestMutex)
+uint8_t pendingLoadSlot = 0;
+bool pendingLoad = false;
+
+// buffers only touched by the worker
+uint8_t* writeSnapshot = NULL;
+uint8_t* readSnapshot = NULL;
+uint8_t* compressBuffer = NULL;
+
+// finished load, handed back to the emulation thread
+uint8_t* loadedSnapshot = NULL;
+atomic_bool loadReady = false;
+
+void savestate_init(char* romPath, uint32_t size) {
+  if (workerRunning || romPath == NULL) return;
+
+  // strip the extension so that slots sit beside the ROM
+  size_t len = strlen(romPath);
+  slotBasePath = malloc(len + 1);
+  strcpy(slotBasePath, romPath);
+  char* ext = strrchr(slotBasePath, '.');
+  char* dir = strrchr(slotBasePath, '/');
+  if (ext != NULL && (dir == NULL || ext > dir)) *ext = '\0';
+
+  stateSize = size;
+  pendingSnapshot = malloc(stateSize);
+  writeSnapshot = malloc(stateSize);
+  readSnapshot = malloc(stateSize);
+  loadedSnapshot = malloc(stateSize);
+  compressBuffer = malloc(sizeof(SaveStateHeader) + lz_maxCompressedSize(stateSize));
+
+  workerShouldExit = false;
+  workerRunning = (pthread_create(&workerThread, NULL, &savestate_worker, NULL) == 0);
+}
+
+bool savestate_save(uint8_t slot, void* snapshot) {
+  if (!workerRunning || slot >= SAVESTATE_SLOT_COUNT) return false;
+  pthread_mutex_lock(&requestMutex);
+  memcpy(pendingSnapshot, snapshot, stateSize);
+  pendingSaveSlot = slot;
+  pendingSave = true;
+  pthread_cond_signal(&requestCond);
+  pthread_mutex_unlock(&requestMutex);
+  return true;
+}
+
+void savestate_requestLoad(uint8_t slot) {
+  if (!workerRunning || slot >= SAVESTATE_SLOT_COUNT) return;
+  pthread_mutex_lock(&requestMutex);
+  pendingLoadSlot = slot;
+  pendingLoad = true;
+  pthread_cond_signal(&requestCond);
+  pthread_mutex_unlock(&requestMutex);
+}
+
+bool savestate_pollLoad(void* snapshot) {
+  // cheap enough to check every frame; the lock is only taken on success
+  if (!atomic_load_explicit(&loadReady, memory_order_acquire)) return false;
+  pthread_mutex_lock(&requestMutex);
+  memcpy(snapshot, loadedSnapshot, stateSize);
+  atomic_store_explicit(&loadReady, false, memory_order_release);
+  pthread_mutex_unlock(&requestMutex);
+  return true;
+}
+
+void savestate_kill() {
+  if (!workerRunning) return;
+  pthread_mutex_lock(&requestMutex);
+  workerShouldExit = true;
+  pthread_cond_signal(&requestCond);
+  pthread_mutex_unlock(&requestMutex);
+  pthread_join(workerThread, NULL);
+  workerRunning = false;
+}
+
+void* savestate_worker(void* arg) {
+  pthread_mutex_lock(&requestMutex);
+  while (true) {
+    while (!pendingSave && !pendingLoad && !workerShouldExit) {
+      pthread_cond_wait(&requestCond, &requestMutex);
+    }
+
+    if (pendingSave) {
+      // take ownership of the snapshot so the emulator can queue another
+      uint8_t slot = pendingSaveSlot;
+      memcpy(writeSnapshot, pendingSnapshot, stateSize);
+      pendingSave = false;
+      pthread_mutex_unlock(&requestMutex);
+      savestate_writeSlot(slot, writeSnapshot);
+      pthread_mutex_lock(&requestMutex);
+    } else if (pendingLoad) {
+      uint8_t slot = pendingLoadSlot;
+      pendingLoad = false;
+      pthread_mutex_unlock(&requestMutex);
+
+      bool success = savestate_readSlot(slot, readSnapshot);
+
+      // publish under the lock so pollLoad never sees a partial copy
+      pthread_mutex_lock(&requestMutex);
+      if (success && !pendingLoad) {
+        memcpy(loadedSnapshot, readSnapshot, stateSize);
+        atomic_store_explicit(&loadReady, true, memory_order_release);
+      }
+    } else {
+      break; // nothing left to flush
+    }
+  }
+  pthread_mutex_unlock(&requestMutex);
+  return NULL;
+}
+
+bool savestate_writeSlot(uint8_t slot, uint8_t* snapshot) {
+  char path[strlen(slotBasePath) + 8];
+  char tempPath[strlen(slotBasePath) + 12];
+  savestate_slotPath(slot, path);
+  strcpy(tempPath, path);
+  strcat(tempPath, ".tmp");
+
+  SaveStateHeader header;
+  header.magic = SAVESTATE_MAGIC;
+  header.version = SAVESTATE_VERSION;
+  header.stateSize = stateSize;
+  header.compressedSize = lz_compress(snapshot, stateSize, compressBuffer + sizeof(header), lz_maxCompressedSize(stateSize));
+  memcpy(compressBuffer, &header, sizeof(header));
+
+  // write to a temporary file, then rename it over the slot so that
+  // a crash mid-write never leaves a truncated save behind
+  int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  size_t total = sizeof(header) + header.compressedSize;
+  size_t written = 0;
+  while (written < total) {
+    ssize_t n = write(fd, compressBuffer + written, total - written);
+    if (n <= 0) {
+      close(fd);
+      unlink(tempPath);
+      return false;
+    }
+    written += n;
+  }
+  fsync(fd);
+  close(fd);
+  return rename(tempPath, path) == 0;
+}
+
+bool savestate_readSlot(uint8_t slot, uint8_t* snapshot) {
+  char path[strlen(slotBasePath) + 8];
+  savestate_slotPath(slot, path);
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SaveStateHeader)) {
+    close(fd);
+    return false;
+  }
+  uint8_t* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return false;
+
+  SaveStateHeader header;
+  memcpy(&header, map, sizeof(header));
+  bool valid = header.magic == SAVESTATE_MAGIC
+    && header.version == SAVESTATE_VERSION
+    && header.stateSize == stateSize
+    && header.compressedSize <= st.st_size - sizeof(header);
+
+  // decompress from the mapping straight into the snapshot buffer
+  if (valid) {
+    valid = lz_decompress(map + sizeof(header), header.compressedSize, snapshot, stateSize) == stateSize;
+  }
+  munmap(map, st.st_size);
+  return valid;
+}
+
+void savestate_slotPath(uint8_t slot, char* path) {
+  strcpy(path, slotBasePath);
+  strcat(path, ".ss");
+  size_t len = strlen(path);
+  path[len] = '1' + slot;
+  path[len + 1] = '\0';
+}
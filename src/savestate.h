@@ -0,0 +1,143 @@
+/**
+ * @file savestate.h
+ * @author Noah Sadir (development.noahsadir@gmail.com)
+ * @brief Persist machine snapshots to disk in the background
+ * @version 1.0
+ * @date 2026-10-19
+ * 
+ * @copyright Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "globalflags.h"
+#include "lz.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Number of save slots available per ROM
+ */
+#define SAVESTATE_SLOT_COUNT 4
+
+/**
+ * @brief Identifies a save state file ("NESS")
+ */
+#define SAVESTATE_MAGIC 0x5353454E
+
+/**
+ * @brief Bump whenever the layout of the machine snapshot changes
+ */
+#define SAVESTATE_VERSION 4
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t stateSize;
+  uint32_t compressedSize;
+} SaveStateHeader;
+
+/**
+ * @brief Start the background writer.
+ *        Slot files are stored next to the ROM (e.g. game.ss1).
+ * 
+ * @param romPath the path of the loaded ROM
+ * @param size the size of a machine snapshot (in bytes)
+ */
+void savestate_init(char* romPath, uint32_t size);
+
+/**
+ * @brief Queue a snapshot to be compressed and written to a slot.
+ *        Only the copy happens on the calling thread; if a previous
+ *        snapshot hasn't been written yet, it is replaced.
+ * 
+ * @param slot the slot to write (0 to SAVESTATE_SLOT_COUNT - 1)
+ * @param snapshot the machine snapshot
+ * @return true if the snapshot was queued
+ */
+bool savestate_save(uint8_t slot, void* snapshot);
+
+/**
+ * @brief Ask the background thread to read a slot.
+ *        Use savestate_pollLoad to pick up the result.
+ * 
+ * @param slot the slot to read (0 to SAVESTATE_SLOT_COUNT - 1)
+ */
+void savestate_requestLoad(uint8_t slot);
+
+/**
+ * @brief Collect the result of the last load request, if it is ready
+ * 
+ * @param snapshot the buffer to copy the machine snapshot into
+ * @return true if a snapshot was copied
+ */
+bool savestate_pollLoad(void* snapshot);
+
+/**
+ * @brief Flush any queued snapshot and stop the background writer
+ */
+void savestate_kill();
+
+/**
+ * @brief Background thread which services save & load requests
+ * 
+ * @param arg unused
+ * @return void* unused
+ */
+void* savestate_worker(void* arg);
+
+/**
+ * @brief Compress a snapshot and atomically replace a slot file
+ * 
+ * @param slot the slot to write
+ * @param snapshot the machine snapshot
+ * @return true if the file was written
+ */
+bool savestate_writeSlot(uint8_t slot, uint8_t* snapshot);
+
+/**
+ * @brief Map a slot file into memory and decompress it
+ * 
+ * @param slot the slot to read
+ * @param snapshot the buffer to decompress into
+ * @return true if the file was valid
+ */
+bool savestate_readSlot(uint8_t slot, uint8_t* snapshot);
+
+/**
+ * @brief Get the file path of a slot
+ * 
+ * @param slot the slot
+ * @param path the output path (at least strlen(romPath) + 8 bytes)
+ */
+void savestate_slotPath(uint8_t slot, char* path);
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ * @file surface.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "surface.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+SurfaceHeader* published = NULL;
+char publishedName[256];
+
+int surface_open(const char* name, const uint32_t* palette) {
+  int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  if (fd < 0) return 0;
+  if (ftruncate(fd, sizeof(SurfaceHeader)) != 0) {
+    close(fd);
+    return 0;
+  }
+  void* map = mmap(NULL, sizeof(SurfaceHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return 0;
+
+  published = map;
+  memset(published, 0, sizeof(SurfaceHeader));
+  published->version = SURFACE_VERSION;
+  published->latest = 1;
+  memcpy(published->palette, palette, sizeof(published->palette));
+  __atomic_store_n(&published->magic, SURFACE_MAGIC, __ATOMIC_RELEASE);
+  strncpy(publishedName, name, sizeof(publishedName) - 1);
+  return 1;
+}
+
+void surface_publish(uint64_t frame, const uint8_t* pixels, const uint8_t* emphasis, const uint8_t* ram) {
+  if (published == NULL) return;
+  uint32_t latest = published->latest;
+  SurfaceSlot* previous = &published->slots[latest];
+  SurfaceSlot* slot = &published->slots[latest ^ 1];
+
+  uint32_t dirty = 0;
+  for (int page = 0; page < SURFACE_PAGE_COUNT; page++) {
+    uint32_t offset = page * SURFACE_PAGE_SIZE;
+    if (memcmp(previous->ram + offset, ram + offset, SURFACE_PAGE_SIZE) != 0) dirty |= (1U << page);
+  }
+
+  // odd while writing; readers which saw the old count will retry
+  uint32_t sequence = slot->sequence;
+  __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  slot->frame = frame;
+  slot->ramDirty = dirty;
+  memcpy(slot->ram, ram, SURFACE_RAM_SIZE);
+  memcpy(slot->emphasis, emphasis, sizeof(slot->emphasis));
+  memcpy(slot->pixels, pixels, sizeof(slot->pixels));
+  __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+  __atomic_store_n(&published->latest, latest ^ 1, __ATOMIC_RELEASE);
+}
+
+void surface_close(void) {
+  if (published == NULL) return;
+  munmap(published, sizeof(SurfaceHeader));
+  shm_unlink(publishedName);
+  published = NULL;
+}
+
+const SurfaceHeader* surface_attach(const char* name) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return NULL;
+  void* map = mmap(NULL, sizeof(SurfaceHeader), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+
+  const SurfaceHeader* header = map;
+  if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SURFACE_MAGIC || header->version != SURFACE_VERSION) {
+    munmap(map, sizeof(SurfaceHeader));
+    return NULL;
+  }
+  return header;
+}
+
+const SurfaceSlot* surface_beginRead(const SurfaceHeader* header, uint32_t* sequence) {
+  const SurfaceSlot* slot;
+  do {
+    slot = &header->slots[__atomic_load_n(&header->latest, __ATOMIC_ACQUIRE)];
+    *sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+  } while (*sequence & 1);
+  return slot;
+}
+
+int surface_endRead(const SurfaceSlot* slot, uint32_t sequence) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence;
+}
+
+void surface_detach(const SurfaceHeader* header) {
+  munmap((void*)header, sizeof(SurfaceHeader));
+}
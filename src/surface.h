@@ -0,0 +1,142 @@
+/**
+ * @file surface.h
+ * @author Noah Sadir (development.noahsadir@gmail.com)
+ * @brief Shared-memory frames for other processes
+ * @version 1.0
+ * @date 2026-10-19
+ * 
+ * @copyright Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef SURFACE_H
+#define SURFACE_H
+
+/*
+ * Publishes each frame's pixels and CPU RAM in a POSIX shared-memory
+ * segment, so encoders, bots and overlays can read them in place with no
+ * system calls. This header is also meant for those readers, so like
+ * nes.h it only depends on the standard headers.
+ *
+ * The segment holds two frame slots which the emulator fills in turn,
+ * each guarded by a sequence lock: the count is odd while the slot is
+ * being written, and a reader's copy is only good if the count was even
+ * and unchanged across it. Readers start at the slot named by `latest`,
+ * which the emulator isn't writing until the frame after.
+ *
+ * Pixels are the PPU's palette indices, a quarter of the size of colors.
+ * A pixel's color is palette[(emphasis[y] * 64) + pixels[(y * 256) + x]].
+ */
+
+#include <stdint.h>
+
+#define SURFACE_MAGIC 0x4E455353 // "NESS"
+#define SURFACE_VERSION 2
+#define SURFACE_WIDTH 256
+#define SURFACE_HEIGHT 240
+#define SURFACE_RAM_SIZE 2048
+#define SURFACE_PAGE_SIZE 64
+#define SURFACE_PAGE_COUNT (SURFACE_RAM_SIZE / SURFACE_PAGE_SIZE)
+#define SURFACE_PALETTE_SIZE 64
+#define SURFACE_EMPHASIS_COUNT 8
+
+typedef struct {
+  uint32_t sequence;
+  uint32_t ramDirty;  // bit n: RAM page n changed since the previous frame
+  uint64_t frame;     // frames since power on
+  uint8_t ram[SURFACE_RAM_SIZE];
+  uint8_t emphasis[SURFACE_HEIGHT];                // per line, 0-7
+  uint8_t pixels[SURFACE_WIDTH * SURFACE_HEIGHT];  // palette indices, 0-63
+} SurfaceSlot;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t latest;    // index of the newest complete slot
+  uint32_t reserved;
+  uint32_t palette[SURFACE_EMPHASIS_COUNT * SURFACE_PALETTE_SIZE]; // 0x00RRGGBB
+  SurfaceSlot slots[2];
+} SurfaceHeader;
+
+/* EMULATOR */
+
+/**
+ * @brief Create (or take over) a segment to publish frames to
+ * 
+ * @param name the shm_open name, e.g. "/nes"
+ * @param palette the colors of the palette indices, 64 per emphasis
+ * @return int 1 on success, 0 on failure
+ */
+int surface_open(const char* name, const uint32_t* palette);
+
+/**
+ * @brief Publish a frame. RAM pages which differ from the previous frame
+ *        are flagged in ramDirty; a reader which skipped frames (frame
+ *        isn't one more than it last saw) should treat all as dirty.
+ * 
+ * @param frame the frame number
+ * @param pixels the frame's palette indices
+ * @param emphasis the emphasis of each line
+ * @param ram the CPU RAM
+ */
+void surface_publish(uint64_t frame, const uint8_t* pixels, const uint8_t* emphasis, const uint8_t* ram);
+
+/**
+ * @brief Unmap and remove the segment
+ */
+void surface_close(void);
+
+/* READERS */
+
+/**
+ * @brief Map an emulator's segment read-only
+ * 
+ * @param name the name given to surface_open
+ * @return const SurfaceHeader* the segment, or NULL if not found
+ */
+const SurfaceHeader* surface_attach(const char* name);
+
+/**
+ * @brief Start reading the newest frame in place
+ * 
+ * @param surface the segment
+ * @param sequence where to keep the slot's sequence for surface_endRead
+ * @return const SurfaceSlot* the slot to read
+ */
+const SurfaceSlot* surface_beginRead(const SurfaceHeader* surface, uint32_t* sequence);
+
+/**
+ * @brief Check that a slot wasn't overwritten while being read
+ * 
+ * @param slot the slot from surface_beginRead
+ * @param sequence the sequence from surface_beginRead
+ * @return int 1 if everything read since surface_beginRead is consistent,
+ *         0 if it must be read again
+ */
+int surface_endRead(const SurfaceSlot* slot, uint32_t sequence);
+
+/**
+ * @brief Unmap a segment from surface_attach
+ * 
+ * @param surface the segment
+ */
+void surface_detach(const SurfaceHeader* surface);
+
+#endif
@@ -0,0 +1,152 @@
+/**
+ * @file lanes.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "../cpubatch.h"
+
+#include <sys/time.h>
+#include <unistd.h>
+
+/**
+ * @brief Instructions to run per lane unless told otherwise
+ */
+#define LANES_DEFAULT_INSTRUCTIONS 1000000
+
+uint8_t* scalarMemory;
+
+static uint8_t lanes_read(uint16_t addr) {
+  return scalarMemory[addr];
+}
+
+static void lanes_write(uint16_t addr, uint8_t val) {
+  scalarMemory[addr] = val;
+}
+
+static double lanes_now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+/**
+ * @brief Lay out an NROM cartridge's PRG ROM in a flat memory image
+ */
+static bool lanes_loadImage(char* path, uint8_t* image) {
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) return false;
+  uint8_t header[16];
+  bool ok = (fread(header, 1, 16, fp) == 16) && memcmp(header, "NES\x1A", 4) == 0 && header[4] > 0;
+  if (ok && (header[6] & 0x04)) fseek(fp, 512, SEEK_CUR); // trainer
+  uint32_t prgSize = (header[4] > 2 ? 2 : header[4]) * 0x4000;
+  ok = ok && fread(image + 0x8000, 1, prgSize, fp) == prgSize;
+  if (ok && prgSize == 0x4000) memcpy(image + 0xC000, image + 0x8000, 0x4000);
+  fclose(fp);
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  uint64_t instructions = LANES_DEFAULT_INSTRUCTIONS;
+  bool verify = false;
+  long divergeAddr = -1;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:d:v")) != -1) {
+    switch (opt) {
+      case 'n': instructions = strtoull(optarg, NULL, 0); break;
+      case 'd': divergeAddr = strtol(optarg, NULL, 0) & 0xFFFF; break;
+      case 'v': verify = true; break;
+      default:
+        fprintf(stderr, "Usage: %s [-n INSTRUCTIONS] [-d ADDR] [-v] ROM\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "Usage: %s [-n INSTRUCTIONS] [-d ADDR] [-v] ROM\n", argv[0]);
+    return 1;
+  }
+
+  // every lane, and a scalar copy of every lane, from the same image
+  uint8_t* images[CPU_BATCH_LANES * 2];
+  for (int i = 0; i < CPU_BATCH_LANES * 2; i++) {
+    images[i] = calloc(0x10000, 1);
+    if (!lanes_loadImage(argv[optind], images[i])) {
+      fprintf(stderr, "Unable to read an NROM image from %s\n", argv[optind]);
+      return 1;
+    }
+    if (divergeAddr >= 0) images[i][divergeAddr] = (i % CPU_BATCH_LANES) * 37;
+  }
+  CPURegisters regs = {0x00, 0x00, 0x00, images[0][0xFFFC] | (images[0][0xFFFD] << 8), 0xFD, 0x24};
+
+  CPUBatch batch;
+  cpubatch_init(&batch);
+  cpubatch_setVerify(&batch, verify);
+  for (int lane = 0; lane < CPU_BATCH_LANES; lane++) {
+    cpubatch_setLane(&batch, lane, &regs, images[lane]);
+  }
+  double t0 = lanes_now();
+  cpubatch_run(&batch, instructions);
+  double batchTime = lanes_now() - t0;
+
+  CPUState scalar[CPU_BATCH_LANES];
+  uint64_t scalarInstructions = 0;
+  t0 = lanes_now();
+  for (int lane = 0; lane < CPU_BATCH_LANES; lane++) {
+    scalar[lane].reg = regs;
+    scalar[lane].clockMode = CPUCLOCK_SUSPENDED;
+    scalar[lane].cpuerrno = 0;
+    scalarMemory = images[CPU_BATCH_LANES + lane];
+    for (uint64_t i = 0; i < instructions && scalar[lane].clockMode != CPUCLOCK_HALT; i++) {
+      cpu6502_executeDetached(&scalar[lane], &lanes_write, &lanes_read);
+      scalarInstructions += 1;
+    }
+  }
+  double scalarTime = lanes_now() - t0;
+
+  // both schedules must end in the same place
+  int differing = 0;
+  for (int lane = 0; lane < CPU_BATCH_LANES; lane++) {
+    CPUState state;
+    cpubatch_getLane(&batch, lane, &state);
+    CPURegisters* r = &scalar[lane].reg;
+    bool sameRegs = state.reg.a == r->a && state.reg.x == r->x && state.reg.y == r->y && state.reg.s == r->s && state.reg.p == r->p && state.reg.pc == r->pc;
+    if (!sameRegs || memcmp(images[lane], images[CPU_BATCH_LANES + lane], 0x10000) != 0) {
+      differing += 1;
+      printf("lane %d: batch PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X, scalar PC:%04X A:%02X X:%02X Y:%02X P:%02X SP:%02X\n", lane,
+        state.reg.pc, state.reg.a, state.reg.x, state.reg.y, state.reg.p, state.reg.s,
+        scalar[lane].reg.pc, scalar[lane].reg.a, scalar[lane].reg.x, scalar[lane].reg.y, scalar[lane].reg.p, scalar[lane].reg.s);
+    }
+  }
+
+  CPUBatchStats* stats = &batch.stats;
+  printf("lanes:              %d\n", CPU_BATCH_LANES);
+  printf("issues:             %llu (%.1f%% vector)\n", (unsigned long long)stats->issues, stats->issues ? 100.0 * stats->vectorIssues / stats->issues : 0.0);
+  printf("lanes per issue:    %.2f\n", stats->issues ? (double)stats->laneInstructions / stats->issues : 0.0);
+  printf("batch:              %.1f ns/instruction\n", 1e9 * batchTime / (stats->laneInstructions ? stats->laneInstructions : 1));
+  printf("scalar:             %.1f ns/instruction\n", 1e9 * scalarTime / (scalarInstructions ? scalarInstructions : 1));
+  if (verify) printf("verify mismatches:  %llu\n", (unsigned long long)stats->mismatches);
+  printf("final state:        %s\n", differing ? "DIFFERS from scalar" : "matches scalar");
+
+  for (int i = 0; i < CPU_BATCH_LANES * 2; i++) {
+    free(images[i]);
+  }
+  return (differing || stats->mismatches) ? 2 : 0;
+}
@@ -0,0 +1,312 @@
+/**
+ * @file runner.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "../nes.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * @brief Frames to run per ROM unless told otherwise (10 sec)
+ */
+#define RUNNER_DEFAULT_FRAMES 600
+
+typedef struct {
+  char* romPath;
+  char* moviePath;
+  char* output;
+  size_t outputSize;
+  size_t outputCapacity;
+  bool done;
+} RunnerJob;
+
+RunnerJob* jobs = NULL;
+uint32_t jobCount = 0;
+uint32_t jobCapacity = 0;
+uint32_t nextJob = 0;
+uint32_t nextPrint = 0;
+pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+
+uint32_t frameCount = RUNNER_DEFAULT_FRAMES;
+uint32_t checkpointInterval = 1;
+
+static void runner_addJob(char* romPath, char* moviePath) {
+  if (jobCount == jobCapacity) {
+    jobCapacity = (jobCapacity == 0) ? 64 : jobCapacity * 2;
+    jobs = realloc(jobs, sizeof(RunnerJob) * jobCapacity);
+  }
+  RunnerJob* job = &jobs[jobCount++];
+  memset(job, 0, sizeof(RunnerJob));
+  job->romPath = strdup(romPath);
+  job->moviePath = (moviePath != NULL) ? strdup(moviePath) : NULL;
+}
+
+static bool runner_readList(char* path) {
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) return false;
+
+  // one job per line: ROM [MOVIE]
+  char line[4096];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    char* rom = strtok(line, " \t\r\n");
+    if (rom == NULL || rom[0] == '#') continue;
+    runner_addJob(rom, strtok(NULL, " \t\r\n"));
+  }
+  fclose(fp);
+  return true;
+}
+
+static uint8_t* runner_readFile(char* path, uint32_t* size) {
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) return NULL;
+  fseek(fp, 0L, SEEK_END);
+  long bytes = ftell(fp);
+  rewind(fp);
+  uint8_t* data = malloc(bytes > 0 ? bytes : 1);
+  *size = fread(data, 1, bytes, fp);
+  fclose(fp);
+  return data;
+}
+
+static void runner_print(RunnerJob* job, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void runner_print(RunnerJob* job, const char* format, ...) {
+  va_list args;
+  char line[512];
+  va_start(args, format);
+  int length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (length < 0) return;
+  if ((size_t)length >= sizeof(line)) length = sizeof(line) - 1;
+
+  if (job->outputSize + length > job->outputCapacity) {
+    job->outputCapacity = (job->outputCapacity + length) * 2;
+    job->output = realloc(job->output, job->outputCapacity);
+  }
+  memcpy(job->output + job->outputSize, line, length);
+  job->outputSize += length;
+}
+
+static inline uint64_t runner_rotl(uint64_t x, uint8_t r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+/**
+ * @brief Non-cryptographic 64-bit hash, 4 independent lanes of 8 bytes
+ *        per step so it keeps up with a frame's worth of pixels
+ */
+static uint64_t runner_hash(const uint8_t* data, size_t size, uint64_t seed) {
+  const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+  const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+  uint64_t lanes[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (int l = 0; l < 4; l++) {
+      uint64_t word;
+      memcpy(&word, data + i + (l * 8), 8);
+      lanes[l] = runner_rotl(lanes[l] + (word * prime2), 31) * prime1;
+    }
+  }
+
+  uint64_t h = runner_rotl(lanes[0], 1) + runner_rotl(lanes[1], 7) + runner_rotl(lanes[2], 12) + runner_rotl(lanes[3], 18) + size;
+  for (; i < size; i++) {
+    h = (h ^ data[i]) * prime1;
+  }
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime1;
+  h ^= h >> 32;
+  return h;
+}
+
+static void runner_runJob(RunnerJob* job) {
+  uint32_t romSize = 0;
+  uint8_t* rom = runner_readFile(job->romPath, &romSize);
+  if (rom == NULL) {
+    runner_print(job, "%s,0,ERROR,NO_ROM\n", job->romPath);
+    return;
+  }
+
+  uint32_t movieSize = 0;
+  uint8_t* movie = NULL;
+  if (job->moviePath != NULL && (movie = runner_readFile(job->moviePath, &movieSize)) == NULL) {
+    runner_print(job, "%s,0,ERROR,NO_MOVIE\n", job->romPath);
+    free(rom);
+    return;
+  }
+
+  // loading from memory never touches the ROM's battery save
+  NES* nes = nes_create();
+  NESLoadResult result = nes_load_rom(nes, rom, romSize);
+  switch (result) {
+    case NES_LOAD_OK: break;
+    case NES_LOAD_NO_ROM: runner_print(job, "%s,0,ERROR,NO_ROM\n", job->romPath); break;
+    case NES_LOAD_INVALID_ROM: runner_print(job, "%s,0,ERROR,INVALID_ROM\n", job->romPath); break;
+    case NES_LOAD_UNSUPPORTED_MAPPER: runner_print(job, "%s,0,ERROR,UNSUPPORTED_MAPPER\n", job->romPath); break;
+  }
+
+  bool halted = false;
+  for (uint32_t frame = 0; frame < frameCount && result == NES_LOAD_OK; frame++) {
+    if (halted) {
+      runner_print(job, "%s,%u,ERROR,CPU_HALT_%02X\n", job->romPath, frame, nes_cpu_error(nes));
+      break;
+    }
+
+    // movies hold both controller ports for each frame, and run out into no input
+    uint8_t inputs[NES_PORT_COUNT] = {0, 0};
+    if ((frame + 1) * NES_PORT_COUNT <= movieSize) {
+      memcpy(inputs, movie + (frame * NES_PORT_COUNT), NES_PORT_COUNT);
+    }
+    for (int port = 0; port < NES_PORT_COUNT; port++) {
+      nes_set_input(nes, port, inputs[port]);
+    }
+    halted = !nes_run_frame(nes);
+
+    if ((frame + 1) % checkpointInterval == 0 || frame + 1 == frameCount) {
+      size_t prgRAMSize;
+      uint8_t* prgRAM = nes_cartridge_ram(nes, &prgRAMSize);
+      uint64_t ramHash = runner_hash(nes_ram(nes), 2048, 0);
+      if (prgRAM != NULL) ramHash = runner_hash(prgRAM, prgRAMSize, ramHash);
+      uint64_t bitmapHash = runner_hash(nes_framebuffer_indexed(nes), NES_WIDTH * NES_HEIGHT, 0);
+      bitmapHash = runner_hash(nes_framebuffer_emphasis(nes), NES_HEIGHT, bitmapHash);
+      runner_print(job, "%s,%u,%016llx,%016llx\n", job->romPath, frame + 1, (unsigned long long)bitmapHash, (unsigned long long)ramHash);
+    }
+  }
+
+  nes_destroy(nes);
+  free(rom);
+  free(movie);
+}
+
+static void* runner_worker(void* arg) {
+  while (true) {
+    pthread_mutex_lock(&jobLock);
+    uint32_t index = nextJob++;
+    pthread_mutex_unlock(&jobLock);
+    if (index >= jobCount) break;
+
+    // each thread has its own machine, so jobs never share state
+    runner_runJob(&jobs[index]);
+
+    // print in list order so runs can be diffed
+    pthread_mutex_lock(&jobLock);
+    jobs[index].done = true;
+    while (nextPrint < jobCount && jobs[nextPrint].done) {
+      RunnerJob* job = &jobs[nextPrint];
+      fwrite(job->output, 1, job->outputSize, stdout);
+      free(job->output);
+      job->output = NULL;
+      nextPrint += 1;
+    }
+    pthread_mutex_unlock(&jobLock);
+  }
+  return NULL;
+}
+
+int main(int argc, char* argv[]) {
+  long threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+  NESCPUMode cpuMode = NES_CPU_INTERPRET_CACHED;
+  NESRenderMode renderMode = NES_RENDER_FRAME;
+  NESTiming timing = NES_TIMING_AUTO;
+  char* codeCachePath = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:e:j:l:c:r:t:k:")) != -1) {
+    switch (opt) {
+      case 'f': frameCount = atoi(optarg); break;
+      case 'c':
+        if (strcmp(optarg, "direct") == 0) cpuMode = NES_CPU_INTERPRET_DIRECT;
+        else if (strcmp(optarg, "cached") == 0) cpuMode = NES_CPU_INTERPRET_CACHED;
+        else if (strcmp(optarg, "static") == 0) cpuMode = NES_CPU_RECOMPILE_STATIC;
+        else {
+          fprintf(stderr, "Unknown CPU mode: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'r':
+        if (strcmp(optarg, "frame") == 0) renderMode = NES_RENDER_FRAME;
+        else if (strcmp(optarg, "scanline") == 0) renderMode = NES_RENDER_SCANLINE;
+        else if (strcmp(optarg, "none") == 0) renderMode = NES_RENDER_NONE;
+        else if (strcmp(optarg, "dot") == 0) renderMode = NES_RENDER_DOT;
+        else {
+          fprintf(stderr, "Unknown PPU renderer: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 't':
+        if (strcmp(optarg, "fast") == 0) timing = NES_TIMING_FAST;
+        else if (strcmp(optarg, "accurate") == 0) timing = NES_TIMING_ACCURATE;
+        else if (strcmp(optarg, "auto") == 0) timing = NES_TIMING_AUTO;
+        else {
+          fprintf(stderr, "Unknown CPU timing: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'k': codeCachePath = optarg; break;
+      case 'e': checkpointInterval = atoi(optarg); break;
+      case 'j': threadCount = atoi(optarg); break;
+      case 'l':
+        if (!runner_readList(optarg)) {
+          fprintf(stderr, "Unable to read %s\n", optarg);
+          return 1;
+        }
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-f FRAMES] [-e EVERY] [-j THREADS] [-l LIST] [-c CPU] [-r RENDERER] [-t TIMING] [-k CACHE_DIR] [ROM ...]\n", argv[0]);
+        return 1;
+    }
+  }
+  for (int i = optind; i < argc; i++) {
+    runner_addJob(argv[i], NULL);
+  }
+  nes_select_engine(cpuMode, renderMode, 0);
+  nes_select_timing(timing);
+  nes_set_code_cache(codeCachePath);
+  if (checkpointInterval == 0) checkpointInterval = 1;
+  if (threadCount < 1) threadCount = 1;
+  if (threadCount > jobCount) threadCount = jobCount;
+
+  printf("rom,frame,bitmap_hash,ram_hash\n");
+
+  pthread_t* threads = malloc(sizeof(pthread_t) * (threadCount > 0 ? threadCount : 1));
+  for (long i = 0; i < threadCount; i++) {
+    pthread_create(&threads[i], NULL, &runner_worker, NULL);
+  }
+  for (long i = 0; i < threadCount; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  for (uint32_t i = 0; i < jobCount; i++) {
+    free(jobs[i].romPath);
+    free(jobs[i].moviePath);
+  }
+  free(jobs);
+  free(threads);
+  return 0;
+}
@@ -0,0 +1,398 @@
+/**
+ * @file search.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "../nes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define SEARCH_MAX_TERMS 16
+#define SEARCH_MAX_ACTIONS 32
+
+/**
+ * @brief Actions tried at each step unless told otherwise: nothing, each
+ *        direction, A, B, and running/jumping right and left
+ */
+static const uint8_t defaultActions[] = {
+  0x00, NES_BUTTON_RIGHT, NES_BUTTON_LEFT, NES_BUTTON_UP, NES_BUTTON_DOWN, NES_BUTTON_A, NES_BUTTON_B,
+  NES_BUTTON_RIGHT | NES_BUTTON_A, NES_BUTTON_RIGHT | NES_BUTTON_B, NES_BUTTON_RIGHT | NES_BUTTON_A | NES_BUTTON_B,
+  NES_BUTTON_LEFT | NES_BUTTON_A
+};
+
+typedef struct {
+  uint16_t addr;
+  int32_t weight;
+} SearchTerm;
+
+typedef struct {
+  uint8_t* state;   // machine state after the last action
+  uint8_t* actions; // one action per step so far
+  int64_t score;
+  uint64_t ramHash; // to drop nodes which reached the same place
+  int parent;
+  uint8_t action;
+} SearchNode;
+
+// options
+uint8_t* rom = NULL;
+uint32_t romSize = 0;
+uint8_t* prefix = NULL;
+uint32_t prefixFrames = 0;
+SearchTerm terms[SEARCH_MAX_TERMS];
+int termCount = 0;
+uint8_t actions[SEARCH_MAX_ACTIONS];
+int actionCount = 0;
+int framesPerStep = 8;
+int depth = 30;
+int beamWidth = 32;
+int emitCount = 1;
+char* moviePrefix = "search";
+
+// the beam, and its expansion which the workers fill in
+size_t stateSize;
+SearchNode* beam = NULL;
+int beamSize = 0;
+SearchNode* candidates = NULL;
+int candidateCount = 0;
+int stepIndex = 0;
+
+int threadCount = 1;
+int nextCandidate = 0;
+int busy = 0;
+uint64_t generation = 0;
+bool quitting = false;
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t start = PTHREAD_COND_INITIALIZER;
+pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+
+static uint8_t* search_readFile(char* path, uint32_t* size) {
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) return NULL;
+  fseek(fp, 0L, SEEK_END);
+  long bytes = ftell(fp);
+  rewind(fp);
+  uint8_t* data = malloc(bytes > 0 ? bytes : 1);
+  *size = fread(data, 1, bytes, fp);
+  fclose(fp);
+  return data;
+}
+
+/**
+ * @brief Parse ADDR[:WEIGHT],... (negative weights minimize)
+ */
+static bool search_parseObjective(char* spec) {
+  for (char* term = strtok(spec, ","); term != NULL; term = strtok(NULL, ",")) {
+    if (termCount == SEARCH_MAX_TERMS) return false;
+    char* end;
+    long addr = strtol(term[0] == '$' ? term + 1 : term, &end, (term[0] == '$') ? 16 : 0);
+    if (end == term || addr < 0 || addr > 0xFFFF) return false;
+    terms[termCount].addr = addr;
+    terms[termCount].weight = (*end == ':') ? strtol(end + 1, NULL, 0) : 1;
+    termCount += 1;
+  }
+  return termCount > 0;
+}
+
+static bool search_parseActions(char* spec) {
+  for (char* action = strtok(spec, ","); action != NULL; action = strtok(NULL, ",")) {
+    if (actionCount == SEARCH_MAX_ACTIONS) return false;
+    actions[actionCount++] = strtol(action, NULL, 0);
+  }
+  return actionCount > 0;
+}
+
+static int64_t search_score(NES* nes) {
+  uint8_t* ram = nes_ram(nes);
+  size_t prgRAMSize;
+  uint8_t* prgRAM = nes_cartridge_ram(nes, &prgRAMSize);
+  int64_t score = 0;
+  for (int i = 0; i < termCount; i++) {
+    uint16_t addr = terms[i].addr;
+    uint8_t val = 0;
+    if (addr < 0x2000) {
+      val = ram[addr & 0x07FF];
+    } else if (addr >= 0x6000 && prgRAM != NULL) {
+      val = prgRAM[(addr - 0x6000) % prgRAMSize];
+    }
+    score += (int64_t)terms[i].weight * val;
+  }
+  return score;
+}
+
+static uint64_t search_hash(const uint8_t* data, size_t size) {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  for (size_t i = 0; i < size; i++) {
+    h = (h ^ data[i]) * 0x100000001B3ULL;
+  }
+  return h;
+}
+
+/**
+ * @brief Clone the parent, hold the action for a step without drawing,
+ *        and score where it ends up
+ */
+static void search_expand(NES* nes, SearchNode* node) {
+  SearchNode* parent = &beam[node->parent];
+  nes_load_state(nes, parent->state);
+  nes_set_input(nes, 0, node->action);
+  bool alive = true;
+  for (int f = 0; f < framesPerStep && alive; f++) {
+    alive = nes_run_frame(nes);
+  }
+  nes_save_state(nes, node->state);
+  memcpy(node->actions, parent->actions, stepIndex);
+  node->actions[stepIndex] = node->action;
+  node->score = alive ? search_score(nes) : INT64_MIN;
+  node->ramHash = search_hash(nes_ram(nes), 2048);
+}
+
+static void* search_worker(void* arg) {
+  // each worker keeps one console for good, since machines are per thread
+  NES* nes = nes_create();
+  nes_load_rom(nes, rom, romSize);
+  nes_set_rendering(nes, 0);
+  uint64_t seen = 0;
+
+  while (true) {
+    pthread_mutex_lock(&lock);
+    while (generation == seen && !quitting) {
+      pthread_cond_wait(&start, &lock);
+    }
+    seen = generation;
+    if (quitting) {
+      pthread_mutex_unlock(&lock);
+      break;
+    }
+    while (nextCandidate < candidateCount) {
+      SearchNode* node = &candidates[nextCandidate++];
+      pthread_mutex_unlock(&lock);
+      search_expand(nes, node);
+      pthread_mutex_lock(&lock);
+    }
+    if (--busy == 0) pthread_cond_signal(&finished);
+    pthread_mutex_unlock(&lock);
+  }
+
+  nes_destroy(nes);
+  return NULL;
+}
+
+static int search_compare(const void* x, const void* y) {
+  const SearchNode* a = x;
+  const SearchNode* b = y;
+  if (a->score != b->score) return (a->score > b->score) ? -1 : 1;
+  // ties go to the earlier candidate, so results don't depend on threads
+  return (a->parent * actionCount + a->action) - (b->parent * actionCount + b->action);
+}
+
+static SearchNode search_allocNode() {
+  SearchNode node;
+  memset(&node, 0, sizeof(node));
+  node.state = malloc(stateSize);
+  node.actions = malloc(depth > 0 ? depth : 1);
+  return node;
+}
+
+/**
+ * @brief Write prefix + actions as a runner movie (2 bytes per frame)
+ */
+static bool search_writeMovie(char* path, SearchNode* node) {
+  FILE* fp = fopen(path, "wb");
+  if (fp == NULL) return false;
+  fwrite(prefix, 1, prefixFrames * NES_PORT_COUNT, fp);
+  for (int s = 0; s < depth; s++) {
+    uint8_t frame[NES_PORT_COUNT] = {node->actions[s], 0};
+    for (int f = 0; f < framesPerStep; f++) {
+      fwrite(frame, 1, NES_PORT_COUNT, fp);
+    }
+  }
+  fclose(fp);
+  return true;
+}
+
+static double search_now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static void search_usage(char* name) {
+  fprintf(stderr, "Usage: %s -o ADDR[:WEIGHT],... [-f FRAMES] [-d DEPTH] [-w WIDTH] [-a ACTIONS] [-j THREADS] [-p MOVIE] [-n COUNT] [-m PREFIX] ROM\n", name);
+}
+
+int main(int argc, char* argv[]) {
+  threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+  char* prefixPath = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "o:f:d:w:a:j:p:n:m:")) != -1) {
+    switch (opt) {
+      case 'o':
+        if (!search_parseObjective(optarg)) {
+          fprintf(stderr, "Invalid objective %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'a':
+        if (!search_parseActions(optarg)) {
+          fprintf(stderr, "Invalid actions %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'f': framesPerStep = atoi(optarg); break;
+      case 'd': depth = atoi(optarg); break;
+      case 'w': beamWidth = atoi(optarg); break;
+      case 'j': threadCount = atoi(optarg); break;
+      case 'p': prefixPath = optarg; break;
+      case 'n': emitCount = atoi(optarg); break;
+      case 'm': moviePrefix = optarg; break;
+      default:
+        search_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc || termCount == 0 || framesPerStep < 1 || depth < 1 || beamWidth < 1) {
+    search_usage(argv[0]);
+    return 1;
+  }
+  if (actionCount == 0) {
+    actionCount = sizeof(defaultActions);
+    memcpy(actions, defaultActions, actionCount);
+  }
+  if (threadCount < 1) threadCount = 1;
+
+  if ((rom = search_readFile(argv[optind], &romSize)) == NULL) {
+    fprintf(stderr, "Unable to read %s\n", argv[optind]);
+    return 1;
+  }
+  uint32_t prefixSize = 0;
+  if (prefixPath != NULL && (prefix = search_readFile(prefixPath, &prefixSize)) == NULL) {
+    fprintf(stderr, "Unable to read %s\n", prefixPath);
+    return 1;
+  }
+  prefixFrames = prefixSize / NES_PORT_COUNT;
+
+  // the root is wherever the prefix movie leaves the game
+  stateSize = nes_state_size();
+  NES* nes = nes_create();
+  if (nes_load_rom(nes, rom, romSize) != NES_LOAD_OK) {
+    fprintf(stderr, "Unable to load %s\n", argv[optind]);
+    return 1;
+  }
+  nes_set_rendering(nes, 0);
+  for (uint32_t f = 0; f < prefixFrames; f++) {
+    for (int port = 0; port < NES_PORT_COUNT; port++) {
+      nes_set_input(nes, port, prefix[f * NES_PORT_COUNT + port]);
+    }
+    nes_run_frame(nes);
+  }
+  beam = malloc(sizeof(SearchNode) * beamWidth);
+  for (int i = 0; i < beamWidth; i++) {
+    beam[i] = search_allocNode();
+  }
+  nes_save_state(nes, beam[0].state);
+  beam[0].score = search_score(nes);
+  beamSize = 1;
+  nes_destroy(nes);
+
+  candidates = malloc(sizeof(SearchNode) * beamWidth * actionCount);
+  for (int i = 0; i < beamWidth * actionCount; i++) {
+    candidates[i] = search_allocNode();
+  }
+
+  pthread_t* threads = malloc(sizeof(pthread_t) * threadCount);
+  for (int i = 0; i < threadCount; i++) {
+    pthread_create(&threads[i], NULL, &search_worker, NULL);
+  }
+
+  uint64_t evaluated = 0;
+  double t0 = search_now();
+  for (stepIndex = 0; stepIndex < depth; stepIndex++) {
+    candidateCount = beamSize * actionCount;
+    evaluated += candidateCount;
+    for (int i = 0; i < candidateCount; i++) {
+      candidates[i].parent = i / actionCount;
+      candidates[i].action = actions[i % actionCount];
+    }
+
+    pthread_mutex_lock(&lock);
+    nextCandidate = 0;
+    busy = threadCount;
+    generation += 1;
+    pthread_cond_broadcast(&start);
+    while (busy > 0) {
+      pthread_cond_wait(&finished, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+
+    // keep the best distinct nodes (swapping buffers, never copying states)
+    qsort(candidates, candidateCount, sizeof(SearchNode), &search_compare);
+    int kept = 0;
+    for (int i = 0; i < candidateCount && kept < beamWidth; i++) {
+      bool duplicate = (candidates[i].score == INT64_MIN);
+      for (int k = 0; k < kept && !duplicate; k++) {
+        duplicate = (beam[k].ramHash == candidates[i].ramHash && beam[k].score == candidates[i].score);
+      }
+      if (duplicate) continue;
+      SearchNode swap = beam[kept];
+      beam[kept] = candidates[i];
+      candidates[i] = swap;
+      kept += 1;
+    }
+    if (kept == 0) {
+      fprintf(stderr, "Every candidate halted the CPU at step %d\n", stepIndex + 1);
+      break;
+    }
+    beamSize = kept;
+    fprintf(stderr, "step %d/%d: best %lld\n", stepIndex + 1, depth, (long long)beam[0].score);
+  }
+  double elapsed = search_now() - t0;
+  int steps = stepIndex;
+
+  pthread_mutex_lock(&lock);
+  quitting = true;
+  pthread_cond_broadcast(&start);
+  pthread_mutex_unlock(&lock);
+  for (int i = 0; i < threadCount; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  fprintf(stderr, "%llu nodes in %.2f s (%.0f frames/s)\n", (unsigned long long)evaluated, elapsed, (evaluated * framesPerStep) / (elapsed > 0 ? elapsed : 1));
+  printf("rank,score,movie\n");
+  depth = steps;
+  for (int i = 0; i < emitCount && i < beamSize; i++) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%d.mov", moviePrefix, i + 1);
+    if (!search_writeMovie(path, &beam[i])) {
+      fprintf(stderr, "Unable to write %s\n", path);
+      return 1;
+    }
+    printf("%d,%lld,%s\n", i + 1, (long long)beam[i].score, path);
+  }
+  return 0;
+}
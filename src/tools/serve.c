@@ -0,0 +1,108 @@
+/**
+ * @file serve.c
+ *
+ * Copyright (c) 2022 Noah Sadir
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "../nes.h"
+#include "../control.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+volatile sig_atomic_t stopRequested = 0;
+
+static void serve_stop(int sig) {
+  stopRequested = 1;
+}
+
+int main(int argc, char* argv[]) {
+  NESCPUMode cpuMode = NES_CPU_INTERPRET_CACHED;
+  NESRenderMode renderMode = NES_RENDER_FRAME;
+  NESTiming timing = NES_TIMING_AUTO;
+  char* codeCachePath = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:r:t:k:")) != -1) {
+    switch (opt) {
+      case 'c':
+        if (strcmp(optarg, "direct") == 0) cpuMode = NES_CPU_INTERPRET_DIRECT;
+        else if (strcmp(optarg, "cached") == 0) cpuMode = NES_CPU_INTERPRET_CACHED;
+        else if (strcmp(optarg, "static") == 0) cpuMode = NES_CPU_RECOMPILE_STATIC;
+        else {
+          fprintf(stderr, "Unknown CPU mode: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'r':
+        if (strcmp(optarg, "frame") == 0) renderMode = NES_RENDER_FRAME;
+        else if (strcmp(optarg, "scanline") == 0) renderMode = NES_RENDER_SCANLINE;
+        else if (strcmp(optarg, "none") == 0) renderMode = NES_RENDER_NONE;
+        else if (strcmp(optarg, "dot") == 0) renderMode = NES_RENDER_DOT;
+        else {
+          fprintf(stderr, "Unknown PPU renderer: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 't':
+        if (strcmp(optarg, "fast") == 0) timing = NES_TIMING_FAST;
+        else if (strcmp(optarg, "accurate") == 0) timing = NES_TIMING_ACCURATE;
+        else if (strcmp(optarg, "auto") == 0) timing = NES_TIMING_AUTO;
+        else {
+          fprintf(stderr, "Unknown CPU timing: %s\n", optarg);
+          return 1;
+        }
+        break;
+      case 'k': codeCachePath = optarg; break;
+      default:
+        fprintf(stderr, "Usage: %s [-c CPU] [-r RENDERER] [-t TIMING] [-k CACHE_DIR] SOCKET [ROM]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "Usage: %s [-c CPU] [-r RENDERER] [-t TIMING] [-k CACHE_DIR] SOCKET [ROM]\n", argv[0]);
+    return 1;
+  }
+  nes_select_engine(cpuMode, renderMode, 0);
+  nes_select_timing(timing);
+  nes_set_code_cache(codeCachePath);
+
+  NES* nes = nes_create();
+  if (!control_open(argv[optind], nes, NULL)) {
+    fprintf(stderr, "Unable to listen on %s\n", argv[optind]);
+    return 1;
+  }
+  // without a ROM here, the client has to send LOAD_ROM first
+  if (optind + 1 < argc && nes_load_rom_file(nes, argv[optind + 1]) != NES_LOAD_OK) {
+    fprintf(stderr, "Unable to load %s\n", argv[optind + 1]);
+  }
+
+  // with no display, the clients are all there is to wait for
+  signal(SIGINT, &serve_stop);
+  signal(SIGTERM, &serve_stop);
+  while (!stopRequested) control_poll(-1);
+
+  control_close();
+  nes_destroy(nes); // flushes the battery save
+  return 0;
+}
@@ -0,0 +1,340 @@
+/**
+ * @file vecenv.c
+ * 
+ * Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "vecenv.h"
+#include "globalflags.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef enum {
+  VEC_LOAD,
+  VEC_RESET,
+  VEC_STEP,
+  VEC_QUIT
+} VecCommand;
+
+typedef struct {
+  NESVec* vec;
+  int index;
+} VecWorker;
+
+struct NESVec {
+  NESVecConfig config;
+  uint8_t* rom;
+  size_t romSize;
+
+  NES** envs;
+  NESLoadResult* loadResults;
+  bool* needsReset;
+  // every console powers on identically, so one copy serves them all
+  uint8_t* initialState;
+  uint8_t* initialFrame;
+  uint8_t initialEmphasis[NES_HEIGHT];
+
+  // colors of the frames' palette indices, 64 per emphasis
+  uint32_t palette[8 * 64];
+
+  NESVecObservations obs;
+  uint8_t* buffer;
+  const uint8_t* inputs;
+
+  pthread_t* threads;
+  VecWorker* workers;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t finished;
+  uint64_t generation;
+  VecCommand command;
+  int busy;
+};
+
+/**
+ * @brief Shrink and convert a frame into an observation
+ */
+static void vecenv_observeFrame(NESVec* vec, const uint8_t* src, const uint8_t* emphasis, uint8_t* dst) {
+  const int d = vec->config.downsample;
+  const int shift = (d == 8) ? 6 : (d == 4) ? 4 : (d == 2) ? 2 : 0; // log2(d * d)
+  const bool grey = (vec->config.format == NES_VEC_GREY);
+
+  for (size_t y = 0; y < vec->obs.frameHeight; y++) {
+    for (size_t x = 0; x < vec->obs.frameWidth; x++) {
+      uint32_t r = 0, g = 0, b = 0;
+      for (int dy = 0; dy < d; dy++) {
+        const uint8_t* row = src + ((y * d + dy) * NES_WIDTH) + (x * d);
+        const uint32_t* colors = vec->palette + (emphasis[y * d + dy] * 64);
+        for (int dx = 0; dx < d; dx++) {
+          uint32_t color = colors[row[dx]];
+          r += (color >> 16) & 0xFF;
+          g += (color >> 8) & 0xFF;
+          b += color & 0xFF;
+        }
+      }
+      r >>= shift;
+      g >>= shift;
+      b >>= shift;
+      if (grey) {
+        *dst++ = ((r * 77) + (g * 150) + (b * 29)) >> 8; // BT.601
+      } else {
+        *dst++ = r;
+        *dst++ = g;
+        *dst++ = b;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Write a console's observation (the frame comes separately, since
+ *        a reset console hasn't drawn one)
+ */
+static void vecenv_observe(NESVec* vec, int env, const uint8_t* frame, const uint8_t* emphasis) {
+  NES* nes = vec->envs[env];
+  vecenv_observeFrame(vec, frame, emphasis, vec->obs.frames + (env * vec->obs.frameSize));
+
+  uint8_t* cpuRAM = nes_ram(nes);
+  size_t prgRAMSize;
+  uint8_t* prgRAM = nes_cartridge_ram(nes, &prgRAMSize);
+  uint8_t* ram = vec->obs.ram + (env * vec->obs.ramCount);
+  for (size_t i = 0; i < vec->obs.ramCount; i++) {
+    uint16_t addr = vec->config.ramAddresses[i];
+    if (addr < 0x2000) {
+      ram[i] = cpuRAM[addr & 0x07FF];
+    } else if (addr >= 0x6000 && prgRAM != NULL) {
+      ram[i] = prgRAM[(addr - 0x6000) % prgRAMSize];
+    } else {
+      ram[i] = 0;
+    }
+  }
+}
+
+static void vecenv_resetEnv(NESVec* vec, int env) {
+  nes_load_state(vec->envs[env], vec->initialState);
+  vec->needsReset[env] = false;
+  vec->obs.done[env] = 0;
+  vec->obs.steps[env] = 0;
+  vecenv_observe(vec, env, vec->initialFrame, vec->initialEmphasis);
+}
+
+static void vecenv_stepEnv(NESVec* vec, int env) {
+  NES* nes = vec->envs[env];
+  if (vec->needsReset[env]) vecenv_resetEnv(vec, env);
+
+  bool halted = false;
+  nes_set_input(nes, 0, vec->inputs[env]);
+  nes_set_rendering(nes, false);
+  for (int i = 1; i < vec->config.frameSkip && !halted; i++) {
+    halted = !nes_run_frame(nes);
+  }
+  nes_set_rendering(nes, true);
+  if (!halted) halted = !nes_run_frame(nes);
+
+  vec->obs.steps[env] += 1;
+  bool done = halted || (vec->config.maxSteps != 0 && vec->obs.steps[env] >= vec->config.maxSteps);
+  vec->obs.done[env] = done;
+  vec->needsReset[env] = done && vec->config.autoReset;
+  vecenv_observe(vec, env, nes_framebuffer_indexed(nes), nes_framebuffer_emphasis(nes));
+}
+
+static void vecenv_loadEnv(NESVec* vec, int env) {
+  NES* nes = nes_create();
+  vec->envs[env] = nes;
+  if (nes == NULL) {
+    vec->loadResults[env] = NES_LOAD_INVALID_ROM;
+    return;
+  }
+  vec->loadResults[env] = nes_load_rom(nes, vec->rom, vec->romSize);
+  if (env == 0 && vec->loadResults[env] == NES_LOAD_OK) {
+    nes_save_state(nes, vec->initialState);
+    memcpy(vec->initialFrame, nes_framebuffer_indexed(nes), NES_WIDTH * NES_HEIGHT);
+    memcpy(vec->initialEmphasis, nes_framebuffer_emphasis(nes), NES_HEIGHT);
+  }
+}
+
+static void* vecenv_work(void* arg) {
+  VecWorker* worker = arg;
+  NESVec* vec = worker->vec;
+  uint64_t generation = 0;
+
+  while (true) {
+    pthread_mutex_lock(&vec->lock);
+    while (vec->generation == generation) {
+      pthread_cond_wait(&vec->start, &vec->lock);
+    }
+    generation = vec->generation;
+    VecCommand command = vec->command;
+    pthread_mutex_unlock(&vec->lock);
+
+    // consoles never move between workers, since their machine lives in
+    // the worker's thread-local state
+    for (int env = worker->index; env < vec->config.envCount; env += vec->config.threadCount) {
+      switch (command) {
+        case VEC_LOAD: vecenv_loadEnv(vec, env); break;
+        case VEC_RESET: vecenv_resetEnv(vec, env); break;
+        case VEC_STEP: vecenv_stepEnv(vec, env); break;
+        case VEC_QUIT: nes_destroy(vec->envs[env]); break;
+      }
+    }
+
+    pthread_mutex_lock(&vec->lock);
+    if (--vec->busy == 0) pthread_cond_signal(&vec->finished);
+    pthread_mutex_unlock(&vec->lock);
+    if (command == VEC_QUIT) return NULL;
+  }
+}
+
+/**
+ * @brief Run a command on every worker and wait for all of them
+ */
+static void vecenv_dispatch(NESVec* vec, VecCommand command) {
+  pthread_mutex_lock(&vec->lock);
+  vec->command = command;
+  vec->busy = vec->config.threadCount;
+  vec->generation += 1;
+  pthread_cond_broadcast(&vec->start);
+  while (vec->busy > 0) {
+    pthread_cond_wait(&vec->finished, &vec->lock);
+  }
+  pthread_mutex_unlock(&vec->lock);
+}
+
+static void vecenv_free(NESVec* vec) {
+  free(vec->rom);
+  free((void*)vec->config.ramAddresses);
+  free(vec->envs);
+  free(vec->loadResults);
+  free(vec->needsReset);
+  free(vec->initialState);
+  free(vec->initialFrame);
+  free(vec->buffer);
+  free(vec->threads);
+  free(vec->workers);
+  pthread_mutex_destroy(&vec->lock);
+  pthread_cond_destroy(&vec->start);
+  pthread_cond_destroy(&vec->finished);
+  free(vec);
+}
+
+NESVec* nes_vec_create(const uint8_t* bytes, size_t len, const NESVecConfig* config, NESLoadResult* result) {
+  if (result != NULL) *result = NES_LOAD_INVALID_ROM;
+  if (config->envCount <= 0) return NULL;
+  int d = (config->downsample == 0) ? 1 : config->downsample;
+  if (d != 1 && d != 2 && d != 4 && d != 8) return NULL;
+  if (bytes == NULL) {
+    if (result != NULL) *result = NES_LOAD_NO_ROM;
+    return NULL;
+  }
+
+  NESVec* vec = calloc(1, sizeof(NESVec));
+  vec->config = *config;
+  vec->config.downsample = d;
+  if (vec->config.frameSkip <= 0) vec->config.frameSkip = 1;
+  // more threads than cores would only take turns themselves
+  if (vec->config.threadCount <= 0) vec->config.threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+  if (vec->config.threadCount <= 0 || vec->config.threadCount > config->envCount) {
+    vec->config.threadCount = config->envCount;
+  }
+  const int k = vec->config.envCount;
+
+  uint16_t* ramAddresses = malloc((config->ramCount > 0 ? config->ramCount : 1) * sizeof(uint16_t));
+  if (config->ramCount > 0) memcpy(ramAddresses, config->ramAddresses, config->ramCount * sizeof(uint16_t));
+  vec->config.ramAddresses = ramAddresses;
+  vec->rom = malloc(len > 0 ? len : 1);
+  memcpy(vec->rom, bytes, len);
+  vec->romSize = len;
+
+  vec->envs = calloc(k, sizeof(NES*));
+  vec->loadResults = calloc(k, sizeof(NESLoadResult));
+  vec->needsReset = calloc(k, sizeof(bool));
+  vec->initialState = malloc(nes_state_size());
+  vec->initialFrame = malloc(NES_WIDTH * NES_HEIGHT);
+  memset(vec->initialFrame, 0x0F, NES_WIDTH * NES_HEIGHT); // black
+  nes_palette(vec->palette, NES_PIXEL_XRGB8888);
+
+  // frames, then RAM, then done flags, then step counts (kept aligned)
+  vec->obs.frameWidth = NES_WIDTH / d;
+  vec->obs.frameHeight = NES_HEIGHT / d;
+  vec->obs.frameSize = vec->obs.frameWidth * vec->obs.frameHeight * ((config->format == NES_VEC_GREY) ? 1 : 3);
+  vec->obs.ramCount = config->ramCount;
+  size_t framesBytes = k * vec->obs.frameSize;
+  size_t ramBytes = k * vec->obs.ramCount;
+  size_t doneBytes = (k + 3) & ~3;
+  vec->buffer = calloc(framesBytes + ramBytes + doneBytes + (k * sizeof(uint32_t)) + 4, 1);
+  vec->obs.frames = vec->buffer;
+  vec->obs.ram = vec->obs.frames + framesBytes;
+  vec->obs.done = vec->obs.ram + ramBytes;
+  vec->obs.steps = (uint32_t*)(((uintptr_t)(vec->obs.done + doneBytes) + 3) & ~(uintptr_t)3);
+
+  pthread_mutex_init(&vec->lock, NULL);
+  pthread_cond_init(&vec->start, NULL);
+  pthread_cond_init(&vec->finished, NULL);
+  vec->threads = calloc(vec->config.threadCount, sizeof(pthread_t));
+  vec->workers = calloc(vec->config.threadCount, sizeof(VecWorker));
+  for (int i = 0; i < vec->config.threadCount; i++) {
+    vec->workers[i].vec = vec;
+    vec->workers[i].index = i;
+    pthread_create(&vec->threads[i], NULL, &vecenv_work, &vec->workers[i]);
+  }
+
+  vecenv_dispatch(vec, VEC_LOAD);
+  NESLoadResult loaded = NES_LOAD_OK;
+  for (int env = 0; env < k && loaded == NES_LOAD_OK; env++) {
+    loaded = vec->loadResults[env];
+  }
+  if (result != NULL) *result = loaded;
+  if (loaded != NES_LOAD_OK) {
+    nes_vec_destroy(vec);
+    return NULL;
+  }
+
+  vecenv_dispatch(vec, VEC_RESET);
+  return vec;
+}
+
+const NESVecObservations* nes_vec_reset(NESVec* vec) {
+  vecenv_dispatch(vec, VEC_RESET);
+  return &vec->obs;
+}
+
+const NESVecObservations* nes_vec_step(NESVec* vec, const uint8_t* inputs) {
+  vec->inputs = inputs;
+  vecenv_dispatch(vec, VEC_STEP);
+  vec->inputs = NULL;
+  return &vec->obs;
+}
+
+const NESVecObservations* nes_vec_observations(NESVec* vec) {
+  return &vec->obs;
+}
+
+void nes_vec_destroy(NESVec* vec) {
+  if (vec == NULL) return;
+  vecenv_dispatch(vec, VEC_QUIT);
+  for (int i = 0; i < vec->config.threadCount; i++) {
+    pthread_join(vec->threads[i], NULL);
+  }
+  vecenv_free(vec);
+}
@@ -0,0 +1,140 @@
+/**
+ * @file vecenv.h
+ * @author Noah Sadir (development.noahsadir@gmail.com)
+ * @brief Lockstep batches of consoles for agents
+ * @version 1.0
+ * @date 2026-10-19
+ * 
+ * @copyright Copyright (c) 2022 Noah Sadir
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef VECENV_H
+#define VECENV_H
+
+/*
+ * Steps K consoles with one call, for agents which would otherwise pay a
+ * foreign function call per console per frame. Like nes.h this is public,
+ * so it only depends on nes.h.
+ *
+ * Each console lives on one worker thread of the batch for its whole life,
+ * and every observation is written into one contiguous buffer laid out as
+ * a structure of arrays: all frames, then all RAM selections, then all
+ * done flags. The pointers stay valid until nes_vec_destroy, and the
+ * contents until the next step or reset.
+ */
+
+#include "nes.h"
+
+/**
+ * @brief How each console's frame is observed
+ */
+typedef enum {
+  NES_VEC_RGB = 0,  // 3 bytes per pixel (R, G, B)
+  NES_VEC_GREY      // 1 byte per pixel (luma)
+} NESVecPixelFormat;
+
+typedef struct {
+  // number of consoles
+  int envCount;
+  // worker threads (0 = one per core, at most one per console). Consoles
+  // sharing a worker take turns, which only costs a save state's copy.
+  int threadCount;
+  // frames emulated per step with the same input (0 = 1); only the last
+  // one is drawn
+  int frameSkip;
+  // episodes end after this many steps (0 = only when the CPU halts)
+  uint32_t maxSteps;
+  // restore a console to power-on at the start of the step after it's done
+  int autoReset;
+
+  NESVecPixelFormat format;
+  // frame is shrunk by averaging factor x factor blocks (1, 2, 4 or 8)
+  int downsample;
+
+  // CPU addresses ($0000-$07FF or $6000-$7FFF) copied into each observation
+  const uint16_t* ramAddresses;
+  size_t ramCount;
+} NESVecConfig;
+
+/**
+ * @brief Batched observations. Console i's data starts at
+ *        frames + i * frameSize, ram + i * ramCount and done + i.
+ */
+typedef struct {
+  uint8_t* frames;
+  size_t frameWidth;
+  size_t frameHeight;
+  size_t frameSize;
+  uint8_t* ram;
+  size_t ramCount;
+  // 1 if the console halted or ran out of steps during the last step
+  uint8_t* done;
+  // steps taken in each console's current episode
+  uint32_t* steps;
+} NESVecObservations;
+
+typedef struct NESVec NESVec;
+
+/**
+ * @brief Create a batch of consoles all running the same ROM. Battery RAM
+ *        starts blank and is never written to disk.
+ * 
+ * @param bytes the contents of the .nes file (copied)
+ * @param len the size of the file (in bytes)
+ * @param config the batch configuration (copied)
+ * @param result the load result, if not NULL
+ * @return NESVec* the batch, or NULL on failure
+ */
+NESVec* nes_vec_create(const uint8_t* bytes, size_t len, const NESVecConfig* config, NESLoadResult* result);
+
+/**
+ * @brief Power every console back on and observe it
+ * 
+ * @param vec the batch
+ * @return const NESVecObservations* the observations
+ */
+const NESVecObservations* nes_vec_reset(NESVec* vec);
+
+/**
+ * @brief Advance every console by one step in lockstep
+ * 
+ * @param vec the batch
+ * @param inputs envCount controller 1 button bitfields (NES_BUTTON_ flags)
+ * @return const NESVecObservations* the observations after the step
+ */
+const NESVecObservations* nes_vec_step(NESVec* vec, const uint8_t* inputs);
+
+/**
+ * @brief Get the observations of the last step or reset
+ * 
+ * @param vec the batch
+ * @return const NESVecObservations* the observations
+ */
+const NESVecObservations* nes_vec_observations(NESVec* vec);
+
+/**
+ * @brief Stop the workers and free every console
+ * 
+ * @param vec the batch
+ */
+void nes_vec_destroy(NESVec* vec);
+
+#endif